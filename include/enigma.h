@@ -0,0 +1,203 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * libenigma implements a simulation of the Enigma M3 cipher machine. It is the library
+ * behind enigma-cli. Build it with `make libenigma.a` or `make libenigma.so`.
+ *
+ * All functions are thread-safe: the only state is the `Enigma` (and `EnigmaTable`)
+ * passed in by the caller, and the detailed message describing the last setup error,
+ * which is kept per thread. No function allocates memory; all buffers are supplied by
+ * the caller.
+ *
+ *
+ * EXAMPLE:
+ *
+ *     Enigma enigma;
+ *     EnigmaSettings settings = {"UKW-B", "II IV I", "6 17 26", "AC LS BQ", "HAG"};
+ *     EnigmaError err = configure_enigma(&enigma, &settings);
+ *     if (err != ENIGMA_OK) {
+ *         fprintf(stderr, "%s: %s\n", enigma_strerror(err), enigma_error_message());
+ *         return 1;
+ *     }
+ *
+ *     char output[64];
+ *     size_t n = encipher_text(ENGINE_SIMD, NULL, &enigma, output, "Hello, World!", 13);
+ *     printf("%.*s\n", (int) n, output);
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef ENIGMA_H
+#define ENIGMA_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*--- Public macros ---------------------------------------------------------------------*/
+
+#define ENIGMA_API __attribute__((visibility("default")))
+
+#define N_POSITIONS (26 * 26 * 26) // number of distinct (left, middle, right) rotor positions
+#define MAX_CRIBS 64               // max. number of cribs placed at once by `place_cribs`
+#define BITSLICE_LANES 256         // number of keys tried at once by `score_keys`
+#define MESSAGE_LANES 32           // number of messages enciphered at once by `encipher_messages`
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+/**
+ * Represents a substitution on the set of letters in the enigma alphabet.
+ * `image[26]` represents the image of the substitution in alphabetical 
+ * order. I.e. using Cauchy's two-line notation:
+ *
+ *     | ABCDEFGHIJKLMNOPQRSTUVWXYZ |
+ *     |         image[26]          |
+ *
+ * E.g. a ROT13 cipher would look like this:
+ *
+ *     | ABCDEFGHIJKLMNOPQRSTUVWXYZ |
+ *     | NOPQRSTUVWXYZABCDEFGHIJKLM |
+ *
+ */
+typedef struct {
+    uint8_t image[26];
+} Substitution;
+
+/* 
+ * Represents an Enigma machine rotor including its ring setting and 
+ * position (even though, strictly speaking, the rotor position is not
+ * an attribute of the actual rotor).
+ */
+typedef struct {
+    Substitution forward;
+    Substitution reverse;
+    uint8_t turnover1;
+    uint8_t turnover2; /* only valid for rotors VI, VII, and VIII */
+    uint8_t ring_setting;
+    uint8_t position;
+} Rotor;
+
+/* 
+ * Represents an Enigma M3 machine.
+ *
+ * Note: Rotors are indexed from left to right as seen from the perspective of the 
+ *       machine operator; i.e. rotor[0] is the leftmost (slow) rotor, and rotor[2] 
+ *       is the rightmost (fast) rotor.
+ */
+typedef struct {
+    Rotor rotor[3];
+    Substitution reflector;
+    Substitution plugboard;
+} Enigma;
+
+/*
+ * The settings of an Enigma machine as given on the command line. See `configure_enigma`.
+ */
+typedef struct {
+    const char *reflector;
+    const char *rotors;
+    const char *ring;
+    const char *plugboard;
+    const char *indicator;
+} EnigmaSettings;
+
+/*
+ * Represents an Enigma machine which has been "compiled" into a table of composite
+ * substitutions; one for every possible rotor position. `image[pos]` is the complete
+ * substitution (plugboard, rotors, reflector, rotors, and plugboard again) performed by
+ * the machine when its rotors are at position `pos`, and `next[pos]` is the position the
+ * rotors move to on the next keypress. Rotor positions are packed into a single number
+ * as (left * 26 * 26 + middle * 26 + right). See `compile_enigma`.
+ *
+ * Note: This is ~470 KiB large. Allocate it on the heap.
+ */
+typedef struct {
+    Substitution image[N_POSITIONS];
+    uint16_t next[N_POSITIONS];
+} EnigmaTable;
+
+typedef enum {
+    ENGINE_REFERENCE,
+    ENGINE_TABLE,
+    ENGINE_SIMD,
+    ENGINE_SEGMENT,
+} Engine;
+
+/*
+ * Returned by the machine setup functions. `enigma_error_message` describes the error
+ * in more detail.
+ */
+typedef enum {
+    ENIGMA_OK = 0,
+    ENIGMA_INVALID_REFLECTOR,
+    ENIGMA_INVALID_ROTOR,
+    ENIGMA_INVALID_RING_SETTING,
+    ENIGMA_INVALID_PLUGBOARD,
+    ENIGMA_INVALID_INDICATOR,
+} EnigmaError;
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/* Basic interface */
+ENIGMA_API size_t encipher_str(Enigma *enigma, char *output, const char *input);
+ENIGMA_API size_t encipher_str_table(const EnigmaTable *table, Enigma *enigma, char *output, const char *input);
+ENIGMA_API uint8_t encipher_char(Enigma *enigma, char c);
+ENIGMA_API void advance_enigma(Enigma *enigma, uint64_t n);
+ENIGMA_API void compile_enigma(EnigmaTable *table, const Enigma *enigma);
+
+/* Bulk interface */
+ENIGMA_API size_t encipher_text(Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                                char *output, const char *input, size_t length);
+ENIGMA_API void encipher_letters(Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                                 char *output, const char *letters, size_t length);
+ENIGMA_API size_t filter_letters(char *letters, const char *input, size_t length);
+ENIGMA_API void encipher_messages(Enigma *enigmas, char *const *outputs, const char *const *messages, 
+                                  const size_t *lengths, size_t n_messages);
+
+/* Cryptanalysis */
+ENIGMA_API size_t place_cribs(const char *ciphertext, size_t length, const char *const *cribs, 
+                              const size_t *crib_lengths, size_t n_cribs, uint64_t *feasible);
+ENIGMA_API size_t score_keys(const Enigma *keys, size_t n_keys, const char *ciphertext, size_t length, 
+                             uint64_t *scores);
+
+/* Machine setup */
+ENIGMA_API EnigmaError configure_enigma(Enigma *enigma, const EnigmaSettings *settings);
+ENIGMA_API EnigmaError apply_reflector_setting(Enigma *enigma, const char *str);
+ENIGMA_API EnigmaError apply_rotor_setting(Enigma *enigma, const char *str);
+ENIGMA_API EnigmaError apply_ring_setting(Enigma *enigma, const char *str);
+ENIGMA_API EnigmaError apply_plugboard_setting(Enigma *enigma, const char *str);
+ENIGMA_API EnigmaError apply_indicator_setting(Enigma *enigma, const char *str);
+
+/* Errors */
+ENIGMA_API const char *enigma_strerror(EnigmaError err);
+ENIGMA_API const char *enigma_error_message(void);
+
+#endif /* ENIGMA_H */
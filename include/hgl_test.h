@@ -511,8 +511,9 @@ void hgl_test_run_test(HglTest *test)
         write(pipes[0][1], test->input, strlen(test->input));
     }
 
-    /* close unused pipe ends */
+    /* close unused pipe ends (and the input write end, so the child sees EOF) */
     close(pipes[0][0]);
+    close(pipes[0][1]);
     close(pipes[1][1]);
 
     /* maybe clear stdout_buffer */
@@ -560,8 +561,7 @@ void hgl_test_run_test(HglTest *test)
              stdout_buffer, sizeof(stdout_buffer) - 1);
     }
 
-    /* close remaining pipe ends */
-    close(pipes[0][1]);
+    /* close remaining pipe end */
     close(pipes[1][0]);
 
     /* determine test result */
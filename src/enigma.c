@@ -0,0 +1,1830 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * libenigma implements the Enigma M3 simulation used by enigma-cli: machine setup, the
+ * reference, table, SIMD, and segment enciphering engines, input filtering, and crib 
+ * placement. See enigma.h for the public interface.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define ENIGMA_X86_SIMD
+#endif
+
+#include "enigma.h"
+
+#define HGL_STRING_IMPLEMENTATION
+#include "hgl_string.h"
+
+/*--- Private macros --------------------------------------------------------------------*/
+
+/* 
+ * Used by the machine setup functions, which must never exit or print anything. Places 
+ * the message in `setup_error` and makes the enclosing function return `err`.
+ */
+#define SETUP_ASSERT(cond, err, ...)                                         \
+    if (!(cond)) {                                                           \
+        snprintf(setup_error, sizeof(setup_error), __VA_ARGS__);             \
+        return (err);                                                        \
+    }
+#define SETUP_ERROR(err, ...)                                                \
+    do {                                                                     \
+        snprintf(setup_error, sizeof(setup_error), __VA_ARGS__);             \
+        return (err);                                                        \
+    } while (0)
+
+#define ENCODE(c) ((c) - 'A') // maps A-Z  --> 0-25
+#define DECODE(n) ((n) + 'A') // maps 0-25 --> A->Z
+
+#define SIMD_BLOCK_SIZE 32 // number of letters enciphered at once by the SIMD kernels
+#define LANE_BLOCK_SIZE 32 // number of letters enciphered per lane by one call to a lane kernel
+
+/*--- Private type definitions ----------------------------------------------------------*/
+
+typedef bool      b8;
+typedef uint8_t   u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t    i8;
+typedef int16_t  i16;
+typedef int32_t  i32;
+typedef int64_t  i64;
+static_assert(sizeof(b8) == 1, "");
+
+typedef enum {
+    FORWARD,
+    REVERSE,
+} Direction;
+
+/*
+ * A substitution laid out for the SIMD kernels: the image is stored in its numerical
+ * encoding (0-25) and padded to 32 bytes, so that each half (the arguments 0-15 and 
+ * 16-25, respectively) fits a single byte shuffle.
+ */
+typedef struct {
+    u8 image[32];
+} SimdSubstitution;
+
+/*
+ * The substitutions of an Enigma machine, laid out for the SIMD kernels. The ring 
+ * settings are folded into the rotor substitutions (see `prepare_simd_enigma`).
+ */
+typedef struct {
+    SimdSubstitution plugboard;
+    SimdSubstitution reflector;
+    SimdSubstitution forward[3];
+    SimdSubstitution reverse[3];
+} SimdEnigma;
+
+/*
+ * A SIMD kernel. Enciphers the SIMD_BLOCK_SIZE letters at `input` (encoded as 0-25) into
+ * `output`, where `positions[i][k]` is the position of rotor i when letter k is enciphered.
+ */
+typedef void (*SimdKernel)(const SimdEnigma *simd, u8 *output, const u8 *input,
+                           const u8 positions[3][SIMD_BLOCK_SIZE]);
+
+/*
+ * MESSAGE_LANES machines with settings of their own, laid out for the lane kernels of 
+ * `encipher_messages`: lane l runs machine l. The substitutions of each lane are laid out
+ * as for the SIMD kernels (see `prepare_simd_enigma`), and the rotor positions and notches
+ * are kept in 32-bit words, lane by lane, so that whole vectors of lanes can be loaded.
+ */
+typedef struct {
+    SimdSubstitution plugboard[MESSAGE_LANES];
+    SimdSubstitution reflector[MESSAGE_LANES];
+    SimdSubstitution forward[3][MESSAGE_LANES];
+    SimdSubstitution reverse[3][MESSAGE_LANES];
+    u32 position[3][MESSAGE_LANES];
+    u32 turnover[3][2][MESSAGE_LANES];
+} LaneEnigmas;
+
+/*
+ * A lane kernel. Steps every lane of `lanes` `n_steps` (at most LANE_BLOCK_SIZE) times, 
+ * and enciphers letter `block[i][l]` (encoded as 0-25) in place at step i of lane l.
+ */
+typedef void (*LaneKernel)(LaneEnigmas *lanes, u8 block[LANE_BLOCK_SIZE][MESSAGE_LANES], size_t n_steps);
+
+/*
+ * A machine word of BITSLICE_LANES bits, one per lane of a bitsliced machine. Bitwise 
+ * operators apply to all lanes at once (in as many SIMD registers as the target needs).
+ */
+typedef u64 Lanes __attribute__((vector_size(BITSLICE_LANES / 8)));
+
+/*
+ * A plugboard pair of a bitsliced machine: the lanes in which letters a and b are 
+ * plugged together.
+ */
+typedef struct {
+    u8 a;
+    u8 b;
+    Lanes lanes;
+} BitslicedPlug;
+
+/*
+ * BITSLICE_LANES machines sharing a reflector and rotor order, bitsliced for `score_keys`.
+ * Each bit (lane) of a Lanes belongs to one machine. A letter is held one-hot, in 26 words:
+ * bit l of word n is set if lane l holds letter n. Substitutions shared by all lanes then
+ * only move words around. The rotor offsets (position - ring setting, modulo 26) of the 
+ * lanes are held in 5 bit planes: bit l of offset[r][b] is bit b of the offset of rotor
+ * r in lane l.
+ *
+ * Since the right rotor turns on every keypress in every lane, its offset is split into
+ * the per-lane start offset `right_start` and the shared number of keypresses `t` (modulo
+ * 26). The turns by t are folded into the right rotor substitutions (`right_forward[t]`, 
+ * `right_reverse[t]`), and the plugboard and the turn by `right_start` on the way in are
+ * applied to every possible ciphertext letter up front (`entry`).
+ */
+typedef struct {
+    Lanes lanes;                        /* the lanes in use */
+    u8 reflector[26];
+    u8 forward[3][26];
+    u8 reverse[3][26];
+    u8 right_forward[26][26];
+    u8 right_reverse[26][26];
+    Lanes offset[3][5];
+    Lanes notch[3][2][5];               /* the offsets at which the rotors are at their notches */
+    Lanes right_start[5];
+    Lanes entry[26][26];                /* entry[c] is ciphertext letter c, after the plugboard 
+                                         and the turn by `right_start` */
+    u8 t;
+    BitslicedPlug plugs[26 * 25 / 2];     /* one for each pair of letters in use */
+    size_t n_plugs;
+} BitslicedEnigma;
+
+/*
+ * The scratch space of `score_keys`, which is too large for the stack. counts[n][b] is bit 
+ * plane b of the number of n's deciphered so far in each lane.
+ */
+typedef struct {
+    BitslicedEnigma machine;
+    Lanes counts[26][64];
+} BitslicedScorer;
+
+/*--- Private constants -----------------------------------------------------------------*/
+
+/**
+ * These are the 8 different rotor supplied with the Enigma M3. The last three rotors were
+ * only used by the german navy (Kriegsmarine) and have, whilst the the first five were used
+ * by all branches of the German Forces, including the navy. The navy's rotors (VI, VII, and 
+ * VII) are special because they have two turnover notches, meaning for every complete 
+ * revolution of such a rotor, the rotor to the left of it will have stepped at least twice (
+ * I write "at least" here, because of the peculiar double-stepping quirk of the Enigma).
+ */
+static const Rotor ROTOR_I    = {{"EKMFLGDQVZNTOWYHXUSPAIBRCJ"}, {"UWYGADFPVZBECKMTHXSLRINQOJ"}, ENCODE('Q'), 255 /* no second turnover */, 0, 0};
+static const Rotor ROTOR_II   = {{"AJDKSIRUXBLHWTMCQGZNPYFVOE"}, {"AJPCZWRLFBDKOTYUQGENHXMIVS"}, ENCODE('E'), 255 /* no second turnover */, 0, 0};
+static const Rotor ROTOR_III  = {{"BDFHJLCPRTXVZNYEIWGAKMUSQO"}, {"TAGBPCSDQEUFVNZHYIXJWLRKOM"}, ENCODE('V'), 255 /* no second turnover */, 0, 0};
+static const Rotor ROTOR_IV   = {{"ESOVPZJAYQUIRHXLNFTGKDCMWB"}, {"HZWVARTNLGUPXQCEJMBSKDYOIF"}, ENCODE('J'), 255 /* no second turnover */, 0, 0};
+static const Rotor ROTOR_V    = {{"VZBRGITYUPSDNHLXAWMJQOFECK"}, {"QCYLXWENFTZOSMVJUDKGIARPHB"}, ENCODE('Z'), 255 /* no second turnover */, 0, 0};
+static const Rotor ROTOR_VI   = {{"JPGVOUMFYQBENHZRDKASXLICTW"}, {"SKXQLHCNWARVGMEBJPTYFDZUIO"}, ENCODE('Z'), ENCODE('M'), 0, 0};
+static const Rotor ROTOR_VII  = {{"NZJHGRCXMYSWBOUFAIVLPEKQDT"}, {"QMGYVPEDRCWTIANUXFKZOSLHJB"}, ENCODE('Z'), ENCODE('M'), 0, 0};
+static const Rotor ROTOR_VIII = {{"FKQHTLXOCBJSPDZRAMEWNIUYGV"}, {"QJINSAYDVKBFRUHMCPLEWZTGXO"}, ENCODE('Z'), ENCODE('M'), 0, 0};
+
+/**
+ * These are three reflectors (Umkehrwalze) used in various versions of the Enigma machine.
+ * Typically, for the M3 variant, either UKW-B or UKW-C were used. Later in the war, the
+ * germans developed the UKW-D rewireable reflector. I'll probably add this in the future
+ * when I'm bored. Info: https://www.cryptomuseum.com/crypto/enigma/ukwd/
+ */
+static const Substitution UKW_A = {"EJMZALYXVBWFCRQUONTSPIKHGD"};
+static const Substitution UKW_B = {"YRUHQSLDPXNGOKMIEBFZCWVJAT"};
+static const Substitution UKW_C = {"FVPJIAOYEDRZXWGCTKUQSBNMHL"};
+
+/**
+ * By default, with no connections made at the plugboard, no substitutions are made.
+ */
+static const Substitution BARE_PLUGBOARD = {"ABCDEFGHIJKLMNOPQRSTUVWXYZ"};
+
+/*--- Private variables -----------------------------------------------------------------*/
+
+/**
+ * Describes why the last machine setup function (e.g. `configure_enigma`) called by this
+ * thread failed.
+ */
+static _Thread_local char setup_error[256];
+
+/*--- Function prototypes ---------------------------------------------------------------*/
+
+/* Machine logic */
+static void step_rotors(Enigma *enigma);
+static u8 apply_machine_subst(const Enigma *enigma, u8 n);
+static u16 pack_positions(const Enigma *enigma);
+static void unpack_positions(Enigma *enigma, u16 pos);
+static b8 is_at_turnover(const Rotor *r);
+static b8 is_turnover(const Rotor *r, u8 position);
+static void step_rotor(Rotor *r);
+static u8 apply_rotor_subst(const Rotor *r, Direction dir, u8 n);
+static u8 apply_subst(const Substitution *s, u8 n);
+
+/* Filtering */
+static size_t filter_letters_scalar(char *letters, const char *input, size_t length);
+#ifdef ENIGMA_X86_SIMD
+static size_t filter_letters_avx2(char *letters, const char *input, size_t length);
+#endif
+
+/* Bitsliced engine */
+static void prepare_bitsliced_enigma(BitslicedEnigma *bs, const Enigma *enigmas, size_t n_lanes);
+static void step_bitsliced_rotors(BitslicedEnigma *bs);
+static void decipher_bitsliced_letter(const BitslicedEnigma *bs, u8 c, Lanes x[26]);
+static void bitsliced_equals(Lanes *equal, const Lanes x[5], const Lanes y[5]);
+static void bitsliced_increment(Lanes x[5], const Lanes *mask);
+static void bitsliced_subtract(Lanes diff[5], const Lanes x[5], const Lanes y[5]);
+static void turn_bitsliced_letters(Lanes x[26], const Lanes offset[5], b8 backwards, const Lanes *lanes);
+static void substitute_bitsliced_letters(Lanes x[26], const u8 s[26]);
+static void plug_bitsliced_letters(const BitslicedEnigma *bs, Lanes x[26]);
+static inline b8 lanes_equal(const Lanes *x, const Lanes *y);
+static inline b8 lanes_empty(const Lanes *x);
+
+/* Crib placement */
+static u32 place_crib_scalar(const char *ciphertext, const char *crib, size_t crib_length, size_t n_offsets);
+#ifdef ENIGMA_X86_SIMD
+static u32 place_crib_avx2(const char *ciphertext, const char *crib, size_t crib_length);
+#endif
+
+/* Segment engine */
+static void encipher_letters_segment(Enigma *enigma, char *output, const char *letters, size_t length);
+
+/* SIMD engine */
+static void encipher_letters_simd(Enigma *enigma, char *output, const char *letters, size_t length);
+static void prepare_simd_enigma(SimdEnigma *simd, const Enigma *enigma);
+static void prepare_simd_substitution(SimdSubstitution *simd, const Substitution *s, u8 ring_setting);
+static SimdKernel select_simd_kernel(void);
+#ifdef ENIGMA_X86_SIMD
+static void encipher_block_avx2(const SimdEnigma *simd, u8 *output, const u8 *input,
+                                const u8 positions[3][SIMD_BLOCK_SIZE]);
+static void encipher_block_ssse3(const SimdEnigma *simd, u8 *output, const u8 *input,
+                                 const u8 positions[3][SIMD_BLOCK_SIZE]);
+#endif
+
+/* Multi-lane engine */
+static void load_lane(LaneEnigmas *lanes, size_t l, const Enigma *enigma);
+static void store_lane(const LaneEnigmas *lanes, size_t l, Enigma *enigma);
+static LaneKernel select_lane_kernel(void);
+static void encipher_lanes_scalar(LaneEnigmas *lanes, u8 block[LANE_BLOCK_SIZE][MESSAGE_LANES], size_t n_steps);
+#ifdef ENIGMA_X86_SIMD
+static void encipher_lanes_avx2(LaneEnigmas *lanes, u8 block[LANE_BLOCK_SIZE][MESSAGE_LANES], size_t n_steps);
+#endif
+
+/* Helpers */
+static size_t lex_numeric(HglStringView sv);
+static size_t lex_letter(HglStringView sv);
+static char to_upper(char c);
+static char in_alphabet(char c);
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/**
+ * Enciphers (or deciphers) the string at `input`, places the result into `output`, and
+ * returns the length of the enciphered (or deciphered) output. 
+ */
+size_t encipher_str(Enigma *enigma, char *output, const char *input)
+{
+    char *wr = output;
+
+    char c;
+    do {
+        c = *input++;
+        c = to_upper(c);
+
+        /* Skip unrecognized letters */
+        if (!in_alphabet(c)) {
+            continue;
+        }
+
+        /* encipher (or decipher ... transcipher? cipher?) character */
+        *wr++ = encipher_char(enigma, c);
+    } while (c != '\0');
+
+    return wr - output;
+}
+
+/**
+ * Same as `encipher_str`, but uses the precompiled `table` (see `compile_enigma`) instead
+ * of walking the signal through the individual rotors. `table` must have been compiled
+ * from `enigma`. The rotor positions of `enigma` are updated accordingly.
+ */
+size_t encipher_str_table(const EnigmaTable *table, Enigma *enigma, char *output, const char *input)
+{
+    char *wr = output;
+    u16 pos = pack_positions(enigma);
+
+    char c;
+    do {
+        c = *input++;
+        c = to_upper(c);
+
+        /* Skip unrecognized letters */
+        if (!in_alphabet(c)) {
+            continue;
+        }
+
+        pos = table->next[pos];
+        *wr++ = table->image[pos].image[ENCODE(c)];
+    } while (c != '\0');
+
+    unpack_positions(enigma, pos);
+    return wr - output;
+}
+
+
+/**
+ * Enciphers (or deciphers) a single character (or letter) `c` given the current machine
+ * settings and updates the rotor positions accordingly. 
+ *
+ * NB:`c` must be in the enigma alphabet and upper-case. 
+ */
+u8 encipher_char(Enigma *enigma, char c)
+{
+    /* 1. advance rotors */
+    step_rotors(enigma);
+
+    /* 2. encipher character */
+    u8 n = ENCODE(c); 
+    n = apply_machine_subst(enigma, n);
+    return DECODE(n);
+}
+
+/**
+ * Advances the rotors of `enigma` to where they would be after `n` keypresses, in 
+ * constant time. I.e. this is equivalent to, but a lot faster than, calling
+ * `encipher_char` `n` times and discarding the results.
+ *
+ * The right rotor simply turns once per keypress. The middle rotor is stepped by the
+ * right rotor once for each turnover notch the right rotor passes, and, whenever this 
+ * lands the middle rotor on one of its own notches, it steps again on the following 
+ * keypress, taking the left rotor along with it (the double step). Hence, for every full
+ * revolution of the middle rotor, the right rotor must pass (26 - #notches) notches, and 
+ * the left rotor steps once per notch of the middle rotor. 
+ *
+ * NB: This assumes that no rotor has two adjacent notches, which holds for all the
+ *     rotors I-VIII.
+ */
+void advance_enigma(Enigma *enigma, u64 n)
+{
+    Rotor *left   = &enigma->rotor[0];
+    Rotor *middle = &enigma->rotor[1];
+    Rotor *right  = &enigma->rotor[2];
+    if (n == 0) {
+        return;
+    }
+
+    /* 
+     * If the middle rotor already sits on a notch, the first keypress is a double step 
+     * (which also swallows any step from the right rotor). Take it by hand so that the
+     * middle rotor is off its notches from here on.
+     */
+    if (is_at_turnover(middle)) {
+        step_rotors(enigma);
+        n--;
+    }
+
+    /* count the keypresses in [1, n] on which the right rotor sits on a notch */
+    u64 n_carries = 0;
+    b8 carry_on_last_keypress = false;
+    u8 right_notches[2] = {right->turnover1, right->turnover2};
+    for (int i = 0; i < 2; i++) {
+        if (right_notches[i] >= 26) continue;
+        u64 first = (right_notches[i] - right->position + 26) % 26; /* 0-based keypress */
+        if (first < n) {
+            n_carries += (n - 1 - first) / 26 + 1;
+            carry_on_last_keypress |= ((n - 1 - first) % 26 == 0);
+        }
+    }
+
+    /* move the middle (and left) rotor accordingly */
+    u8 n_middle_notches = 1 + (middle->turnover2 < 26);
+    u64 carries_per_revolution = 26 - n_middle_notches;
+    u64 revolutions = n_carries / carries_per_revolution;
+    u64 left_steps = revolutions * n_middle_notches;
+    u8 middle_position = middle->position;
+    for (u64 i = 0; i < n_carries % carries_per_revolution; i++) {
+        middle_position = (middle_position + 1) % 26;
+        if (is_turnover(middle, middle_position)) {
+            middle_position = (middle_position + 1) % 26;
+            left_steps++;
+        }
+    }
+
+    /* 
+     * If the last carry landed the middle rotor on a notch on the very last keypress, 
+     * the double step is yet to happen.
+     */
+    u8 previous_middle_position = (middle_position + 25) % 26;
+    if (n_carries > 0 && carry_on_last_keypress && is_turnover(middle, previous_middle_position)) {
+        middle_position = previous_middle_position;
+        left_steps--;
+    }
+
+    right->position  = (right->position + n) % 26;
+    middle->position = middle_position;
+    left->position   = (left->position + left_steps) % 26;
+}
+
+/**
+ * Compiles the fully configured machine `enigma` (rotors, ring settings, reflector and 
+ * plugboard) into `table`. The rotor positions of `enigma` are irrelevant, since all 
+ * positions are compiled.
+ */
+void compile_enigma(EnigmaTable *table, const Enigma *enigma)
+{
+    Enigma e = *enigma;
+    for (u16 pos = 0; pos < N_POSITIONS; pos++) {
+        unpack_positions(&e, pos);
+        for (u8 n = 0; n < 26; n++) {
+            table->image[pos].image[n] = DECODE(apply_machine_subst(&e, n));
+        }
+        step_rotors(&e);
+        table->next[pos] = pack_positions(&e);
+    }
+}
+
+/**
+ * Sets up `enigma` according to `settings`. Returns ENIGMA_OK, or the error of the first
+ * invalid setting, in which case `enigma_error_message` describes it. If the indicator 
+ * setting is NULL, all rotors are left at position A.
+ */
+EnigmaError configure_enigma(Enigma *enigma, const EnigmaSettings *settings)
+{
+    EnigmaError err = apply_reflector_setting(enigma, settings->reflector);
+    if (err == ENIGMA_OK) err = apply_rotor_setting(enigma, settings->rotors);
+    if (err == ENIGMA_OK) err = apply_ring_setting(enigma, settings->ring);
+    if (err == ENIGMA_OK) err = apply_plugboard_setting(enigma, settings->plugboard);
+    if (err == ENIGMA_OK && settings->indicator != NULL) {
+        err = apply_indicator_setting(enigma, settings->indicator);
+    }
+    return err;
+}
+
+/**
+ * Mounts the given reflector ("Umkehrwalze") to the machine.
+ */
+EnigmaError apply_reflector_setting(Enigma *enigma, const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    if (hgl_sv_equals(sv, HGL_SV("UKW-A"))) {
+        enigma->reflector = UKW_A;
+    } else if (hgl_sv_equals(sv, HGL_SV("UKW-B"))) {
+        enigma->reflector = UKW_B;
+    } else if (hgl_sv_equals(sv, HGL_SV("UKW-C"))) {
+        enigma->reflector = UKW_C;
+    } else {
+        SETUP_ERROR(ENIGMA_INVALID_REFLECTOR, "Unknown reflector \"" HGL_SV_FMT "\".", HGL_SV_ARG(sv));
+    }
+    return ENIGMA_OK;
+}
+
+/**
+ * Mounts the given rotors (e.g. "I VI II", from left to right, as seen from the 
+ * machine operator) in the machine ("Walzenlage"). 
+ *
+ * NB: This will reset any earlier applied ring- and indicator settings.
+ *
+ */
+EnigmaError apply_rotor_setting(Enigma *enigma, const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    for (int i = 0; i < 3; i++) {
+        HglStringView r = hgl_sv_trim(hgl_sv_lchop_until(&sv, ' '));
+        if (hgl_sv_equals(r, HGL_SV("I"))) {
+            enigma->rotor[i] = ROTOR_I;
+        } else if (hgl_sv_equals(r, HGL_SV("II"))) {
+            enigma->rotor[i] = ROTOR_II;
+        } else if (hgl_sv_equals(r, HGL_SV("III"))) {
+            enigma->rotor[i] = ROTOR_III;
+        } else if (hgl_sv_equals(r, HGL_SV("IV"))) {
+            enigma->rotor[i] = ROTOR_IV;
+        } else if (hgl_sv_equals(r, HGL_SV("V"))) {
+            enigma->rotor[i] = ROTOR_V;
+        } else if (hgl_sv_equals(r, HGL_SV("VI"))) {
+            enigma->rotor[i] = ROTOR_VI;
+        } else if (hgl_sv_equals(r, HGL_SV("VII"))) {
+            enigma->rotor[i] = ROTOR_VII;
+        } else if (hgl_sv_equals(r, HGL_SV("VIII"))) {
+            enigma->rotor[i] = ROTOR_VIII;
+        } else {
+            SETUP_ERROR(ENIGMA_INVALID_ROTOR, "Unknown rotor \"" HGL_SV_FMT "\".", HGL_SV_ARG(r));
+        }
+    }
+    return ENIGMA_OK;
+}
+
+/**
+ * Applies an indicator (or "Ringstellung") setting (e.g. "ABC" or "1 2 3") to 
+ * the currently mounted rotors.
+ */
+EnigmaError apply_ring_setting(Enigma *enigma, const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    for (int i = 0; i < 3; i++) {
+        HglStringView l;
+        sv = hgl_sv_trim(sv);
+        l = hgl_sv_lchop_lexeme(&sv, lex_numeric);
+        if (l.length != 0) {
+            enigma->rotor[i].ring_setting = (u8) hgl_sv_to_u64(l) - 1;
+            continue;
+        }
+        l = hgl_sv_lchop_lexeme(&sv, lex_letter);
+        if (l.length != 0) {
+            enigma->rotor[i].ring_setting = ENCODE(to_upper(l.start[0]));
+            continue;
+        }
+        SETUP_ERROR(ENIGMA_INVALID_RING_SETTING, "Invalid ring setting \"%s\".", str);
+    }
+    SETUP_ASSERT(hgl_sv_trim(sv).length == 0, ENIGMA_INVALID_RING_SETTING, "Invalid ring setting \"%s\".", str);
+    return ENIGMA_OK;
+}
+
+/**
+ * Applies a plugboard (or "Steckerverbindungen") setting (e.g. "ab cd ef gh") 
+ * to the machine.
+ */
+EnigmaError apply_plugboard_setting(Enigma *enigma, const char *str)
+{
+    enigma->plugboard = BARE_PLUGBOARD;
+    u8 wiring[26] = {0};
+    HglStringView sv = hgl_sv_from_cstr(str);
+    while (sv.length > 0) {
+        /* grab next pair */
+        HglStringView pair = hgl_sv_trim(hgl_sv_lchop_until(&sv, ' '));
+        SETUP_ASSERT(pair.length == 2, ENIGMA_INVALID_PLUGBOARD, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
+                      "String should be formatted as \"ab cd ef ...\"", HGL_SV_ARG(pair));
+
+        char c0 = to_upper(pair.start[0]);
+        char c1 = to_upper(pair.start[1]);
+        u8 n0 = ENCODE(c0);
+        u8 n1 = ENCODE(c1);
+
+        SETUP_ASSERT(c0 != c1, ENIGMA_INVALID_PLUGBOARD, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
+                      "A character can not be swapped with itself", HGL_SV_ARG(pair));
+        SETUP_ASSERT(in_alphabet(c0), ENIGMA_INVALID_PLUGBOARD, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
+                      "Character '%c' is not in the Enigma alphabet", HGL_SV_ARG(pair), c0);
+        SETUP_ASSERT(in_alphabet(c1), ENIGMA_INVALID_PLUGBOARD, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
+                      "Character '%c' is not in the Enigma alphabet", HGL_SV_ARG(pair), c1);
+        SETUP_ASSERT(wiring[n0] == 0, ENIGMA_INVALID_PLUGBOARD, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
+                      "The character '%c' has already been used.", HGL_SV_ARG(pair), c0);
+        SETUP_ASSERT(wiring[n1] == 0, ENIGMA_INVALID_PLUGBOARD, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
+                      "The character '%c' has already been used.", HGL_SV_ARG(pair), c1);
+
+        /* apply wiring */
+        wiring[n0] = c1;
+        wiring[n1] = c0;
+        enigma->plugboard.image[n0] = c1;
+        enigma->plugboard.image[n1] = c0;
+    }
+    return ENIGMA_OK;
+}
+
+/**
+ * Applies an indicator (or "Grundstellung") setting (e.g. "ABC" or "1 2 3") to 
+ * the currently mounted rotors.
+ */
+EnigmaError apply_indicator_setting(Enigma *enigma, const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    for (int i = 0; i < 3; i++) {
+        HglStringView l;
+        sv = hgl_sv_trim(sv);
+        l = hgl_sv_lchop_lexeme(&sv, lex_numeric);
+        if (l.length != 0) {
+            enigma->rotor[i].position = (u8) hgl_sv_to_u64(l) - 1;
+            continue;
+        }
+        l = hgl_sv_lchop_lexeme(&sv, lex_letter);
+        if (l.length != 0) {
+            enigma->rotor[i].position = ENCODE(to_upper(l.start[0]));
+            continue;
+        }
+        SETUP_ERROR(ENIGMA_INVALID_INDICATOR, "Invalid indicator setting \"%s\".", str);
+    }
+    SETUP_ASSERT(hgl_sv_trim(sv).length == 0, ENIGMA_INVALID_INDICATOR, "Invalid indicator setting \"%s\".", str);
+    return ENIGMA_OK;
+}
+
+/**
+ * Filters the `length` characters at `input` (see `filter_letters`) and enciphers the 
+ * remaining letters into `output` using `engine`. Returns the number of enciphered 
+ * letters. `output` must have room for `length` letters, and may equal `input`.
+ */
+size_t encipher_text(Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                     char *output, const char *input, size_t length)
+{
+    size_t n_letters = filter_letters(output, input, length);
+    encipher_letters(engine, table, enigma, output, output, n_letters);
+    return n_letters;
+}
+
+/**
+ * Enciphers the `length` upper-case letters at `letters` using `engine` and places the 
+ * result into `output`. `table` is only used by ENGINE_TABLE. `output` may equal `letters`.
+ */
+void encipher_letters(Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                      char *output, const char *letters, size_t length)
+{
+    switch (engine) {
+        case ENGINE_REFERENCE: {
+            for (size_t i = 0; i < length; i++) {
+                output[i] = encipher_char(enigma, letters[i]);
+            }
+        } break;
+        case ENGINE_TABLE: {
+            u16 pos = pack_positions(enigma);
+            for (size_t i = 0; i < length; i++) {
+                pos = table->next[pos];
+                output[i] = table->image[pos].image[ENCODE(letters[i])];
+            }
+            unpack_positions(enigma, pos);
+        } break;
+        case ENGINE_SIMD: {
+            encipher_letters_simd(enigma, output, letters, length);
+        } break;
+        case ENGINE_SEGMENT: {
+            encipher_letters_segment(enigma, output, letters, length);
+        } break;
+    }
+}
+
+/**
+ * Upper-cases the `length` characters at `input` and places those in the Enigma alphabet
+ * into `letters`, dropping all others. Returns the number of letters. `letters` may 
+ * equal `input`.
+ */
+size_t filter_letters(char *letters, const char *input, size_t length)
+{
+#ifdef ENIGMA_X86_SIMD
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")) {
+        return filter_letters_avx2(letters, input, length);
+    }
+#endif
+    return filter_letters_scalar(letters, input, length);
+}
+
+/**
+ * Enciphers each of the `n_messages` messages at `messages`, of `lengths` upper-case 
+ * letters, with its own machine at `enigmas`, and places the results into `outputs`. 
+ * `outputs[i]` may equal `messages[i]`. The machines are left at the positions following
+ * their messages, as by `encipher_letters`.
+ *
+ * For many short messages, vectorizing over the letters of one message barely pays off.
+ * Instead, MESSAGE_LANES machines run side by side, one per SIMD lane, each taking one
+ * step per step of the kernel; with AVX2, their substitutions are looked up with gathers.
+ * Whenever a lane runs out of letters, it is loaded with the next message. Passing the 
+ * messages ordered by length keeps the lanes finishing together.
+ */
+void encipher_messages(Enigma *enigmas, char *const *outputs, const char *const *messages, 
+                       const size_t *lengths, size_t n_messages)
+{
+    LaneKernel kernel = select_lane_kernel();
+    LaneEnigmas lanes = {0};
+
+    size_t message[MESSAGE_LANES];    /* the message in each lane, or n_messages if none */
+    size_t n_done[MESSAGE_LANES] = {0}; /* the number of its letters enciphered so far */
+    for (size_t l = 0; l < MESSAGE_LANES; l++) {
+        message[l] = n_messages;
+    }
+
+    size_t next = 0;
+    u8 block[LANE_BLOCK_SIZE][MESSAGE_LANES] = {0};
+    for (;;) {
+        /* retire the finished messages and refill their lanes */
+        size_t n_steps = LANE_BLOCK_SIZE;
+        b8 any = false;
+        for (size_t l = 0; l < MESSAGE_LANES; l++) {
+            if (message[l] < n_messages && n_done[l] == lengths[message[l]]) {
+                store_lane(&lanes, l, &enigmas[message[l]]);
+                message[l] = n_messages;
+            }
+            while (message[l] == n_messages && next < n_messages) {
+                if (lengths[next] > 0) {
+                    load_lane(&lanes, l, &enigmas[next]);
+                    message[l] = next;
+                    n_done[l] = 0;
+                }
+                next++;
+            }
+            if (message[l] < n_messages) {
+                size_t n_left = lengths[message[l]] - n_done[l];
+                n_steps = (n_left < n_steps) ? n_left : n_steps;
+                any = true;
+            }
+        }
+        if (!any) {
+            break;
+        }
+
+        /* transpose the next letters of every message into lanes, and back; idle lanes 
+           encipher whatever is left in the block */
+        for (size_t l = 0; l < MESSAGE_LANES; l++) {
+            if (message[l] < n_messages) {
+                const char *letters = &messages[message[l]][n_done[l]];
+                for (size_t i = 0; i < n_steps; i++) {
+                    block[i][l] = ENCODE(letters[i]);
+                }
+            }
+        }
+        kernel(&lanes, block, n_steps);
+        for (size_t l = 0; l < MESSAGE_LANES; l++) {
+            if (message[l] < n_messages) {
+                char *output = &outputs[message[l]][n_done[l]];
+                for (size_t i = 0; i < n_steps; i++) {
+                    output[i] = DECODE(block[i][l]);
+                }
+                n_done[l] += n_steps;
+            }
+        }
+    }
+}
+
+/**
+ * Finds the offsets into the `length` letters at `ciphertext` at which each of the
+ * `n_cribs` (at most MAX_CRIBS) cribs at `cribs`, of lengths `crib_lengths`, may be 
+ * placed. Since the Enigma never enciphers a letter to itself, a crib only fits where
+ * none of its letters meets the same letter in the ciphertext. Sets bit c of 
+ * `feasible[i]` (and clears the others) if crib c fits at offset i, for all `length` 
+ * offsets. Returns the number of set bits.
+ *
+ * All cribs are placed in a single pass over the ciphertext, 32 offsets at a time. With
+ * AVX2, the 32 offsets are tested at once; each crib letter is compared against 32 
+ * ciphertext letters with a single instruction.
+ */
+size_t place_cribs(const char *ciphertext, size_t length, const char *const *cribs, 
+                   const size_t *crib_lengths, size_t n_cribs, uint64_t *feasible)
+{
+    assert(n_cribs <= MAX_CRIBS);
+#ifdef ENIGMA_X86_SIMD
+    b8 avx2 = __builtin_cpu_supports("avx2");
+#endif
+    size_t n_feasible = 0;
+    for (size_t i = 0; i < length; i += 32) {
+        memset(&feasible[i], 0, ((length - i < 32) ? length - i : 32) * sizeof(u64));
+        for (size_t c = 0; c < n_cribs; c++) {
+            /* the number of offsets in this block at which the crib does not run off the end */
+            size_t n_offsets = (crib_lengths[c] <= length - i) ? length - i - crib_lengths[c] + 1 : 0;
+            n_offsets = (n_offsets < 32) ? n_offsets : 32;
+
+            u32 fits;
+#ifdef ENIGMA_X86_SIMD
+            if (avx2 && n_offsets == 32) {
+                fits = place_crib_avx2(&ciphertext[i], cribs[c], crib_lengths[c]);
+            } else {
+                fits = place_crib_scalar(&ciphertext[i], cribs[c], crib_lengths[c], n_offsets);
+            }
+#else
+            fits = place_crib_scalar(&ciphertext[i], cribs[c], crib_lengths[c], n_offsets);
+#endif
+
+            n_feasible += __builtin_popcount(fits);
+            while (fits != 0) {
+                feasible[i + __builtin_ctz(fits)] |= (u64) 1 << c;
+                fits &= fits - 1;
+            }
+        }
+    }
+    return n_feasible;
+}
+
+/**
+ * Deciphers the `length` letters at `ciphertext` with each of the `n_keys` machines at
+ * `keys`, and places the sum of n * (n - 1) over the letter counts n of each decryption 
+ * (i.e. its index of coincidence times length * (length - 1)) into `scores`. The keys 
+ * must share the reflector and rotor order, but may differ in their ring settings, rotor
+ * positions, and plugboards. The keys themselves are left as they are.
+ *
+ * The keys are run BITSLICE_LANES at a time, one per bit of a machine word, so a single
+ * bitwise operation takes a step in all of them (see BitslicedEnigma). The letters of 
+ * each decryption are counted in bitsliced counters as well. Keys which share their left
+ * (and middle) rotor offsets are the cheapest to run together.
+ *
+ * Returns the number of keys scored; `n_keys`, or 0 if the scratch space (~100 KiB) could
+ * not be allocated.
+ *
+ * Note: In the builds measured, deciphering with a compiled table (see `compile_enigma`)
+ *       scored all the positions of a rotor order faster than this. See the README.
+ */
+size_t score_keys(const Enigma *keys, size_t n_keys, const char *ciphertext, size_t length, uint64_t *scores)
+{
+    size_t size = (sizeof(BitslicedScorer) + sizeof(Lanes) - 1) / sizeof(Lanes) * sizeof(Lanes);
+    BitslicedScorer *scorer = aligned_alloc(sizeof(Lanes), size);
+    if (scorer == NULL) {
+        return 0;
+    }
+    BitslicedEnigma *bs = &scorer->machine;
+    Lanes (*counts)[64] = scorer->counts;
+    for (size_t k = 0; k < n_keys; k += BITSLICE_LANES) {
+        size_t n_lanes = (n_keys - k < BITSLICE_LANES) ? n_keys - k : BITSLICE_LANES;
+        prepare_bitsliced_enigma(bs, &keys[k], n_lanes);
+        memset(counts, 0, sizeof(scorer->counts));
+        for (size_t i = 0; i < length; i++) {
+            step_bitsliced_rotors(bs);
+            Lanes x[26];
+            decipher_bitsliced_letter(bs, ENCODE(ciphertext[i]), x);
+            for (u8 n = 0; n < 26; n++) {
+                Lanes carry = x[n];
+                for (int b = 0; !lanes_empty(&carry); b++) {
+                    Lanes t = counts[n][b] & carry;
+                    counts[n][b] ^= carry;
+                    carry = t;
+                }
+            }
+        }
+
+        /* no count has more bits than the length */
+        int n_planes = (length > 0) ? 64 - __builtin_clzll(length) : 0;
+        for (size_t l = 0; l < n_lanes; l++) {
+            scores[k + l] = 0;
+            for (u8 n = 0; n < 26; n++) {
+                u64 count = 0;
+                for (int b = 0; b < n_planes; b++) {
+                    count |= ((counts[n][b][l / 64] >> (l % 64)) & 1) << b;
+                }
+                scores[k + l] += count * (count - 1); /* 0 for count = 0, in unsigned arithmetic */
+            }
+        }
+    }
+    free(scorer);
+    return n_keys;
+}
+
+/**
+ * Returns a short description of `err`.
+ */
+const char *enigma_strerror(EnigmaError err)
+{
+    switch (err) {
+        case ENIGMA_OK:                   return "Success";
+        case ENIGMA_INVALID_REFLECTOR:    return "Invalid reflector";
+        case ENIGMA_INVALID_ROTOR:        return "Invalid rotor order";
+        case ENIGMA_INVALID_RING_SETTING: return "Invalid ring setting";
+        case ENIGMA_INVALID_PLUGBOARD:    return "Invalid plugboard setting";
+        case ENIGMA_INVALID_INDICATOR:    return "Invalid indicator setting";
+    }
+    return "Unknown error";
+}
+
+/**
+ * Returns a message describing the last error returned by a machine setup function 
+ * called by this thread.
+ */
+const char *enigma_error_message(void)
+{
+    return setup_error;
+}
+
+/*--- Private functions -----------------------------------------------------------------*/
+
+/**
+ * Advances the rotors of `enigma` as if a key was pressed (including the double-stepping 
+ * of the middle rotor).
+ */
+static void step_rotors(Enigma *enigma)
+{
+    if (is_at_turnover(&enigma->rotor[1])) { 
+        step_rotor(&enigma->rotor[0]);
+        step_rotor(&enigma->rotor[1]);
+    } else if (is_at_turnover(&enigma->rotor[2])) {
+        step_rotor(&enigma->rotor[1]);
+    }
+    step_rotor(&enigma->rotor[2]);
+}
+
+/**
+ * Returns the image of `n` under the complete substitution performed by the machine at
+ * its current rotor positions, where `n` is the numerical encoding of a letter in the
+ * Enigma alphabet. The rotors are not advanced.
+ */
+static u8 apply_machine_subst(const Enigma *enigma, u8 n)
+{
+    n = apply_subst(&enigma->plugboard, n);
+    n = apply_rotor_subst(&enigma->rotor[2], FORWARD, n);
+    n = apply_rotor_subst(&enigma->rotor[1], FORWARD, n);
+    n = apply_rotor_subst(&enigma->rotor[0], FORWARD, n);
+    n = apply_subst(&enigma->reflector, n);
+    n = apply_rotor_subst(&enigma->rotor[0], REVERSE, n);
+    n = apply_rotor_subst(&enigma->rotor[1], REVERSE, n);
+    n = apply_rotor_subst(&enigma->rotor[2], REVERSE, n);
+    n = apply_subst(&enigma->plugboard, n);
+    return n;
+}
+
+/**
+ * Packs the rotor positions of `enigma` into a single number in [0, N_POSITIONS).
+ */
+static u16 pack_positions(const Enigma *enigma)
+{
+    return (enigma->rotor[0].position * 26 + enigma->rotor[1].position) * 26 + 
+           enigma->rotor[2].position;
+}
+
+/**
+ * Sets the rotor positions of `enigma` from a number packed by `pack_positions`.
+ */
+static void unpack_positions(Enigma *enigma, u16 pos)
+{
+    enigma->rotor[2].position = pos % 26;
+    enigma->rotor[1].position = (pos / 26) % 26;
+    enigma->rotor[0].position = pos / (26 * 26);
+}
+
+/**
+ * Returns true if rotor `r` is positioned at a turnover notch.
+ */
+static b8 is_at_turnover(const Rotor *r)
+{
+    return is_turnover(r, r->position);
+}
+
+/**
+ * Returns true if `position` is a turnover notch position of rotor `r`.
+ */
+static b8 is_turnover(const Rotor *r, u8 position)
+{
+    return (position == r->turnover1) ||
+           (position == r->turnover2);
+}
+
+/**
+ * Steps rotor `r` once.
+ */
+static void step_rotor(Rotor *r)
+{
+    r->position = (r->position + 1) % 26;
+}
+
+/**
+ * Returns the image of 'n' under the substitution given by the rotor `r` (including rotor 
+ * position and ring setting) and the current flow direction `dir` through the rotor, where
+ * `n` is the numerical encoding of a letter in the Enigma alphabet.
+ */
+static u8 apply_rotor_subst(const Rotor *r, Direction dir, u8 n)
+{
+    n = (n - r->ring_setting + r->position + 26) % 26;
+    switch (dir) {
+        case FORWARD: n = apply_subst(&r->forward, n); break;
+        case REVERSE: n = apply_subst(&r->reverse, n); break;
+    }
+    n = (n + r->ring_setting - r->position + 26) % 26;
+    return n;
+}
+
+/**
+ * Applies substitution `s` to `n`.
+ */
+static u8 apply_subst(const Substitution *s, u8 n)
+{
+    return ENCODE(s->image[n]);
+}
+
+/**
+ * Scalar implementation of `filter_letters`.
+ */
+static size_t filter_letters_scalar(char *letters, const char *input, size_t length)
+{
+    char *wr = letters;
+    for (size_t i = 0; i < length; i++) {
+        char c = to_upper(input[i]);
+        if (in_alphabet(c)) {
+            *wr++ = c;
+        }
+    }
+    return wr - letters;
+}
+
+#ifdef ENIGMA_X86_SIMD
+/**
+ * AVX2 implementation of `filter_letters`. Classifies and upper-cases 32 characters at a
+ * time, and compacts the letters 8 at a time using `pext`. Blocks without any letters
+ * (or with only letters) are skipped (or copied) as a whole.
+ *
+ * Clearing bit 5 of a character maps 'a'-'z' onto 'A'-'Z' while leaving all other 
+ * characters outside of 'A'-'Z', so a character is a letter iff ((c & 0xDF) - 'A') < 26.
+ */
+__attribute__((target("avx2,bmi2")))
+static size_t filter_letters_avx2(char *letters, const char *input, size_t length)
+{
+    char *wr = letters;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *) &input[i]);
+        __m256i x = _mm256_sub_epi8(_mm256_and_si256(c, _mm256_set1_epi8((char) 0xDF)), _mm256_set1_epi8('A'));
+        __m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(25)), x);
+        u32 mask = (u32) _mm256_movemask_epi8(is_letter);
+        if (mask == 0) {
+            continue;
+        }
+
+        u8 upper[32];
+        _mm256_storeu_si256((__m256i *) upper, _mm256_add_epi8(x, _mm256_set1_epi8('A')));
+        if (mask == 0xFFFFFFFF) {
+            memcpy(wr, upper, 32);
+            wr += 32;
+            continue;
+        }
+
+        /* 
+         * Note: Each 8-byte store ends at most at the end of the current block, so this
+         *       is safe to do in place. 
+         */
+        for (int g = 0; g < 4; g++) {
+            u8 m = (u8) (mask >> (8 * g));
+            u64 v;
+            memcpy(&v, &upper[8 * g], 8);
+            u64 packed = _pext_u64(v, _pdep_u64(m, 0x0101010101010101) * 0xFF);
+            memcpy(wr, &packed, 8);
+            wr += __builtin_popcount(m);
+        }
+    }
+    wr += filter_letters_scalar(wr, &input[i], length - i);
+    return wr - letters;
+}
+#endif
+
+/**
+ * Sets up `bs` to run the `n_lanes` (at most BITSLICE_LANES) machines at `enigmas`, which
+ * must share the reflector and rotor order, in parallel.
+ */
+static void prepare_bitsliced_enigma(BitslicedEnigma *bs, const Enigma *enigmas, size_t n_lanes)
+{
+    assert(n_lanes > 0 && n_lanes <= BITSLICE_LANES);
+    memset(bs, 0, sizeof(*bs));
+    const Enigma *first = &enigmas[0];
+    for (u8 n = 0; n < 26; n++) {
+        bs->reflector[n] = apply_subst(&first->reflector, n);
+        for (int r = 0; r < 3; r++) {
+            bs->forward[r][n] = apply_subst(&first->rotor[r].forward, n);
+            bs->reverse[r][n] = apply_subst(&first->rotor[r].reverse, n);
+        }
+    }
+    for (u8 t = 0; t < 26; t++) {
+        for (u8 n = 0; n < 26; n++) {
+            bs->right_forward[t][n] = (bs->forward[2][(n + t) % 26] + 26 - t) % 26;
+            bs->right_reverse[t][n] = (bs->reverse[2][(n + t) % 26] + 26 - t) % 26;
+        }
+    }
+
+    for (size_t l = 0; l < n_lanes; l++) {
+        const Enigma *e = &enigmas[l];
+        Lanes lane = {0};
+        lane[l / 64] = (u64) 1 << (l % 64);
+        assert(memcmp(&e->reflector, &first->reflector, sizeof(Substitution)) == 0);
+        bs->lanes |= lane;
+        for (int r = 0; r < 3; r++) {
+            const Rotor *rotor = &e->rotor[r];
+            assert(memcmp(&rotor->forward, &first->rotor[r].forward, sizeof(Substitution)) == 0);
+            u8 offset = (rotor->position + 26 - rotor->ring_setting) % 26;
+            u8 notches[2] = {rotor->turnover1, rotor->turnover2};
+            for (int b = 0; b < 5; b++) {
+                bs->offset[r][b] |= ((offset >> b) & 1) ? lane : (Lanes) {0};
+                for (int i = 0; i < 2; i++) {
+                    /* rotor positions at notches are kept as offsets as well; no offset is 31 */
+                    u8 notch = (notches[i] < 26) ? (notches[i] + 26 - rotor->ring_setting) % 26 : 31;
+                    bs->notch[r][i][b] |= ((notch >> b) & 1) ? lane : (Lanes) {0};
+                }
+            }
+        }
+        for (u8 n = 0; n < 26; n++) {
+            u8 m = apply_subst(&e->plugboard, n);
+            if (m <= n) {
+                continue;
+            }
+            size_t i = 0;
+            while (i < bs->n_plugs && (bs->plugs[i].a != n || bs->plugs[i].b != m)) {
+                i++;
+            }
+            if (i == bs->n_plugs) {
+                bs->plugs[bs->n_plugs++] = (BitslicedPlug) {.a = n, .b = m};
+            }
+            bs->plugs[i].lanes |= lane;
+        }
+    }
+
+    memcpy(bs->right_start, bs->offset[2], sizeof(bs->right_start));
+    for (u8 c = 0; c < 26; c++) {
+        bs->entry[c][c] = bs->lanes;
+        plug_bitsliced_letters(bs, bs->entry[c]);
+        turn_bitsliced_letters(bs->entry[c], bs->right_start, false, &bs->lanes);
+    }
+}
+
+/**
+ * Bitsliced `step_rotors`: advances the rotors of every lane of `bs`.
+ */
+static void step_bitsliced_rotors(BitslicedEnigma *bs)
+{
+    Lanes middle_at_notch[2];
+    Lanes right_at_notch[2];
+    for (int i = 0; i < 2; i++) {
+        bitsliced_equals(&middle_at_notch[i], bs->offset[1], bs->notch[1][i]);
+        bitsliced_equals(&right_at_notch[i], bs->offset[2], bs->notch[2][i]);
+    }
+    Lanes middle_steps = middle_at_notch[0] | middle_at_notch[1];
+    Lanes right_steps = middle_steps | right_at_notch[0] | right_at_notch[1];
+    bitsliced_increment(bs->offset[0], &middle_steps);
+    bitsliced_increment(bs->offset[1], &right_steps);
+    bitsliced_increment(bs->offset[2], &bs->lanes);
+    bs->t = (bs->t + 1) % 26;
+}
+
+/**
+ * Bitsliced `apply_machine_subst`: places the one-hot decipherment of the ciphertext 
+ * letter `c` in every lane of `bs`, at its current rotor positions, into `x`; up to a 
+ * relabeling of the letters which is fixed per lane (the turn by `right_start` and the
+ * plugboard on the way out), and hence does not change how often each letter occurs.
+ *
+ * Between the right rotor and the left rotor, the turns of adjacent rotors combine into
+ * turns by the differences of their offsets. Turns which are shared by all lanes, as 
+ * those of the left rotor usually are, cost no more than a substitution.
+ */
+static void decipher_bitsliced_letter(const BitslicedEnigma *bs, u8 c, Lanes x[26])
+{
+    Lanes middle_from_right[5]; /* offset[1] - right_start */
+    Lanes left_from_middle[5];  /* offset[0] - offset[1] */
+    bitsliced_subtract(middle_from_right, bs->offset[1], bs->right_start);
+    bitsliced_subtract(left_from_middle, bs->offset[0], bs->offset[1]);
+
+    memcpy(x, bs->entry[c], 26 * sizeof(Lanes));
+    substitute_bitsliced_letters(x, bs->right_forward[bs->t]);
+    turn_bitsliced_letters(x, middle_from_right, false, &bs->lanes);
+    substitute_bitsliced_letters(x, bs->forward[1]);
+    turn_bitsliced_letters(x, left_from_middle, false, &bs->lanes);
+    substitute_bitsliced_letters(x, bs->forward[0]);
+    turn_bitsliced_letters(x, bs->offset[0], true, &bs->lanes);
+    substitute_bitsliced_letters(x, bs->reflector);
+    turn_bitsliced_letters(x, bs->offset[0], false, &bs->lanes);
+    substitute_bitsliced_letters(x, bs->reverse[0]);
+    turn_bitsliced_letters(x, left_from_middle, true, &bs->lanes);
+    substitute_bitsliced_letters(x, bs->reverse[1]);
+    turn_bitsliced_letters(x, middle_from_right, true, &bs->lanes);
+    substitute_bitsliced_letters(x, bs->right_reverse[bs->t]);
+}
+
+/**
+ * Places the lanes in which the 5-bit numbers with bit planes `x` and `y` are equal into
+ * `equal`.
+ */
+static void bitsliced_equals(Lanes *equal, const Lanes x[5], const Lanes y[5])
+{
+    *equal = ~((x[0] ^ y[0]) | (x[1] ^ y[1]) | (x[2] ^ y[2]) | (x[3] ^ y[3]) | (x[4] ^ y[4]));
+}
+
+/**
+ * Adds 1, modulo 26, to the 5-bit numbers with bit planes `x`, in the lanes `mask`.
+ */
+static void bitsliced_increment(Lanes x[5], const Lanes *mask)
+{
+    Lanes carry = *mask;
+    for (int b = 0; b < 5 && !lanes_empty(&carry); b++) {
+        Lanes t = x[b] & carry;
+        x[b] ^= carry;
+        carry = t;
+    }
+    const Lanes none = {0};
+    const Lanes twenty_six[5] = {none, ~none, none, ~none, ~none}; /* 0b11010 */
+    Lanes wrapped;
+    bitsliced_equals(&wrapped, x, twenty_six);
+    for (int b = 0; b < 5; b++) {
+        x[b] &= ~wrapped;
+    }
+}
+
+/**
+ * Places the differences x - y, modulo 26, of the 5-bit numbers (less than 26) with bit 
+ * planes `x` and `y` into `diff`.
+ */
+static void bitsliced_subtract(Lanes diff[5], const Lanes x[5], const Lanes y[5])
+{
+    Lanes borrow = {0};
+    for (int b = 0; b < 5; b++) {
+        diff[b] = x[b] ^ y[b] ^ borrow;
+        borrow = (~x[b] & (y[b] | borrow)) | (x[b] & y[b] & borrow);
+    }
+
+    /* negative differences wrapped around 32 rather than 26; add 26 (0b11010), modulo 32 */
+    Lanes carry = {0};
+    for (int b = 0; b < 5; b++) {
+        Lanes add = ((26 >> b) & 1) ? borrow : (Lanes) {0};
+        Lanes sum = diff[b] ^ add ^ carry;
+        carry = (diff[b] & add) | (carry & (diff[b] ^ add));
+        diff[b] = sum;
+    }
+}
+
+/**
+ * Turns the one-hot letters `x` by the rotor offsets with bit planes `offset`; i.e. maps 
+ * n to n + offset (or to n - offset if `backwards` is set), modulo 26, in every lane of
+ * `lanes`. If all lanes share the offset, this is a single substitution. Otherwise, it is
+ * done in 5 stages, each turning by a power of two in the lanes with that bit set.
+ */
+static void turn_bitsliced_letters(Lanes x[26], const Lanes offset[5], b8 backwards, const Lanes *lanes)
+{
+    u8 shared = 0;
+    b8 is_shared = true;
+    for (int b = 0; b < 5; b++) {
+        shared |= lanes_equal(&offset[b], lanes) << b;
+        is_shared &= lanes_equal(&offset[b], lanes) || lanes_empty(&offset[b]);
+    }
+    if (is_shared) {
+        u8 shift = backwards ? (26 - shared) % 26 : shared;
+        if (shift != 0) {
+            Lanes y[26];
+            memcpy(y, x, sizeof(y));
+            memcpy(&x[shift], y, (26 - shift) * sizeof(Lanes));
+            memcpy(x, &y[26 - shift], shift * sizeof(Lanes));
+        }
+        return;
+    }
+
+    for (int b = 0; b < 5; b++) {
+        Lanes mask = offset[b];
+        if (lanes_empty(&mask)) {
+            continue;
+        }
+        u8 shift = backwards ? 26 - (1 << b) : (1 << b);
+        Lanes y[26];
+        memcpy(y, x, sizeof(y));
+        for (u8 n = 0; n < shift; n++) {
+            x[n] = (y[n] & ~mask) | (y[n + 26 - shift] & mask);
+        }
+        for (u8 n = shift; n < 26; n++) {
+            x[n] = (y[n] & ~mask) | (y[n - shift] & mask);
+        }
+    }
+}
+
+/**
+ * Applies the substitution `s` (shared by all lanes) to the one-hot letters `x`. 
+ */
+static void substitute_bitsliced_letters(Lanes x[26], const u8 s[26])
+{
+    Lanes y[26];
+    for (u8 n = 0; n < 26; n++) {
+        y[s[n]] = x[n];
+    }
+    memcpy(x, y, sizeof(y));
+}
+
+/**
+ * Applies the plugboards of `bs` to the one-hot letters `x`.
+ */
+static void plug_bitsliced_letters(const BitslicedEnigma *bs, Lanes x[26])
+{
+    Lanes y[26];
+    memcpy(y, x, sizeof(y));
+    for (size_t i = 0; i < bs->n_plugs; i++) {
+        const BitslicedPlug *p = &bs->plugs[i];
+        x[p->a] = (x[p->a] & ~p->lanes) | (y[p->b] & p->lanes);
+        x[p->b] = (x[p->b] & ~p->lanes) | (y[p->a] & p->lanes);
+    }
+}
+
+/**
+ * Returns true if `x` and `y` are equal in every lane.
+ */
+static inline b8 lanes_equal(const Lanes *x, const Lanes *y)
+{
+    Lanes difference = *x ^ *y;
+    return lanes_empty(&difference);
+}
+
+/**
+ * Returns true if no lane of `x` is set.
+ */
+static inline b8 lanes_empty(const Lanes *x)
+{
+    u64 any = 0;
+    for (size_t i = 0; i < BITSLICE_LANES / 64; i++) {
+        any |= (*x)[i];
+    }
+    return any == 0;
+}
+
+/**
+ * Places the `crib_length` letters at `crib` at the first `n_offsets` (at most 32) 
+ * offsets into `ciphertext`. Returns a mask with bit k set if the crib fits at offset k
+ * (see `place_cribs`).
+ */
+static u32 place_crib_scalar(const char *ciphertext, const char *crib, size_t crib_length, size_t n_offsets)
+{
+    u32 fits = 0;
+    for (size_t k = 0; k < n_offsets; k++) {
+        size_t j = 0;
+        while (j < crib_length && ciphertext[k + j] != crib[j]) {
+            j++;
+        }
+        fits |= (u32) (j == crib_length) << k;
+    }
+    return fits;
+}
+
+#ifdef ENIGMA_X86_SIMD
+/**
+ * AVX2 implementation of `place_crib_scalar`, for exactly 32 offsets. Crib letter j is
+ * compared against the 32 ciphertext letters under it at once, and the comparison stops
+ * as soon as the crib clashes at every offset.
+ */
+__attribute__((target("avx2")))
+static u32 place_crib_avx2(const char *ciphertext, const char *crib, size_t crib_length)
+{
+    __m256i clashes = _mm256_setzero_si256();
+    for (size_t j = 0; j < crib_length; j++) {
+        __m256i c = _mm256_loadu_si256((const __m256i *) &ciphertext[j]);
+        clashes = _mm256_or_si256(clashes, _mm256_cmpeq_epi8(c, _mm256_set1_epi8(crib[j])));
+        if ((j & 7) == 7 && _mm256_movemask_epi8(clashes) == -1) {
+            return 0;
+        }
+    }
+    return ~(u32) _mm256_movemask_epi8(clashes);
+}
+#endif
+
+/**
+ * Same as `encipher_letters` with ENGINE_SEGMENT. Only the right rotor moves between 
+ * steps of the middle rotor, so for up to 26 keypresses at a time (a segment), the middle
+ * and left rotors and the reflector make up a constant substitution. This inner 
+ * substitution is composed once per segment (from that of the left rotor and reflector, 
+ * which only changes when the left rotor moves), after which each letter only passes 
+ * the plugboard, the right rotor, the inner substitution, and the right rotor again.
+ *
+ * A rotor at offset o = (position - ring setting) maps n to (S[n + o] - o), modulo 26. 
+ * The sums and differences are kept in [0, 78) and reduced by table lookup.
+ */
+static void encipher_letters_segment(Enigma *enigma, char *output, const char *letters, size_t length)
+{
+    u8 mod26[3 * 26];
+    for (u8 k = 0; k < 3 * 26; k++) {
+        mod26[k] = k % 26;
+    }
+    const Rotor *right = &enigma->rotor[2];
+    const Rotor *middle = &enigma->rotor[1];
+    u8 outer[26]; /* the left rotor and the reflector */
+    u8 inner[26]; /* the middle rotor and `outer` */
+    u8 left_position = 26;
+
+    size_t i = 0;
+    while (i < length) {
+        /* the first keypress of a segment may move any rotor */
+        step_rotors(enigma);
+        if (enigma->rotor[0].position != left_position) {
+            left_position = enigma->rotor[0].position;
+            for (u8 n = 0; n < 26; n++) {
+                u8 m = apply_rotor_subst(&enigma->rotor[0], FORWARD, n);
+                m = apply_subst(&enigma->reflector, m);
+                outer[n] = apply_rotor_subst(&enigma->rotor[0], REVERSE, m);
+            }
+        }
+        u8 o = mod26[middle->position + 26 - middle->ring_setting];
+        for (u8 n = 0; n < 26; n++) {
+            u8 m = ENCODE(middle->forward.image[mod26[n + o]]);
+            m = outer[mod26[m + 26 - o]];
+            m = ENCODE(middle->reverse.image[mod26[m + o]]);
+            inner[n] = mod26[m + 26 - o];
+        }
+
+        /* the rest only move the right rotor, until it reaches a notch or the middle rotor is at one */
+        while (true) {
+            o = mod26[right->position + 26 - right->ring_setting];
+            u8 n = ENCODE(enigma->plugboard.image[ENCODE(letters[i])]);
+            n = ENCODE(right->forward.image[mod26[n + o]]);
+            n = inner[mod26[n + 26 - o]];
+            n = ENCODE(right->reverse.image[mod26[n + o]]);
+            output[i++] = enigma->plugboard.image[mod26[n + 26 - o]];
+            if (i == length || is_at_turnover(right) || is_at_turnover(middle)) {
+                break;
+            }
+            step_rotor(&enigma->rotor[2]);
+        }
+    }
+}
+
+/**
+ * Same as `encipher_letters` with ENGINE_SIMD. The rotor positions for a block of 
+ * SIMD_BLOCK_SIZE letters are computed up front, after which the whole block is pushed 
+ * through the plugboard, rotors, and reflector using byte shuffles. Falls back on the
+ * reference implementation if the CPU supports neither AVX2 nor SSSE3.
+ */
+static void encipher_letters_simd(Enigma *enigma, char *output, const char *letters, size_t length)
+{
+    SimdKernel kernel = select_simd_kernel();
+    if (kernel == NULL) {
+        encipher_letters(ENGINE_REFERENCE, NULL, enigma, output, letters, length);
+        return;
+    }
+
+    SimdEnigma simd;
+    prepare_simd_enigma(&simd, enigma);
+
+    for (size_t i = 0; i < length; i += SIMD_BLOCK_SIZE) {
+        size_t n = length - i;
+        n = (n < SIMD_BLOCK_SIZE) ? n : SIMD_BLOCK_SIZE;
+
+        /* Compute the rotor positions and encode the input. Unused lanes are left at 0. */
+        u8 positions[3][SIMD_BLOCK_SIZE] = {0};
+        u8 block[SIMD_BLOCK_SIZE] = {0};
+        for (size_t k = 0; k < n; k++) {
+            step_rotors(enigma);
+            positions[0][k] = enigma->rotor[0].position;
+            positions[1][k] = enigma->rotor[1].position;
+            positions[2][k] = enigma->rotor[2].position;
+            block[k] = ENCODE(letters[i + k]);
+        }
+
+        kernel(&simd, block, block, (const u8 (*)[SIMD_BLOCK_SIZE]) positions);
+        for (size_t k = 0; k < n; k++) {
+            output[i + k] = DECODE(block[k]);
+        }
+    }
+}
+
+/**
+ * Lays out the substitutions of `enigma` for the SIMD kernels. 
+ *
+ * `apply_rotor_subst` computes f(n + position - ring) - position + ring (mod 26), where f
+ * is the rotor wiring. With g(y) = f(y - ring) + ring this becomes g(n + position) - 
+ * position, so by storing g instead of f, the kernels need only the rotor positions.
+ */
+static void prepare_simd_enigma(SimdEnigma *simd, const Enigma *enigma)
+{
+    prepare_simd_substitution(&simd->plugboard, &enigma->plugboard, 0);
+    prepare_simd_substitution(&simd->reflector, &enigma->reflector, 0);
+    for (int r = 0; r < 3; r++) {
+        u8 ring_setting = enigma->rotor[r].ring_setting;
+        prepare_simd_substitution(&simd->forward[r], &enigma->rotor[r].forward, ring_setting);
+        prepare_simd_substitution(&simd->reverse[r], &enigma->rotor[r].reverse, ring_setting);
+    }
+}
+
+/**
+ * Lays out the substitution `s`, conjugated by a shift of `ring_setting`, for the SIMD 
+ * kernels. See `prepare_simd_enigma`.
+ */
+static void prepare_simd_substitution(SimdSubstitution *simd, const Substitution *s, u8 ring_setting)
+{
+    *simd = (SimdSubstitution) {0};
+    u8 m = (26 - ring_setting) % 26; /* n - ring_setting, stepped along with n */
+    for (u8 n = 0; n < 26; n++) {
+        u8 image = apply_subst(s, m) + ring_setting;
+        simd->image[n] = (image >= 26) ? image - 26 : image;
+        m = (m == 25) ? 0 : m + 1;
+    }
+}
+
+/**
+ * Returns the best SIMD kernel supported by the CPU, or NULL if there is none.
+ */
+static SimdKernel select_simd_kernel(void)
+{
+#ifdef ENIGMA_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return encipher_block_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return encipher_block_ssse3;
+    }
+#endif
+    return NULL;
+}
+
+#ifdef ENIGMA_X86_SIMD
+
+/* 
+ * Applies the SIMD substitution `s` to every lane of `x`. Lanes with x < 16 are looked up
+ * in the lower half of `s->image`, and lanes with x >= 16 in the upper half. 
+ */
+#define AVX2_SUBST(s, x)                                                                   \
+    _mm256_blendv_epi8(                                                                   \
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) &(s)->image[0])), (x)), \
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) &(s)->image[16])), \
+                            _mm256_sub_epi8((x), _mm256_set1_epi8(16))),                  \
+        _mm256_cmpgt_epi8((x), _mm256_set1_epi8(15)))
+
+/* (x + y) mod 26 and (x - y) mod 26 for x, y in [0, 25] */
+#define AVX2_ADD_MOD26(x, y) \
+    _mm256_min_epu8(_mm256_add_epi8((x), (y)), _mm256_sub_epi8(_mm256_add_epi8((x), (y)), _mm256_set1_epi8(26)))
+#define AVX2_SUB_MOD26(x, y) \
+    _mm256_min_epu8(_mm256_sub_epi8((x), (y)), _mm256_add_epi8(_mm256_sub_epi8((x), (y)), _mm256_set1_epi8(26)))
+
+/**
+ * AVX2 SIMD kernel. Enciphers all 32 letters of the block at once.
+ */
+__attribute__((target("avx2")))
+static void encipher_block_avx2(const SimdEnigma *simd, u8 *output, const u8 *input,
+                                const u8 positions[3][SIMD_BLOCK_SIZE])
+{
+    static_assert(SIMD_BLOCK_SIZE == 32, "");
+    __m256i shift[3];
+    for (int r = 0; r < 3; r++) {
+        shift[r] = _mm256_loadu_si256((const __m256i *) positions[r]);
+    }
+
+    __m256i x = _mm256_loadu_si256((const __m256i *) input);
+    x = AVX2_SUBST(&simd->plugboard, x);
+    for (int r = 2; r >= 0; r--) {
+        x = AVX2_ADD_MOD26(x, shift[r]);
+        x = AVX2_SUBST(&simd->forward[r], x);
+        x = AVX2_SUB_MOD26(x, shift[r]);
+    }
+    x = AVX2_SUBST(&simd->reflector, x);
+    for (int r = 0; r < 3; r++) {
+        x = AVX2_ADD_MOD26(x, shift[r]);
+        x = AVX2_SUBST(&simd->reverse[r], x);
+        x = AVX2_SUB_MOD26(x, shift[r]);
+    }
+    x = AVX2_SUBST(&simd->plugboard, x);
+    _mm256_storeu_si256((__m256i *) output, x);
+}
+
+/* 
+ * SSSE3 equivalents of the AVX2 macros above. SSSE3 lacks a byte blend, so the halves 
+ * are combined with a mask instead.
+ */
+#define SSSE3_SELECT(mask, a, b) _mm_or_si128(_mm_and_si128((mask), (a)), _mm_andnot_si128((mask), (b)))
+#define SSSE3_SUBST(s, x)                                                                  \
+    SSSE3_SELECT(_mm_cmpgt_epi8((x), _mm_set1_epi8(15)),                                   \
+                 _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) &(s)->image[16]), _mm_sub_epi8((x), _mm_set1_epi8(16))), \
+                 _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) &(s)->image[0]), (x)))
+#define SSSE3_ADD_MOD26(x, y) \
+    _mm_min_epu8(_mm_add_epi8((x), (y)), _mm_sub_epi8(_mm_add_epi8((x), (y)), _mm_set1_epi8(26)))
+#define SSSE3_SUB_MOD26(x, y) \
+    _mm_min_epu8(_mm_sub_epi8((x), (y)), _mm_add_epi8(_mm_sub_epi8((x), (y)), _mm_set1_epi8(26)))
+
+/**
+ * SSSE3 SIMD kernel. Enciphers the block 16 letters at a time.
+ */
+__attribute__((target("ssse3")))
+static void encipher_block_ssse3(const SimdEnigma *simd, u8 *output, const u8 *input,
+                                 const u8 positions[3][SIMD_BLOCK_SIZE])
+{
+    for (int half = 0; half < SIMD_BLOCK_SIZE; half += 16) {
+        __m128i shift[3];
+        for (int r = 0; r < 3; r++) {
+            shift[r] = _mm_loadu_si128((const __m128i *) &positions[r][half]);
+        }
+
+        __m128i x = _mm_loadu_si128((const __m128i *) &input[half]);
+        x = SSSE3_SUBST(&simd->plugboard, x);
+        for (int r = 2; r >= 0; r--) {
+            x = SSSE3_ADD_MOD26(x, shift[r]);
+            x = SSSE3_SUBST(&simd->forward[r], x);
+            x = SSSE3_SUB_MOD26(x, shift[r]);
+        }
+        x = SSSE3_SUBST(&simd->reflector, x);
+        for (int r = 0; r < 3; r++) {
+            x = SSSE3_ADD_MOD26(x, shift[r]);
+            x = SSSE3_SUBST(&simd->reverse[r], x);
+            x = SSSE3_SUB_MOD26(x, shift[r]);
+        }
+        x = SSSE3_SUBST(&simd->plugboard, x);
+        _mm_storeu_si128((__m128i *) &output[half], x);
+    }
+}
+
+#endif /* ENIGMA_X86_SIMD */
+
+/**
+ * Loads the machine `enigma` into lane `l` of `lanes`.
+ */
+static void load_lane(LaneEnigmas *lanes, size_t l, const Enigma *enigma)
+{
+    prepare_simd_substitution(&lanes->plugboard[l], &enigma->plugboard, 0);
+    prepare_simd_substitution(&lanes->reflector[l], &enigma->reflector, 0);
+    for (int r = 0; r < 3; r++) {
+        const Rotor *rotor = &enigma->rotor[r];
+        prepare_simd_substitution(&lanes->forward[r][l], &rotor->forward, rotor->ring_setting);
+        prepare_simd_substitution(&lanes->reverse[r][l], &rotor->reverse, rotor->ring_setting);
+        lanes->position[r][l] = rotor->position;
+        lanes->turnover[r][0][l] = rotor->turnover1;
+        lanes->turnover[r][1][l] = rotor->turnover2;
+    }
+}
+
+/**
+ * Copies the rotor positions of lane `l` of `lanes` back into `enigma`.
+ */
+static void store_lane(const LaneEnigmas *lanes, size_t l, Enigma *enigma)
+{
+    for (int r = 0; r < 3; r++) {
+        enigma->rotor[r].position = lanes->position[r][l];
+    }
+}
+
+/**
+ * Returns the best lane kernel supported by the CPU.
+ */
+static LaneKernel select_lane_kernel(void)
+{
+#ifdef ENIGMA_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return encipher_lanes_avx2;
+    }
+#endif
+    return encipher_lanes_scalar;
+}
+
+/**
+ * Portable lane kernel. Runs the lanes one after the other.
+ */
+static void encipher_lanes_scalar(LaneEnigmas *lanes, u8 block[LANE_BLOCK_SIZE][MESSAGE_LANES], size_t n_steps)
+{
+    for (size_t l = 0; l < MESSAGE_LANES; l++) {
+        u32 p[3] = {lanes->position[0][l], lanes->position[1][l], lanes->position[2][l]};
+        for (size_t i = 0; i < n_steps; i++) {
+            b8 middle_at_notch = (p[1] == lanes->turnover[1][0][l]) || (p[1] == lanes->turnover[1][1][l]);
+            b8 right_at_notch = (p[2] == lanes->turnover[2][0][l]) || (p[2] == lanes->turnover[2][1][l]);
+            p[0] = (p[0] + middle_at_notch) % 26;
+            p[1] = (p[1] + (middle_at_notch || right_at_notch)) % 26;
+            p[2] = (p[2] + 1) % 26;
+
+            u8 x = lanes->plugboard[l].image[block[i][l]];
+            for (int r = 2; r >= 0; r--) {
+                x = (lanes->forward[r][l].image[(x + p[r]) % 26] + 26 - p[r]) % 26;
+            }
+            x = lanes->reflector[l].image[x];
+            for (int r = 0; r < 3; r++) {
+                x = (lanes->reverse[r][l].image[(x + p[r]) % 26] + 26 - p[r]) % 26;
+            }
+            block[i][l] = lanes->plugboard[l].image[x];
+        }
+        for (int r = 0; r < 3; r++) {
+            lanes->position[r][l] = p[r];
+        }
+    }
+}
+
+#ifdef ENIGMA_X86_SIMD
+
+/* 
+ * Looks up every lane of `x` in its own lane of the SIMD substitutions `s` (8 lanes, 
+ * starting at the lane of `s`). Each lane gathers the 4 bytes at its letter, of which 
+ * the first is kept; the padding of the substitutions keeps the reads in bounds.
+ */
+#define AVX2_GATHER_SUBST(s, x)                                                            \
+    _mm256_and_si256(_mm256_i32gather_epi32((const int *) (s)->image,                       \
+                                            _mm256_add_epi32((x), lane_offsets), 1),       \
+                     _mm256_set1_epi32(0xFF))
+
+/* (x + y) mod 26 and (x - y) mod 26 for 32-bit x, y in [0, 25] */
+#define AVX2_ADD_MOD26_EPI32(x, y) \
+    _mm256_min_epu32(_mm256_add_epi32((x), (y)), _mm256_sub_epi32(_mm256_add_epi32((x), (y)), _mm256_set1_epi32(26)))
+#define AVX2_SUB_MOD26_EPI32(x, y) \
+    _mm256_min_epu32(_mm256_sub_epi32((x), (y)), _mm256_add_epi32(_mm256_sub_epi32((x), (y)), _mm256_set1_epi32(26)))
+
+/**
+ * AVX2 lane kernel. Runs the lanes 8 at a time, one per 32-bit element. The rotors of all
+ * 8 lanes are stepped with comparisons, and each substitution is a single gather. Since 
+ * every substitution depends on the last, all MESSAGE_LANES / 8 vectors are enciphered 
+ * side by side, so that their gathers overlap.
+ */
+__attribute__((target("avx2")))
+static void encipher_lanes_avx2(LaneEnigmas *lanes, u8 block[LANE_BLOCK_SIZE][MESSAGE_LANES], size_t n_steps)
+{
+    enum { N_VECTORS = MESSAGE_LANES / 8 };
+    static_assert(MESSAGE_LANES % 8 == 0, "");
+    const __m256i lane_offsets = _mm256_setr_epi32(0, 32, 64, 96, 128, 160, 192, 224);
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i p[3][N_VECTORS];
+    __m256i notch[3][2][N_VECTORS];
+    for (int r = 0; r < 3; r++) {
+        for (int v = 0; v < N_VECTORS; v++) {
+            p[r][v] = _mm256_loadu_si256((const __m256i *) &lanes->position[r][8 * v]);
+            notch[r][0][v] = _mm256_loadu_si256((const __m256i *) &lanes->turnover[r][0][8 * v]);
+            notch[r][1][v] = _mm256_loadu_si256((const __m256i *) &lanes->turnover[r][1][8 * v]);
+        }
+    }
+
+    for (size_t i = 0; i < n_steps; i++) {
+        __m256i x[N_VECTORS];
+        for (int v = 0; v < N_VECTORS; v++) {
+            __m256i middle_at_notch = _mm256_or_si256(_mm256_cmpeq_epi32(p[1][v], notch[1][0][v]), 
+                                                      _mm256_cmpeq_epi32(p[1][v], notch[1][1][v]));
+            __m256i right_at_notch = _mm256_or_si256(_mm256_cmpeq_epi32(p[2][v], notch[2][0][v]), 
+                                                     _mm256_cmpeq_epi32(p[2][v], notch[2][1][v]));
+            __m256i left_steps = _mm256_and_si256(middle_at_notch, one);
+            __m256i middle_steps = _mm256_and_si256(_mm256_or_si256(middle_at_notch, right_at_notch), one);
+            p[0][v] = AVX2_ADD_MOD26_EPI32(p[0][v], left_steps);
+            p[1][v] = AVX2_ADD_MOD26_EPI32(p[1][v], middle_steps);
+            p[2][v] = AVX2_ADD_MOD26_EPI32(p[2][v], one);
+
+            x[v] = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &block[i][8 * v]));
+            x[v] = AVX2_GATHER_SUBST(&lanes->plugboard[8 * v], x[v]);
+        }
+        for (int r = 2; r >= 0; r--) {
+            for (int v = 0; v < N_VECTORS; v++) {
+                x[v] = AVX2_ADD_MOD26_EPI32(x[v], p[r][v]);
+                x[v] = AVX2_GATHER_SUBST(&lanes->forward[r][8 * v], x[v]);
+                x[v] = AVX2_SUB_MOD26_EPI32(x[v], p[r][v]);
+            }
+        }
+        for (int v = 0; v < N_VECTORS; v++) {
+            x[v] = AVX2_GATHER_SUBST(&lanes->reflector[8 * v], x[v]);
+        }
+        for (int r = 0; r < 3; r++) {
+            for (int v = 0; v < N_VECTORS; v++) {
+                x[v] = AVX2_ADD_MOD26_EPI32(x[v], p[r][v]);
+                x[v] = AVX2_GATHER_SUBST(&lanes->reverse[r][8 * v], x[v]);
+                x[v] = AVX2_SUB_MOD26_EPI32(x[v], p[r][v]);
+            }
+        }
+        for (int v = 0; v < N_VECTORS; v++) {
+            x[v] = AVX2_GATHER_SUBST(&lanes->plugboard[8 * v], x[v]);
+
+            /* narrow the 8 letters back to bytes; the packs work within 128-bit halves */
+            __m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(x[v], x[v]), _mm256_setzero_si256());
+            u32 lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(bytes));
+            u32 hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(bytes, 1));
+            memcpy(&block[i][8 * v], &lo, 4);
+            memcpy(&block[i][8 * v + 4], &hi, 4);
+        }
+    }
+
+    for (int r = 0; r < 3; r++) {
+        for (int v = 0; v < N_VECTORS; v++) {
+            _mm256_storeu_si256((__m256i *) &lanes->position[r][8 * v], p[r][v]);
+        }
+    }
+}
+
+#endif /* ENIGMA_X86_SIMD */
+
+/**
+ * Lexer rule which matches the numerical encodings of the letters from the Enigma alphabet.
+ */
+static size_t lex_numeric(HglStringView sv)
+{
+    if (sv.length == 0) {
+        return 0;
+    }
+    size_t original_length = sv.length;
+    if (sv.start[0] < '1' || sv.start[0] > '9') return 0;
+    u64 value = hgl_sv_lchop_u64(&sv);
+    if (value < 1 || value > 26) {
+        return 0;
+    }
+    return original_length - sv.length;
+}
+
+/**
+ * Lexer rule which matches the letters from the Enigma alphabet.
+ */
+static size_t lex_letter(HglStringView sv)
+{
+    if (sv.length == 0) {
+        return 0;
+    }
+    char c = to_upper(sv.start[0]);
+    if (c >= 'A' && c <= 'Z') {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the uppercase of `c`.
+ */
+static char to_upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? (c - 0x20) : c;
+}
+
+/**
+ * Returns true if `c` is in the Enigma alphabet.
+ */
+static char in_alphabet(char c)
+{
+    return c >= 'A' && c <= 'Z';
+}
+
@@ -0,0 +1,344 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * The Turing-Welchman bombe behind --bombe: the menu built from a crib, and the run of
+ * that menu through every reflector, rotor order, and indicator setting, with the
+ * diagonal board.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "enigma_bombe.h"
+
+/*--- Private macros --------------------------------------------------------------------*/
+
+#define ALL_WIRES ((1u << 26) - 1) // a bombe register with all 26 wires live
+
+/*--- Private type definitions ----------------------------------------------------------*/
+
+/*
+ * The shared state of a bombe run (see `run_bombe`).
+ */
+typedef struct {
+    const Enigma *enigma;     /* machine with the ring setting set up */
+    const Menu *menu;
+    u64 crib_offset;
+    const char **reflectors;
+    const char **rotors;
+    u8 (*orders)[3];          /* all rotor orders; indices into `rotors` */
+    size_t n_orders;
+    BombeStop *stops;
+    size_t n_stops;
+    size_t stops_capacity;
+    pthread_mutex_t lock;
+} BombeSearch;
+
+/*--- Function prototypes ---------------------------------------------------------------*/
+
+static void bombe_job(void *ctx, size_t job);
+static size_t test_position(const Menu *menu, const EnigmaTable *table, const u16 *positions, 
+                            u8 plugboards[26][26]);
+static b8 energize(const Menu *menu, const EnigmaTable *table, const u16 *positions, u8 letter, u8 wire, 
+                   u32 live[26]);
+static int compare_stops(const void *a, const void *b);
+
+/*--- Bombe functions -------------------------------------------------------------------*/
+
+/**
+ * Builds the menu of a bombe run from the `crib_length` letters at `crib` and the 
+ * ciphertext letters under them at `ciphertext`; one link per crib letter. The test
+ * register is the letter with the most links.
+ */
+void build_menu(Menu *menu, const char *ciphertext, const char *crib, size_t crib_length)
+{
+    *menu = (Menu) {0};
+    menu->links = malloc(crib_length * sizeof(*menu->links));
+    menu->adjacent = malloc(2 * crib_length * sizeof(size_t));
+    ENIGMA_ASSERT(menu->links != NULL && menu->adjacent != NULL, "Failed to allocate the menu.");
+    menu->n_links = crib_length;
+
+    size_t degree[26] = {0};
+    for (size_t i = 0; i < crib_length; i++) {
+        ENIGMA_ASSERT(crib[i] != ciphertext[i], "The crib does not fit here: the Enigma never enciphers "
+                      "a letter to itself (%c at crib letter %zu).", crib[i], i + 1);
+        menu->links[i][0] = ENCODE(crib[i]);
+        menu->links[i][1] = ENCODE(ciphertext[i]);
+        degree[menu->links[i][0]]++;
+        degree[menu->links[i][1]]++;
+    }
+    size_t next[26];
+    for (u8 a = 0; a < 26; a++) {
+        menu->first[a + 1] = menu->first[a] + degree[a];
+        next[a] = menu->first[a];
+        menu->test_register = (degree[a] > degree[menu->test_register]) ? a : menu->test_register;
+        menu->n_letters += (degree[a] > 0);
+    }
+
+    /* every link joining two letters which are already connected closes a loop */
+    u8 component[26];
+    for (u8 a = 0; a < 26; a++) {
+        component[a] = a;
+    }
+    for (size_t i = 0; i < crib_length; i++) {
+        menu->adjacent[next[menu->links[i][0]]++] = i;
+        menu->adjacent[next[menu->links[i][1]]++] = i;
+        u8 a = menu->links[i][0];
+        u8 b = menu->links[i][1];
+        while (component[a] != a) {
+            a = component[a];
+        }
+        while (component[b] != b) {
+            b = component[b];
+        }
+        component[a] = b;
+        menu->n_loops += (a == b);
+    }
+}
+
+/**
+ * Frees the links of `menu`.
+ */
+void free_menu(Menu *menu)
+{
+    free(menu->links);
+    free(menu->adjacent);
+    *menu = (Menu) {0};
+}
+
+/**
+ * Simulates a Turing-Welchman bombe running `menu` (with its crib `crib_offset` letters 
+ * into the message) on every reflector and rotor order chosen from the `n_reflectors` 
+ * and `n_rotors` names at `reflectors` and `rotors`, with the ring setting of `enigma`.
+ * Returns the stops, sorted, and places their number into `n_stops`.
+ *
+ * The scramblers are those of the machine sans plugboard, so each reflector and rotor 
+ * order is compiled into a table once (one job per rotor order, on `n_threads` threads),
+ * after which every scrambler is a table lookup.
+ */
+BombeStop *run_bombe(const Enigma *enigma, const Menu *menu, u64 crib_offset,
+                     const char **reflectors, size_t n_reflectors, const char **rotors, size_t n_rotors,
+                     size_t *n_stops, size_t n_threads)
+{
+    BombeSearch search = {
+        .enigma      = enigma,
+        .menu        = menu,
+        .crib_offset = crib_offset,
+        .reflectors  = reflectors,
+        .rotors      = rotors,
+    };
+    search.orders = malloc(n_rotors * n_rotors * n_rotors * sizeof(*search.orders));
+    ENIGMA_ASSERT(search.orders != NULL, "Failed to allocate the rotor orders.");
+    search.n_orders = list_rotor_orders(n_rotors, search.orders);
+
+    pthread_mutex_init(&search.lock, NULL);
+    parallel_for(n_reflectors * search.n_orders, n_threads, bombe_job, &search);
+    pthread_mutex_destroy(&search.lock);
+
+    qsort(search.stops, search.n_stops, sizeof(BombeStop), compare_stops);
+    free(search.orders);
+    *n_stops = search.n_stops;
+    return search.stops;
+}
+
+/**
+ * `parallel_for` job which compiles one reflector and rotor order, and runs the bombe 
+ * through all indicator settings with it.
+ */
+static void bombe_job(void *ctx, size_t job)
+{
+    BombeSearch *search = ctx;
+    const Menu *menu = search->menu;
+    size_t order = job % search->n_orders;
+    size_t reflector = job / search->n_orders;
+
+    /* set up and compile the machine sans plugboard */
+    BombeStop stop = {
+        .reflector = reflector,
+        .rotors    = {search->orders[order][0], search->orders[order][1], search->orders[order][2]},
+    };
+    char rotor_setting[64];
+    snprintf(rotor_setting, sizeof(rotor_setting), "%s %s %s", search->rotors[stop.rotors[0]], 
+             search->rotors[stop.rotors[1]], search->rotors[stop.rotors[2]]);
+    Enigma enigma = *search->enigma;
+    ENIGMA_ASSERT(apply_reflector_setting(&enigma, search->reflectors[reflector]) == ENIGMA_OK &&
+                  apply_rotor_setting(&enigma, rotor_setting) == ENIGMA_OK &&
+                  apply_plugboard_setting(&enigma, "") == ENIGMA_OK, "%s", enigma_error_message());
+    for (int i = 0; i < 3; i++) {
+        enigma.rotor[i].ring_setting = search->enigma->rotor[i].ring_setting;
+    }
+    EnigmaTable *table = malloc(sizeof(EnigmaTable));
+    u16 *positions = malloc(menu->n_links * sizeof(u16));
+    ENIGMA_ASSERT(table != NULL && positions != NULL, "Failed to allocate the bombe.");
+    compile_enigma(table, &enigma);
+
+    u8 plugboards[26][26];
+    for (u16 pos = 0; pos < N_POSITIONS; pos++) {
+        /* the rotor positions at which the crib letters are enciphered */
+        enigma.rotor[0].position = pos / (26 * 26);
+        enigma.rotor[1].position = (pos / 26) % 26;
+        enigma.rotor[2].position = pos % 26;
+        advance_enigma(&enigma, search->crib_offset);
+        u16 p = enigma.rotor[0].position * 26 * 26 + enigma.rotor[1].position * 26 + enigma.rotor[2].position;
+        for (size_t i = 0; i < menu->n_links; i++) {
+            p = table->next[p];
+            positions[i] = p;
+        }
+
+        size_t n = test_position(menu, table, positions, plugboards);
+        if (n == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&search->lock);
+        if (search->n_stops + n > search->stops_capacity) {
+            search->stops_capacity = 2 * search->stops_capacity + n;
+            search->stops = realloc(search->stops, search->stops_capacity * sizeof(BombeStop));
+            ENIGMA_ASSERT(search->stops != NULL, "Failed to allocate the bombe stops.");
+        }
+        for (size_t i = 0; i < n; i++) {
+            stop.position = pos;
+            memcpy(stop.plugboard, plugboards[i], 26);
+            search->stops[search->n_stops++] = stop;
+        }
+        pthread_mutex_unlock(&search->lock);
+    }
+    free(positions);
+    free(table);
+}
+
+/**
+ * Tests the indicator setting under which the links of `menu` are enciphered at the 
+ * rotor positions `positions` of `table`. Places the plugboard implied by every stecker
+ * of the test register which does not contradict itself into `plugboards`, and returns
+ * their number (almost always 0).
+ *
+ * A stecker hypothesis energizes one wire of the test register. Since the scramblers and
+ * the diagonal board connect wires both ways, the live wires of a true hypothesis are all
+ * true, so a hypothesis which lights up another wire of the test register is false, and
+ * so is that one. Hence, like on the real bombe, a single energized wire lighting up the
+ * entire test register rules out the position.
+ */
+static size_t test_position(const Menu *menu, const EnigmaTable *table, const u16 *positions, 
+                            u8 plugboards[26][26])
+{
+    u32 live[26];
+    if (!energize(menu, table, positions, menu->test_register, 0, live)) {
+        return 0;
+    }
+
+    /* a stop; find the hypotheses whose live wires imply at most one stecker per letter */
+    size_t n = 0;
+    u32 tested = 0;
+    for (u8 wire = 0; wire < 26; wire++) {
+        if (tested & (1u << wire)) {
+            continue;
+        }
+        b8 consistent = energize(menu, table, positions, menu->test_register, wire, live);
+        tested |= live[menu->test_register];
+        for (u8 a = 0; a < 26 && consistent; a++) {
+            consistent = (live[a] & (live[a] - 1)) == 0;
+        }
+        if (!consistent) {
+            continue;
+        }
+        for (u8 a = 0; a < 26; a++) {
+            plugboards[n][a] = (live[a] != 0) ? (u8) __builtin_ctz(live[a]) : a;
+        }
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Energizes wire `wire` of the register of letter `letter` (i.e. hypothesizes that 
+ * `letter` is steckered to `wire`), and lets the current spread through the scramblers 
+ * of the links of `menu` and the diagonal board. Places the live wires of every register
+ * into `live` (bit x of live[a] is set if wire x of register a is live). Returns false 
+ * as soon as all wires of the test register are live.
+ */
+static b8 energize(const Menu *menu, const EnigmaTable *table, const u16 *positions, u8 letter, u8 wire, 
+                   u32 live[26])
+{
+    u16 stack[26 * 26]; /* live wires whose current is yet to be spread (register * 26 + wire) */
+    size_t n = 0;
+    memset(live, 0, 26 * sizeof(u32));
+    live[letter] = 1u << wire;
+    stack[n++] = letter * 26 + wire;
+    while (n > 0) {
+        u16 top = stack[--n];
+        u8 a = top / 26;
+        u8 x = top % 26;
+
+        /* the diagonal board: if a is steckered to x, then x is steckered to a */
+        if (!(live[x] & (1u << a))) {
+            live[x] |= 1u << a;
+            stack[n++] = x * 26 + a;
+        }
+
+        /* the scramblers: if a is steckered to x, the letter b at the other end of the link
+           is steckered to the letter which x enciphers to */
+        for (size_t i = menu->first[a]; i < menu->first[a + 1]; i++) {
+            size_t link = menu->adjacent[i];
+            u8 b = (menu->links[link][0] == a) ? menu->links[link][1] : menu->links[link][0];
+            u8 y = ENCODE(table->image[positions[link]].image[x]);
+            if (!(live[b] & (1u << y))) {
+                live[b] |= 1u << y;
+                stack[n++] = b * 26 + y;
+            }
+        }
+
+        if (live[menu->test_register] == ALL_WIRES) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Compares two bombe stops by reflector, rotor order, and indicator setting (for qsort).
+ */
+static int compare_stops(const void *a, const void *b)
+{
+    const BombeStop *sa = a;
+    const BombeStop *sb = b;
+    int diff = memcmp(sa, sb, offsetof(BombeStop, position));
+    if (diff != 0) {
+        return diff;
+    }
+    if (sa->position != sb->position) {
+        return (sa->position < sb->position) ? -1 : 1;
+    }
+    return memcmp(sa->plugboard, sb->plugboard, 26);
+}
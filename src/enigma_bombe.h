@@ -0,0 +1,81 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * The Turing-Welchman bombe simulator behind --bombe. See enigma_bombe.c.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef ENIGMA_BOMBE_H
+#define ENIGMA_BOMBE_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include "enigma_cli.h"
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+/*
+ * The menu of a bombe run (see `build_menu`); the graph whose vertices are letters, and 
+ * whose edges (links) join the crib letter and the ciphertext letter at each place. 
+ */
+typedef struct {
+    u8 (*links)[2];       /* the crib and ciphertext letter of each link, encoded as 0-25 */
+    size_t n_links;
+    size_t first[26 + 1]; /* the links at letter a are adjacent[first[a]..first[a + 1]) */
+    size_t *adjacent;
+    u8 test_register;     /* the letter whose stecker hypotheses are tested */
+    size_t n_letters;     /* number of letters in the menu */
+    size_t n_loops;       /* number of independent loops in the menu */
+} Menu;
+
+/*
+ * A bombe stop; a reflector, rotor order, and indicator setting under which the menu is 
+ * consistent, along with the steckers (plugboard pairs) this implies.
+ */
+typedef struct {
+    u8 reflector;
+    u8 rotors[3];     /* indices into the names given to the bombe */
+    u16 position;     /* packed indicator setting */
+    u8 plugboard[26]; /* the implied steckers; letters with no implied stecker map to themselves */
+} BombeStop;
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/* Menus */
+void build_menu(Menu *menu, const char *ciphertext, const char *crib, size_t crib_length);
+void free_menu(Menu *menu);
+
+/* Bombe */
+BombeStop *run_bombe(const Enigma *enigma, const Menu *menu, u64 crib_offset,
+                     const char **reflectors, size_t n_reflectors, const char **rotors, size_t n_rotors,
+                     size_t *n_stops, size_t n_threads);
+
+#endif /* ENIGMA_BOMBE_H */
@@ -0,0 +1,343 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * The cycle catalog behind --build-catalog and --catalog-lookup: the characteristics
+ * (cycle structures of AD, BE, and CF) of every indicator setting, sorted into a file
+ * which is memory-mapped for lookups, and the observation of a characteristic from a
+ * day's doubled indicators.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#ifndef _POSIX_C_SOURCE
+#  define _POSIX_C_SOURCE 200809L /* for mmap, etc. */
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "enigma_catalog.h"
+
+/*--- Private macros --------------------------------------------------------------------*/
+
+#define CATALOG_MAGIC "ENICATLG" // identifies cycle catalog files (see CatalogFileHeader)
+
+/*--- Private type definitions ----------------------------------------------------------*/
+
+/*
+ * The header of a cycle catalog file, as written by --build-catalog. It is followed by 
+ * `n_settings` CatalogSettings, the N_CHARACTERISTICS + 1 offsets of the entries of each
+ * characteristic, and the `n_entries` entries (see Catalog). All numbers are u32s in 
+ * native byte order.
+ */
+typedef struct {
+    char magic[8];  /* CATALOG_MAGIC */
+    u32 n_settings;
+    u32 n_entries;  /* n_settings * N_POSITIONS */
+} CatalogFileHeader;
+
+/*
+ * The shared state of a cycle catalog build (see `build_catalog`).
+ */
+typedef struct {
+    const char **reflectors;
+    const char **rotors;
+    u8 (*orders)[3];          /* all rotor orders; indices into `rotors` */
+    size_t n_orders;
+    u32 *characteristics;     /* characteristics[setting * N_POSITIONS + position] */
+} CatalogBuild;
+
+/*--- Function prototypes ---------------------------------------------------------------*/
+
+static void catalog_job(void *ctx, size_t job);
+
+/*--- Catalog functions -----------------------------------------------------------------*/
+
+/**
+ * Builds a cycle catalog (see Catalog) for the `n_reflectors` and `n_rotors` names at 
+ * `reflectors` and `rotors`, using `n_threads` threads, and writes it to `output_fd`.
+ *
+ * The Polish method: a day's doubled indicators reveal the products AD, BE, and CF of the
+ * substitutions A-F performed at the first six letters after the indicator setting. Their
+ * cycle structures (the characteristic) do not depend on the plugboard, which merely 
+ * relabels the letters of each cycle, nor, up to the timing of the turnovers, on the ring 
+ * setting, which merely shifts the positions. So the catalog is built without plugboard, 
+ * at ring setting 1 1 1, with one job per reflector and rotor order, and the entries are
+ * then sorted by characteristic with a counting sort.
+ */
+void build_catalog(int output_fd, const char **reflectors, size_t n_reflectors, const char **rotors, 
+                   size_t n_rotors, size_t n_threads)
+{
+    CatalogBuild build = {
+        .reflectors = reflectors,
+        .rotors     = rotors,
+    };
+    build.orders = malloc(n_rotors * n_rotors * n_rotors * sizeof(*build.orders));
+    ENIGMA_ASSERT(build.orders != NULL, "Failed to allocate the rotor orders.");
+    build.n_orders = list_rotor_orders(n_rotors, build.orders);
+    size_t n_settings = n_reflectors * build.n_orders;
+    size_t n_entries = n_settings * N_POSITIONS;
+    build.characteristics = malloc(n_entries * sizeof(u32));
+    CatalogSetting *settings = calloc(n_settings, sizeof(CatalogSetting));
+    u32 *offsets = calloc(N_CHARACTERISTICS + 1, sizeof(u32));
+    u32 *entries = malloc(n_entries * sizeof(u32));
+    ENIGMA_ASSERT(build.characteristics != NULL && settings != NULL && offsets != NULL && entries != NULL, 
+                  "Failed to allocate the catalog.");
+
+    for (size_t i = 0; i < n_settings; i++) {
+        const u8 *order = build.orders[i % build.n_orders];
+        int n = snprintf(settings[i].reflector, sizeof(settings[i].reflector), "%s", reflectors[i / build.n_orders]);
+        int m = snprintf(settings[i].rotors, sizeof(settings[i].rotors), "%s %s %s", rotors[order[0]], 
+                         rotors[order[1]], rotors[order[2]]);
+        ENIGMA_ASSERT(n < (int) sizeof(settings[i].reflector) && m < (int) sizeof(settings[i].rotors), 
+                      "Reflector or rotor name too long.");
+    }
+    parallel_for(n_settings, n_threads, catalog_job, &build);
+
+    /* counting sort; offsets[c + 1] is first the count, then the end, of characteristic c */
+    for (size_t i = 0; i < n_entries; i++) {
+        offsets[build.characteristics[i] + 1]++;
+    }
+    for (size_t c = 0; c < N_CHARACTERISTICS; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+    for (size_t i = 0; i < n_entries; i++) {
+        entries[offsets[build.characteristics[i]]++] = i;
+    }
+    for (size_t c = N_CHARACTERISTICS; c > 0; c--) {
+        offsets[c] = offsets[c - 1];
+    }
+    offsets[0] = 0;
+
+    CatalogFileHeader header = {.magic = CATALOG_MAGIC, .n_settings = n_settings, .n_entries = n_entries};
+    write_fully(output_fd, (const char *) &header, sizeof(header));
+    write_fully(output_fd, (const char *) settings, n_settings * sizeof(CatalogSetting));
+    write_fully(output_fd, (const char *) offsets, (N_CHARACTERISTICS + 1) * sizeof(u32));
+    write_fully(output_fd, (const char *) entries, n_entries * sizeof(u32));
+    free(entries);
+    free(offsets);
+    free(settings);
+    free(build.characteristics);
+    free(build.orders);
+}
+
+/**
+ * `parallel_for` job which compiles one reflector and rotor order, and computes the 
+ * characteristic of every indicator setting with it.
+ */
+static void catalog_job(void *ctx, size_t job)
+{
+    CatalogBuild *build = ctx;
+    const u8 *order = build->orders[job % build->n_orders];
+    char rotor_setting[64];
+    snprintf(rotor_setting, sizeof(rotor_setting), "%s %s %s", build->rotors[order[0]], 
+             build->rotors[order[1]], build->rotors[order[2]]);
+    Enigma enigma = {0};
+    ENIGMA_ASSERT(apply_reflector_setting(&enigma, build->reflectors[job / build->n_orders]) == ENIGMA_OK &&
+                  apply_rotor_setting(&enigma, rotor_setting) == ENIGMA_OK &&
+                  apply_ring_setting(&enigma, "1 1 1") == ENIGMA_OK &&
+                  apply_plugboard_setting(&enigma, "") == ENIGMA_OK, "%s", enigma_error_message());
+    EnigmaTable *table = malloc(sizeof(EnigmaTable));
+    ENIGMA_ASSERT(table != NULL, "Failed to allocate the enigma table.");
+    compile_enigma(table, &enigma);
+
+    u32 *characteristics = &build->characteristics[job * N_POSITIONS];
+    for (u32 start = 0; start < N_POSITIONS; start++) {
+        /* the substitutions A-F, at the first six letters after the indicator setting */
+        const Substitution *s[6];
+        u16 pos = start;
+        for (int k = 0; k < 6; k++) {
+            pos = table->next[pos];
+            s[k] = &table->image[pos];
+        }
+        u8 products[3][26];
+        for (int k = 0; k < 3; k++) {
+            for (u8 n = 0; n < 26; n++) {
+                products[k][n] = ENCODE(s[k + 3]->image[ENCODE(s[k]->image[n])]);
+            }
+        }
+        characteristics[start] = rank_characteristic(products);
+    }
+    free(table);
+}
+
+/**
+ * Memory-maps the cycle catalog file at `path` (see --build-catalog) into `catalog`.
+ */
+void load_catalog(Catalog *catalog, const char *path)
+{
+    *catalog = (Catalog) {0};
+    int fd = open(path, O_RDONLY);
+    ENIGMA_ASSERT(fd >= 0, "Failed to open catalog \"%s\".", path);
+    struct stat st;
+    ENIGMA_ASSERT(fstat(fd, &st) == 0, "Failed to read catalog \"%s\".", path);
+    catalog->mapping_size = st.st_size;
+    ENIGMA_ASSERT(catalog->mapping_size >= sizeof(CatalogFileHeader), "Invalid catalog \"%s\".", path);
+    catalog->mapping = mmap(NULL, catalog->mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    ENIGMA_ASSERT(catalog->mapping != MAP_FAILED, "Failed to map catalog \"%s\".", path);
+    close(fd);
+
+    const CatalogFileHeader *header = catalog->mapping;
+    ENIGMA_ASSERT(memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) == 0, "Invalid catalog \"%s\".", path);
+    ENIGMA_ASSERT(catalog->mapping_size == sizeof(CatalogFileHeader) + header->n_settings * sizeof(CatalogSetting) +
+                  (N_CHARACTERISTICS + 1 + (size_t) header->n_entries) * sizeof(u32), "Truncated catalog \"%s\".", path);
+    catalog->settings = (const CatalogSetting *) (header + 1);
+    catalog->n_settings = header->n_settings;
+    catalog->offsets = (const u32 *) &catalog->settings[catalog->n_settings];
+    catalog->entries = &catalog->offsets[N_CHARACTERISTICS + 1];
+}
+
+/**
+ * Unmaps `catalog`.
+ */
+void free_catalog(Catalog *catalog)
+{
+    munmap(catalog->mapping, catalog->mapping_size);
+    *catalog = (Catalog) {0};
+}
+
+/**
+ * Places the products AD, BE, and CF revealed by the `n_indicators` doubled indicators (6 
+ * letters each) at `indicators` into `products`: the first and fourth letter of every
+ * indicator are joined by AD, and so on. Letters not (yet) seen map to 26. Returns false
+ * if the indicators contradict each other.
+ */
+b8 observe_products(const char *indicators, size_t n_indicators, u8 products[3][26])
+{
+    memset(products, 26, 3 * 26);
+    for (size_t i = 0; i < n_indicators; i++) {
+        const char *indicator = &indicators[6 * i];
+        for (int k = 0; k < 3; k++) {
+            u8 a = ENCODE(indicator[k]);
+            u8 d = ENCODE(indicator[k + 3]);
+            if (products[k][a] != 26 && products[k][a] != d) {
+                return false;
+            }
+            products[k][a] = d;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the characteristic (the cycle structures of AD, BE, and CF) of the `products`,
+ * as a number less than N_CHARACTERISTICS, or N_CHARACTERISTICS if any of them is not
+ * a (complete) product of two reflections. See `rank_cycle_structure`.
+ */
+u32 rank_characteristic(const u8 products[3][26])
+{
+    u32 characteristic = 0;
+    for (int k = 0; k < 3; k++) {
+        u32 rank = rank_cycle_structure(products[k]);
+        if (rank == N_CYCLE_STRUCTURES) {
+            return N_CHARACTERISTICS;
+        }
+        characteristic = characteristic * N_CYCLE_STRUCTURES + rank;
+    }
+    return characteristic;
+}
+
+/**
+ * Returns the rank of the cycle structure of `permutation`, a product of two reflections,
+ * among all N_CYCLE_STRUCTURES such structures, or N_CYCLE_STRUCTURES if `permutation` 
+ * is not such a product. The cycles of such a product come in pairs of equal length, so
+ * its structure is a partition of 13; partitions are ranked in lexicographic order of 
+ * their parts, largest first.
+ */
+u32 rank_cycle_structure(const u8 permutation[26])
+{
+    /* partitions[n][m] is the number of partitions of n into parts no larger than m */
+    static const u8 partitions[14][14] = {
+        {  1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1},
+        {  0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1},
+        {  0,   1,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2},
+        {  0,   1,   2,   3,   3,   3,   3,   3,   3,   3,   3,   3,   3,   3},
+        {  0,   1,   3,   4,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5},
+        {  0,   1,   3,   5,   6,   7,   7,   7,   7,   7,   7,   7,   7,   7},
+        {  0,   1,   4,   7,   9,  10,  11,  11,  11,  11,  11,  11,  11,  11},
+        {  0,   1,   4,   8,  11,  13,  14,  15,  15,  15,  15,  15,  15,  15},
+        {  0,   1,   5,  10,  15,  18,  20,  21,  22,  22,  22,  22,  22,  22},
+        {  0,   1,   5,  12,  18,  23,  26,  28,  29,  30,  30,  30,  30,  30},
+        {  0,   1,   6,  14,  23,  30,  35,  38,  40,  41,  42,  42,  42,  42},
+        {  0,   1,   6,  16,  27,  37,  44,  49,  52,  54,  55,  56,  56,  56},
+        {  0,   1,   7,  19,  34,  47,  58,  65,  70,  73,  75,  76,  77,  77},
+        {  0,   1,   7,  21,  39,  57,  71,  82,  89,  94,  97,  99, 100, 101},
+    };
+    static_assert(N_CYCLE_STRUCTURES == 101, "");
+
+    u8 counts[26 + 1];
+    if (!count_cycles(permutation, counts)) {
+        return N_CYCLE_STRUCTURES;
+    }
+    u32 rank = 0;
+    u8 remaining = 13;
+    for (u8 length = 26; length > 0; length--) {
+        if (counts[length] % 2 != 0) {
+            return N_CYCLE_STRUCTURES;
+        }
+        for (u8 i = 0; i < counts[length] / 2; i++) {
+            rank += partitions[remaining][length - 1];
+            remaining -= length;
+        }
+    }
+    return rank;
+}
+
+/**
+ * Counts the cycles of each length (1-26) of `permutation` into `counts`. Returns false
+ * if `permutation` is not a permutation of all 26 letters (e.g. some are not known).
+ */
+b8 count_cycles(const u8 permutation[26], u8 counts[26 + 1])
+{
+    memset(counts, 0, 26 + 1);
+    u32 seen = 0;
+    for (u8 n = 0; n < 26; n++) {
+        if (seen & (1u << n)) {
+            continue;
+        }
+        u8 length = 0;
+        u8 m = n;
+        do {
+            if (permutation[m] >= 26 || (seen & (1u << m))) {
+                return false;
+            }
+            seen |= 1u << m;
+            m = permutation[m];
+            length++;
+        } while (m != n);
+        counts[length]++;
+    }
+    return true;
+}
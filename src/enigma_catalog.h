@@ -0,0 +1,88 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * The Rejewski cycle catalog behind --build-catalog and --catalog-lookup. See
+ * enigma_catalog.c.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef ENIGMA_CATALOG_H
+#define ENIGMA_CATALOG_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include "enigma_cli.h"
+
+/*--- Public macros ---------------------------------------------------------------------*/
+
+#define N_CYCLE_STRUCTURES 101 // number of cycle structures of a product of two reflections
+#define N_CHARACTERISTICS (N_CYCLE_STRUCTURES * N_CYCLE_STRUCTURES * N_CYCLE_STRUCTURES)
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+/*
+ * A reflector and rotor order of a cycle catalog, as given to -u and -w.
+ */
+typedef struct {
+    char reflector[16];
+    char rotors[48];
+} CatalogSetting;
+
+/*
+ * A memory-mapped cycle catalog; for each characteristic (see `rank_characteristic`), the
+ * reflectors, rotor orders, and indicator settings under which doubled indicators have 
+ * that characteristic. The entries with characteristic c are entries[offsets[c]] up to 
+ * entries[offsets[c + 1]], each encoded as (setting * N_POSITIONS + packed position).
+ */
+typedef struct {
+    const CatalogSetting *settings;
+    size_t n_settings;
+    const u32 *offsets;
+    const u32 *entries;
+    void *mapping;
+    size_t mapping_size;
+} Catalog;
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/* Catalog files */
+void build_catalog(int output_fd, const char **reflectors, size_t n_reflectors, const char **rotors, 
+                   size_t n_rotors, size_t n_threads);
+void load_catalog(Catalog *catalog, const char *path);
+void free_catalog(Catalog *catalog);
+
+/* Characteristics */
+b8 observe_products(const char *indicators, size_t n_indicators, u8 products[3][26]);
+u32 rank_characteristic(const u8 products[3][26]);
+u32 rank_cycle_structure(const u8 permutation[26]);
+b8 count_cycles(const u8 permutation[26], u8 counts[26 + 1]);
+
+#endif /* ENIGMA_CATALOG_H */
@@ -42,6 +42,40 @@
  *       -g,--indicator-setting,--grundstellung           Indicator setting (Ger: Grundstellung) (default = "1 1 1")
  *       -G,--group-size                                  Number of characters per group in the output. (default = 5, valid range = [1, 64])
  *       -N,--groups-per-line                             Number of groups per line in the output. (default = 6, valid range = [1, 64])
+ *       -t,--threads                                     Number of threads to encipher with. (default = 1, valid range = [1, 256])
+ *       --offset                                         Number of letters to skip ahead before enciphering (i.e. start mid-stream). (default = 0, valid range = [0, 18446744073709551615])
+ *       -i,--input                                       Memory-map and encipher this file instead of reading from stdin. (default = "")
+ *       -o,--output                                      Write the output to this file instead of stdout. Memory-mapped if -i is given. (default = "")
+ *       --batch                                          Encipher every record of this batch file ("-" for stdin) with its own settings. The results hold raw letters (-f, -G, and -N don't apply). (default = "")
+ *       --batch-format                                   Batch file format ("csv", "tsv", or "binary") (default = "csv")
+ *       --procedure                                      Indicator procedure of the input or batch messages ("none", "doubled-indicator", or "single-indicator") (default = "none")
+ *       --serve                                          Run as a daemon serving requests on this Unix domain socket. (default = "")
+ *       --connect                                        Have the daemon listening on this Unix domain socket encipher the input. (default = "")
+ *       --cache-size                                     Memory (in MiB) for caching configured machines in --batch and --serve mode. (default = 64, valid range = [0, 1048576])
+ *       --crib-positions                                 List the offsets into the input at which these (comma-separated) cribs may be placed; where no crib letter meets the same ciphertext letter. (default = "")
+ *       --search-indicator                               Find the indicator settings under which the input deciphers to the crib. (default = 0)
+ *       --crib                                           Known plaintext for --search-indicator and --bombe. (default = "")
+ *       --crib-offset                                    Number of letters into the message at which the crib starts. (default = 0, valid range = [0, 18446744073709551615])
+ *       --search-ioc                                     Find the reflectors, rotor orders, and indicator settings whose decryptions of the input have the highest index of coincidence. (default = 0)
+ *       --search-reflectors                              Reflectors to try in --search-ioc and --bombe, and to catalog in --build-catalog. (default = "UKW-A UKW-B UKW-C")
+ *       --search-rotors                                  Rotors to try in --search-ioc and --bombe, and to catalog in --build-catalog. (default = "I II III IV V VI VII VIII")
+ *       --search-rings                                   Also try all middle and right ring settings in --search-ioc (26 times slower; see README). (default = 0)
+ *       --bitsliced                                      Score the keys in --search-ioc with the bitsliced scorer rather than compiled tables (slower in the builds measured; see README). (default = 0)
+ *       --top                                            Number of candidates reported by --search-ioc. (default = 10, valid range = [1, 1000])
+ *       --bombe                                          Find the rotor orders, indicator settings, and plugboard pairs consistent with the crib, like a Turing-Welchman bombe (with the given ring setting). (default = 0)
+ *       --build-catalog                                  Build a catalog of the cycle structures of doubled indicators (see --catalog-lookup) for all indicator settings of the --search-reflectors and --search-rotors, and write it to the output. (default = 0)
+ *       --catalog-lookup                                 Find the reflectors, rotor orders, and indicator settings under which the doubled indicators (6 letters each) in the input have the cycle structure they have, in this catalog (see --build-catalog). (default = "")
+ *       --search-plugboard                               Recover the plugboard setting from the input, given the other settings. (default = 0)
+ *       --ngrams                                         N-gram table (see --build-ngrams), or text file of n-gram counts, for scoring decryptions in --search-plugboard. (default = "")
+ *       --ngram-length                                   Length of the n-grams used from an n-gram table. (default = 4, valid range = [1, 4])
+ *       --build-ngrams                                   Build an n-gram table from this text corpus ("-" for stdin) and write it to the output. (default = "")
+ *       --max-pairs                                      Max. number of plugboard pairs in --search-plugboard. (default = 10, valid range = [0, 13])
+ *       --restarts                                       Number of (randomly started) hill-climbs in --search-plugboard. (default = 16, valid range = [1, 1048576])
+ *       --temperature                                    Initial simulated annealing temperature in --search-plugboard (0 for pure hill-climbing). (default = 0, valid range = [0, 1000])
+ *       -f,--format                                      Output format ("grouped", "raw", or "packed") (default = "grouped")
+ *       --input-format                                   Input format ("raw" or "packed"). Raw (or grouped) input may contain any characters. (default = "raw")
+ *       -e,--engine                                      Enciphering engine ("reference", "table", "simd", or "segment") (default = "reference")
+ *       -v,--verbose                                     Print the number of enciphered letters and dropped characters to stderr (default = 0)
  *       --help,--hilfe                                   Displays this message (default = 0)
  *
  *
@@ -65,9 +99,24 @@
 
 /*--- Include files ---------------------------------------------------------------------*/
 
+#ifndef _POSIX_C_SOURCE
+#  define _POSIX_C_SOURCE 200809L /* for mmap, ftruncate, etc. */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 /* 
  * Note: Hack/workaround for unit testing. The test program includes this source file 
@@ -75,156 +124,386 @@
  *       implementation of hgl_flags.h, meaning we can't include it here.
  */
 #ifndef HGL_TEST_H
+#  define HGL_FLAGS_MAX_N_FLAGS 64
 #  define HGL_FLAGS_PRINT_MARGIN 48
 #  define HGL_FLAGS_IMPLEMENTATION
 #  include "hgl_flags.h"
 #endif
 
-#define HGL_STRING_IMPLEMENTATION
 #include "hgl_string.h"
+#include "enigma.h"
+#include "enigma_cli.h"
+#include "enigma_search.h"
+#include "enigma_plugboard.h"
+#include "enigma_bombe.h"
+#include "enigma_catalog.h"
 
 /*--- Private macros --------------------------------------------------------------------*/
 
-#define ENIGMA_ASSERT(cond, ...)                \
-    if (!(cond)) {                              \
-        fprintf(stderr, "Error: " __VA_ARGS__); \
-        fprintf(stderr, "\n");                  \
-        exit(1);                                \
-    }
-#define ENIGMA_ERROR(...)                       \
-    do {                                        \
-        fprintf(stderr, "Error: " __VA_ARGS__); \
-        fprintf(stderr, "\n");                  \
-        exit(1);                                \
-    } while (0)
+#define OUTPUT_BUFFER_SIZE (256 * 1024) // size of the buffer in which the output is formatted
+#define MAX_ROW_SIZE (64 * (64 + 1) + 1)  // size of a line with 64 groups of 64 letters
 
-#define ENCODE(c) ((c) - 'A') // maps A-Z  --> 0-25
-#define DECODE(n) ((n) + 'A') // maps 0-25 --> A->Z
+#define PARTITION_SIZE (256 * 1024)  // size of the input partitions handed to each thread
+#define PARTITIONS_PER_THREAD 4      // partitions per thread and chunk, for load balancing
+#define BATCH_GROUP_SIZE 1024        // number of batch records handed to `encipher_messages` at once
+#define MAX_LANE_MESSAGE_LENGTH 64   // longest batch message for which `encipher_messages` is faster
+#define INDICATOR_LENGTH 6           // number of letters of a message indicator (see Procedure)
 
-#define SCRATCH_BUF_SIZE (16 * 1024 * 1024)
+#define MAX_REQUEST_SIZE (16 * 1024 * 1024) // connections sending requests this large are closed
+#define MAX_PENDING_OUTPUT (16 * 1024 * 1024) // connections with more unsent output are not read from
+#define MAX_EVENTS 64                         // max. number of epoll events handled at once
 
-/*--- Private type definitions ----------------------------------------------------------*/
+#define CACHE_BUCKETS 1024 // number of hash buckets of a MachineCache (a power of 2)
 
-typedef bool      b8;
-typedef uint8_t   u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-typedef int8_t    i8;
-typedef int16_t  i16;
-typedef int32_t  i32;
-typedef int64_t  i64;
-static_assert(sizeof(b8) == 1, "");
+/*--- Private type definitions ----------------------------------------------------------*/
 
 typedef enum {
-    FORWARD,
-    REVERSE,
-} Direction;
+    FORMAT_GROUPED, /* groups of letters separated by spaces, split into lines */
+    FORMAT_RAW,     /* a contiguous stream of letters */
+    FORMAT_PACKED,  /* letters encoded as 0-25, packed into 5 bits each */
+} Format;
 
-/**
- * Represents a substitution on the set of letters in the enigma alphabet.
- * `image[26]` represents the image of the substitution in alphabetical 
- * order. I.e. using Cauchy's two-line notation:
- *
- *     | ABCDEFGHIJKLMNOPQRSTUVWXYZ |
- *     |         image[26]          |
- *
- * E.g. a ROT13 cipher would look like this:
+/*
+ * Formats letters according to `format` and buffers the result until it is flushed to 
+ * `fd`. Keeps track of where in the output we are (the position in the current group
+ * and line, or the bits not yet written), so that output may be written incrementally. 
+ * See `write_output`.
  *
- *     | ABCDEFGHIJKLMNOPQRSTUVWXYZ |
- *     | NOPQRSTUVWXYZABCDEFGHIJKLM |
+ * Full lines are formatted by copying `row_template` (which has the spaces and the 
+ * newline in place) into the buffer and copying the letters of each group on top of it.
  *
+ * If `mapped` is set, `buffer` is a memory-mapped output file which is large enough to 
+ * hold the entire output, and is never flushed. See `map_output_writer`.
  */
 typedef struct {
-    u8 image[26];
-} Substitution;
+    Format format;
+    size_t group_size;
+    size_t groups_per_line;
+    size_t column; /* number of letters written in the current group */
+    size_t group;  /* number of complete groups written on the current line */
+    u64 n_letters; /* total number of letters written */
+    u32 bits;      /* FORMAT_PACKED: bits not yet written (the lowest `n_bits` bits) */
+    u8 n_bits;
+    char row_template[MAX_ROW_SIZE];
+    size_t row_size;
+    char *buffer;
+    size_t buffer_length;
+    size_t buffer_size;
+    int fd;
+    b8 mapped;
+} OutputWriter;
 
-/* 
- * Represents an Enigma machine rotor including its ring setting and 
- * position (even though, strictly speaking, the rotor position is not
- * an attribute of the actual rotor).
+/*
+ * Keeps track of the bits not yet unpacked when reading packed input. See `unpack_letters`.
  */
 typedef struct {
-    Substitution forward;
-    Substitution reverse;
-    u8 turnover1;
-    u8 turnover2; /* only valid for rotors VI, VII, and VIII */
-    u8 ring_setting;
-    u8 position;
-} Rotor;
+    u32 bits;
+    u8 n_bits;
+} Unpacker;
 
-/* 
- * Represents an Enigma M3 machine.
- *
- * Note: Rotors are indexed from left to right as seen from the perspective of the 
- *       machine operator; i.e. rotor[0] is the leftmost (slow) rotor, and rotor[2] 
- *       is the rightmost (fast) rotor.
+/*
+ * Shared state for `parallel_for`.
  */
 typedef struct {
-    Rotor rotor[3];
-    Substitution reflector;
-    Substitution plugboard;
-} Enigma;
+    void (*fn)(void *ctx, size_t job);
+    void *ctx;
+    size_t n_jobs;
+    atomic_size_t next_job;
+} ParallelFor;
 
-/*--- Private constants -----------------------------------------------------------------*/
+/*
+ * Shared state of the threads enciphering one chunk in `encipher_stream_threaded` (or one
+ * window in `encipher_file`). Each partition of the input is first filtered into a dense
+ * run of letters at the start of its partition of `letters`, and then enciphered in place
+ * starting from the machine state at letter offset `offsets[partition]`.
+ */
+typedef struct {
+    Engine engine;
+    const EnigmaTable *table;
+    Enigma start;
+    Format input_format;
+    size_t input_partition_size;
+    char *input;
+    size_t input_size;
+    char *letters;
+    size_t *lengths;
+    u64 *offsets;
+} ThreadedChunk;
 
-/**
- * These are the 8 different rotor supplied with the Enigma M3. The last three rotors were
- * only used by the german navy (Kriegsmarine) and have, whilst the the first five were used
- * by all branches of the German Forces, including the navy. The navy's rotors (VI, VII, and 
- * VII) are special because they have two turnover notches, meaning for every complete 
- * revolution of such a rotor, the rotor to the left of it will have stepped at least twice (
- * I write "at least" here, because of the peculiar double-stepping quirk of the Enigma).
+/*
+ * The procedure under which a message was sent; i.e. what the letters at its start hold. 
+ * See `read_message_key`.
  */
-static const Rotor ROTOR_I    = {{"EKMFLGDQVZNTOWYHXUSPAIBRCJ"}, {"UWYGADFPVZBECKMTHXSLRINQOJ"}, ENCODE('Q'), 255 /* no second turnover */, 0, 0};
-static const Rotor ROTOR_II   = {{"AJDKSIRUXBLHWTMCQGZNPYFVOE"}, {"AJPCZWRLFBDKOTYUQGENHXMIVS"}, ENCODE('E'), 255 /* no second turnover */, 0, 0};
-static const Rotor ROTOR_III  = {{"BDFHJLCPRTXVZNYEIWGAKMUSQO"}, {"TAGBPCSDQEUFVNZHYIXJWLRKOM"}, ENCODE('V'), 255 /* no second turnover */, 0, 0};
-static const Rotor ROTOR_IV   = {{"ESOVPZJAYQUIRHXLNFTGKDCMWB"}, {"HZWVARTNLGUPXQCEJMBSKDYOIF"}, ENCODE('J'), 255 /* no second turnover */, 0, 0};
-static const Rotor ROTOR_V    = {{"VZBRGITYUPSDNHLXAWMJQOFECK"}, {"QCYLXWENFTZOSMVJUDKGIARPHB"}, ENCODE('Z'), 255 /* no second turnover */, 0, 0};
-static const Rotor ROTOR_VI   = {{"JPGVOUMFYQBENHZRDKASXLICTW"}, {"SKXQLHCNWARVGMEBJPTYFDZUIO"}, ENCODE('Z'), ENCODE('M'), 0, 0};
-static const Rotor ROTOR_VII  = {{"NZJHGRCXMYSWBOUFAIVLPEKQDT"}, {"QMGYVPEDRCWTIANUXFKZOSLHJB"}, ENCODE('Z'), ENCODE('M'), 0, 0};
-static const Rotor ROTOR_VIII = {{"FKQHTLXOCBJSPDZRAMEWNIUYGV"}, {"QJINSAYDVKBFRUHMCPLEWZTGXO"}, ENCODE('Z'), ENCODE('M'), 0, 0};
+typedef enum {
+    PROCEDURE_NONE,              /* just the message */
+    PROCEDURE_DOUBLED_INDICATOR, /* the message key enciphered twice at the indicator setting 
+                                    (Grundstellung) from the key sheet; until 1940 */
+    PROCEDURE_SINGLE_INDICATOR,  /* an indicator setting chosen by the operator, in the clear,
+                                    and the message key enciphered once at it; from 1940 */
+} Procedure;
 
-/**
- * These are three reflectors (Umkehrwalze) used in various versions of the Enigma machine.
- * Typically, for the M3 variant, either UKW-B or UKW-C were used. Later in the war, the
- * germans developed the UKW-D rewireable reflector. I'll probably add this in the future
- * when I'm bored. Info: https://www.cryptomuseum.com/crypto/enigma/ukwd/
+typedef enum {
+    BATCH_CSV,    /* comma-separated fields, one record per line */
+    BATCH_TSV,    /* tab-separated fields, one record per line */
+    BATCH_BINARY, /* fields prefixed by their length as a 32-bit little-endian integer */
+} BatchFormat;
+
+/*
+ * A record of a batch file (see `encipher_batch`): a message and the settings of the
+ * machine to encipher it with. All fields are NUL-terminated strings pointing into the
+ * batch file, and the message is enciphered in place.
  */
-static const Substitution UKW_A = {"EJMZALYXVBWFCRQUONTSPIKHGD"};
-static const Substitution UKW_B = {"YRUHQSLDPXNGOKMIEBFZCWVJAT"};
-static const Substitution UKW_C = {"FVPJIAOYEDRZXWGCTKUQSBNMHL"};
+typedef struct {
+    const char *id;
+    EnigmaSettings settings;
+    char *message;
+    size_t length; /* length of the message; after enciphering, the number of letters */
+} BatchRecord;
 
-/**
- * By default, with no connections made at the plugboard, no substitutions are made.
+/*
+ * A machine configured from a set of settings (all but the indicator setting) and, for 
+ * ENGINE_TABLE, compiled. See `acquire_machine`.
+ */
+typedef struct CachedMachine {
+    u64 hash;
+    Enigma enigma; /* with all rotors at position A; also the key of the machine */
+    EnigmaTable *table;
+    size_t refs;  /* number of users; the machine is not evicted while in use */
+    struct CachedMachine *prev; /* LRU order, most recently used first */
+    struct CachedMachine *next;
+    struct CachedMachine *next_in_bucket;
+} CachedMachine;
+
+/*
+ * A thread-safe cache of configured machines, so that batch records and requests sharing
+ * the same key (e.g. the daily key) are only compiled once. The least recently
+ * used machines are evicted when the memory used by the cache exceeds `max_size` bytes.
+ */
+typedef struct {
+    CachedMachine *buckets[CACHE_BUCKETS];
+    CachedMachine *head;
+    CachedMachine *tail;
+    Engine engine;
+    size_t size;
+    size_t max_size;
+    u64 n_hits;
+    u64 n_misses;
+    pthread_mutex_t lock;
+} MachineCache;
+
+/*
+ * Shared state of the threads enciphering a batch file in `encipher_batch`.
+ */
+typedef struct {
+    EnigmaSettings defaults;
+    MachineCache *cache;
+    BatchRecord *records;
+    BatchRecord **sorted; /* ENGINE_SIMD: the records by descending length */
+    size_t n_records;
+    Procedure procedure;
+} Batch;
+
+/*
+ * A growable buffer of bytes.
+ */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+/*
+ * A client connection to the daemon (see `serve`). Requests are read into `input` until
+ * they are complete, and the responses are queued in `output` until they can be sent.
+ */
+typedef struct {
+    int fd;
+    ByteBuffer input;
+    ByteBuffer output;
+    size_t n_sent_bytes; /* number of bytes of `output` sent so far */
+    b8 hung_up;          /* the client is done sending requests */
+    u32 events;          /* the epoll events the connection is registered for */
+} Connection;
+
+/*
+ * The command-line flags (see `add_options`); pointers to the values hgl_flags parses 
+ * them into.
+ */
+typedef struct {
+    const char **reflector_setting;
+    const char **rotor_setting;
+    const char **ring_setting;
+    const char **plugboard_setting;
+    const char **indicator_setting;
+    u64 *group_size;
+    u64 *groups_per_line;
+    u64 *threads;
+    u64 *offset;
+    const char **input_file;
+    const char **output_file;
+    const char **batch_file;
+    const char **batch_format;
+    const char **procedure;
+    const char **serve_socket;
+    const char **connect_socket;
+    u64 *cache_size;
+    const char **crib_positions;
+    b8 *search_indicator;
+    const char **crib;
+    u64 *crib_offset;
+    b8 *search_ioc;
+    const char **search_reflectors;
+    const char **search_rotors;
+    b8 *search_rings;
+    b8 *bitsliced;
+    u64 *top;
+    b8 *bombe;
+    b8 *build_catalog;
+    const char **catalog_lookup;
+    b8 *search_plugboard;
+    const char **ngrams;
+    u64 *ngram_length;
+    const char **build_ngrams;
+    u64 *max_pairs;
+    u64 *restarts;
+    double *temperature;
+    const char **format;
+    const char **input_format;
+    const char **engine;
+    b8 *verbose;
+    b8 *help;
+} Options;
+
+/*
+ * What every mode of enigma-cli starts from: the machine configured from the flags, the
+ * parsed formats, and the input and output files. The files are closed by 
+ * `enigma_cli_main` once the mode is done.
+ */
+typedef struct {
+    EnigmaSettings settings;
+    Enigma enigma;          /* configured, and advanced by --offset */
+    Engine engine;
+    Format format;
+    Format input_format;
+    BatchFormat batch_format;
+    Procedure procedure;
+    int input_fd;           /* 0 for stdin */
+    int output_fd;          /* 1 for stdout */
+} Session;
+
+/*
+ * The reflectors and rotors to search (see `split_search_names`).
  */
-static const Substitution BARE_PLUGBOARD = {"ABCDEFGHIJKLMNOPQRSTUVWXYZ"};
+typedef struct {
+    char *reflector_list;   /* the split copies of --search-reflectors */
+    char *rotor_list;       /* and --search-rotors */
+    const char *reflectors[MAX_SEARCH_NAMES];
+    const char *rotors[MAX_SEARCH_NAMES];
+    size_t n_reflectors;
+    size_t n_rotors;
+} SearchNames;
 
 /*--- Function prototypes ---------------------------------------------------------------*/
 
 /* Basic interface */
 int enigma_cli_main(int argc, char *argv[]);
-size_t encipher_str(Enigma *enigma, char *output, const char *input);
-u8 encipher_char(Enigma *enigma, char c);
-
-/* Machine setup */
-static void apply_reflector_setting(Enigma *enigma, const char *str);
-static void apply_rotor_setting(Enigma *enigma, const char *str);
-static void apply_ring_setting(Enigma *enigma, const char *str);
-static void apply_plugboard_setting(Enigma *enigma, const char *str);
-static void apply_indicator_setting(Enigma *enigma, const char *str);
-
-/* Machine logic */
-static b8 is_at_turnover(const Rotor *r);
-static void step_rotor(Rotor *r);
-static u8 apply_rotor_subst(const Rotor *r, Direction dir, u8 n);
-static u8 apply_subst(const Substitution *s, u8 n);
+
+/* Modes */
+static void add_options(Options *opts);
+static int batch_main(const Options *opts, Session *session);
+static int crib_positions_main(const Options *opts, Session *session);
+static int search_indicator_main(const Options *opts, Session *session);
+static int search_ioc_main(const Options *opts, Session *session);
+static int bombe_main(const Options *opts, Session *session);
+static int build_catalog_main(const Options *opts, Session *session);
+static int catalog_lookup_main(const Options *opts, Session *session);
+static int build_ngrams_main(const Options *opts, Session *session);
+static int search_plugboard_main(const Options *opts, Session *session);
+static int serve_main(const Options *opts, Session *session);
+static int procedure_main(const Options *opts, Session *session);
+static int encipher_main(const Options *opts, Session *session);
+static char *read_letters(int fd, size_t *length);
+static char *read_crib(const Options *opts, size_t length, size_t *crib_length);
+static void split_search_names(SearchNames *names, const Options *opts);
+static void free_search_names(SearchNames *names);
+static EnigmaTable *compile_table(Engine engine, const Enigma *enigma);
+
+/* Streaming */
+static size_t encipher_stream(Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                              Format input_format, OutputWriter *writer, int input_fd);
+static size_t encipher_stream_threaded(Engine engine, const EnigmaTable *table, const Enigma *enigma, 
+                                       Format input_format, OutputWriter *writer, int input_fd, size_t n_threads);
+static size_t encipher_file(Engine engine, const EnigmaTable *table, const Enigma *enigma, Format input_format,
+                            OutputWriter *writer, int input_fd, b8 map_output, size_t n_threads);
+static size_t encipher_batch(MachineCache *cache, const EnigmaSettings *defaults, BatchFormat batch_format,
+                             Procedure procedure, int batch_fd, OutputWriter *writer, size_t n_threads);
+static BatchRecord *parse_batch_text(char *data, size_t size, char delimiter, size_t *n_records);
+static BatchRecord *parse_batch_binary(char *data, size_t size, size_t *n_records);
+static size_t parse_fields(char *data, size_t size, int n_fields, char *fields[], size_t lengths[]);
+static void encipher_record(void *ctx, size_t job);
+static void encipher_record_group(void *ctx, size_t job);
+static b8 encipher_batch_record(MachineCache *cache, const EnigmaSettings *defaults, Procedure procedure,
+                                BatchRecord *record);
+static b8 prepare_batch_record(MachineCache *cache, const EnigmaSettings *defaults, Procedure procedure,
+                               BatchRecord *record, Enigma *enigma);
+static void read_record_key(Procedure procedure, Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                            BatchRecord *record);
+static b8 read_message_key(Procedure procedure, Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                           const char *letters, char indicator[INDICATOR_LENGTH + 1]);
+static EnigmaSettings record_settings(const EnigmaSettings *defaults, const BatchRecord *record);
+static int compare_record_lengths(const void *a, const void *b);
+static void filter_partition(void *ctx, size_t job);
+static void encipher_partition(void *ctx, size_t job);
+static void encipher_letters_threaded(Engine engine, const EnigmaTable *table, const Enigma *enigma, 
+                                      char *letters, size_t length, size_t n_threads);
+static size_t unpack_letters(Unpacker *unpacker, char *letters, const u8 *input, size_t length);
+
+/* Daemon */
+static int open_server_socket(const char *path);
+static void serve(int listen_fd, MachineCache *cache, const EnigmaSettings *defaults);
+static void accept_connections(int epoll_fd, int listen_fd, int *reserve_fd);
+static b8 serve_connection(int epoll_fd, Connection *conn, MachineCache *cache, const EnigmaSettings *defaults);
+static void close_connection(Connection *conn);
+static size_t encipher_remote(const char *path, const EnigmaSettings *settings, const Enigma *enigma,
+                              Format input_format, int input_fd, OutputWriter *writer);
+static void append_bytes(ByteBuffer *buffer, const void *bytes, size_t length);
+static void append_field(ByteBuffer *buffer, const char *field, size_t length);
+static void set_nonblocking(int fd);
+static b8 is_regular_file(int fd);
+static b8 is_mappable_output(int fd);
+
+/* Machine cache */
+static void init_machine_cache(MachineCache *cache, Engine engine, size_t max_size);
+static void free_machine_cache(MachineCache *cache);
+static CachedMachine *acquire_machine(MachineCache *cache, const EnigmaSettings *settings);
+static void release_machine(MachineCache *cache, CachedMachine *machine);
+static void evict_machines(MachineCache *cache);
+static u64 hash_bytes(const char *bytes, size_t length);
+
+/* Cryptanalysis */
+static size_t split_words(char *str, const char *words[], size_t max_words);
+static void check_search_names(const char **reflectors, size_t n_reflectors, const char **rotors, size_t n_rotors);
+static void format_plugboard(char *setting, const u8 plugboard[26]);
+
+/* Output */
+static void init_output_writer(OutputWriter *writer, Format format, size_t group_size, size_t groups_per_line, int fd);
+static void map_output_writer(OutputWriter *writer, char *buffer, size_t size);
+static void free_output_writer(OutputWriter *writer);
+static size_t output_size(const OutputWriter *writer, u64 n_letters);
+static void write_output(OutputWriter *writer, const char *str, size_t length);
+static void write_grouped(OutputWriter *writer, const char *str, size_t length);
+static void write_raw(OutputWriter *writer, const char *str, size_t length);
+static void write_packed(OutputWriter *writer, const char *str, size_t length);
+static void finish_output(OutputWriter *writer);
+static void flush_output(OutputWriter *writer);
 
 /* Helpers */
-static size_t lex_numeric(HglStringView sv);
-static size_t lex_letter(HglStringView sv);
-static char to_upper(char c);
-static char in_alphabet(char c);
+static void *parallel_for_worker(void *arg);
+static char *read_all(int fd, size_t *size);
+static Engine parse_engine(const char *str);
+static Format parse_format(const char *str);
+static BatchFormat parse_batch_format(const char *str);
+static Procedure parse_procedure(const char *str);
 
 /*--- Enigma functions ------------------------------------------------------------------*/
 
@@ -233,17 +512,8 @@ static char in_alphabet(char c);
  */
 int enigma_cli_main(int argc, char *argv[])
 {
-    /* Enigma machine simulation settings */
-    const char **opt_reflector_setting = hgl_flags_add_str("-u,--reflector,--umkehrwalze", "Reflector (Ger: Umkehrwalze)", "UKW-B", 0);
-    const char **opt_rotor_setting     = hgl_flags_add_str("-w,--rotors,--walzenlage", "Rotor order (Ger: Walzenlage)", "I II III", 0);
-    const char **opt_ring_setting      = hgl_flags_add_str("-r,--ring-setting,--ringstellung", "Ring setting (Ger: Ringstellung)", "1 1 1", 0);
-    const char **opt_plugboard_setting = hgl_flags_add_str("-s,--plugboard-setting,--steckerverbindungen", "Plugboard transpositions (Ger: Steckerverbindungen)", "", 0);
-    const char **opt_indicator_setting = hgl_flags_add_str("-g,--indicator-setting,--grundstellung", "Indicator setting (Ger: Grundstellung)", "1 1 1", 0);
-
-    /* Enigma-cli general settings */
-    u64 *opt_group_size      = hgl_flags_add_u64_range("-G,--group-size", "Number of characters per group in the output.", 5, 0, 1, 64);
-    u64 *opt_groups_per_line = hgl_flags_add_u64_range("-N,--groups-per-line", "Number of groups per line in the output.", 6, 0, 1, 64);
-    b8  *opt_help            = hgl_flags_add_bool("--help,--hilfe", "Displays this message", false, 0);
+    Options opts;
+    add_options(&opts);
 
     /* Parse arguments */
     int err = hgl_flags_parse(argc, argv);
@@ -252,330 +522,2249 @@ int enigma_cli_main(int argc, char *argv[])
         hgl_flags_print();
         return 1;
     }
-    if (*opt_help) {
+    if (*opts.help) {
         printf("Usage: %s [Options]\n", argv[0]);
         hgl_flags_print();
         return 0;
     }
-    
+
     /* Configure enigma */
-    Enigma enigma = {0};
-    apply_reflector_setting(&enigma, *opt_reflector_setting);
-    apply_rotor_setting(&enigma, *opt_rotor_setting);
-    apply_ring_setting(&enigma, *opt_ring_setting);
-    apply_plugboard_setting(&enigma, *opt_plugboard_setting);
-    apply_indicator_setting(&enigma, *opt_indicator_setting);
-
-    /* encipher/decipher from stdin */
-    static u8 input[SCRATCH_BUF_SIZE] = {0};
-    static u8 output[SCRATCH_BUF_SIZE] = {0};
-    size_t n_read_bytes = read(0, input, SCRATCH_BUF_SIZE);
-    if (n_read_bytes <= 0) {
-        return 1;
+    Session session = {
+        .settings = {
+            .reflector = *opts.reflector_setting,
+            .rotors    = *opts.rotor_setting,
+            .ring      = *opts.ring_setting,
+            .plugboard = *opts.plugboard_setting,
+            .indicator = *opts.indicator_setting,
+        },
+    };
+    ENIGMA_ASSERT(configure_enigma(&session.enigma, &session.settings) == ENIGMA_OK, "%s", enigma_error_message());
+    advance_enigma(&session.enigma, *opts.offset);
+    session.engine = parse_engine(*opts.engine);
+    session.format = parse_format(*opts.format);
+    session.input_format = parse_format(*opts.input_format);
+    session.batch_format = parse_batch_format(*opts.batch_format);
+    session.procedure = parse_procedure(*opts.procedure);
+
+    /* Open the input and output files, if any */
+    session.input_fd = 0;
+    session.output_fd = 1;
+    if (**opts.input_file != '\0') {
+        session.input_fd = open(*opts.input_file, O_RDONLY);
+        ENIGMA_ASSERT(session.input_fd >= 0, "Failed to open input file \"%s\".", *opts.input_file);
+    }
+    if (**opts.output_file != '\0') {
+        session.output_fd = open(*opts.output_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        ENIGMA_ASSERT(session.output_fd >= 0, "Failed to open output file \"%s\".", *opts.output_file);
     }
-    size_t output_size = encipher_str(&enigma, (char *) output, (char *) input);
 
-    /* Pretty-print result */
-    size_t group_size = *opt_group_size;
-    size_t groups_per_row = *opt_groups_per_line;
-    size_t row_size = group_size * groups_per_row;
-    size_t rows = output_size / (group_size * groups_per_row) + 1;
-    for (size_t row = 0; row < rows; row++) {
-        for (size_t group = 0; group < groups_per_row; group++) {
-            size_t idx = row * row_size + group * group_size;
-            if (idx > output_size) break;
-            printf("%.*s ", (int) group_size, &output[idx]);
-        }
-        printf("\n");
+    /* Run the mode asked for */
+    int exit_code;
+    if (**opts.batch_file != '\0') {
+        exit_code = batch_main(&opts, &session);
+    } else if (**opts.crib_positions != '\0') {
+        exit_code = crib_positions_main(&opts, &session);
+    } else if (*opts.search_indicator) {
+        exit_code = search_indicator_main(&opts, &session);
+    } else if (*opts.search_ioc) {
+        exit_code = search_ioc_main(&opts, &session);
+    } else if (*opts.bombe) {
+        exit_code = bombe_main(&opts, &session);
+    } else if (*opts.build_catalog) {
+        exit_code = build_catalog_main(&opts, &session);
+    } else if (**opts.catalog_lookup != '\0') {
+        exit_code = catalog_lookup_main(&opts, &session);
+    } else if (**opts.build_ngrams != '\0') {
+        exit_code = build_ngrams_main(&opts, &session);
+    } else if (*opts.search_plugboard) {
+        exit_code = search_plugboard_main(&opts, &session);
+    } else if (**opts.serve_socket != '\0') {
+        exit_code = serve_main(&opts, &session);
+    } else if (session.procedure != PROCEDURE_NONE) {
+        exit_code = procedure_main(&opts, &session);
+    } else {
+        exit_code = encipher_main(&opts, &session);
     }
 
+    if (session.input_fd != 0) {
+        close(session.input_fd);
+    }
+    if (session.output_fd != 1) {
+        close(session.output_fd);
+    }
+    return exit_code;
+}
+
+/**
+ * Registers the command-line flags with hgl_flags, and places pointers to their values
+ * into `opts`.
+ */
+static void add_options(Options *opts)
+{
+    /* Enigma machine simulation settings */
+    opts->reflector_setting = hgl_flags_add_str("-u,--reflector,--umkehrwalze", "Reflector (Ger: Umkehrwalze)", "UKW-B", 0);
+    opts->rotor_setting     = hgl_flags_add_str("-w,--rotors,--walzenlage", "Rotor order (Ger: Walzenlage)", "I II III", 0);
+    opts->ring_setting      = hgl_flags_add_str("-r,--ring-setting,--ringstellung", "Ring setting (Ger: Ringstellung)", "1 1 1", 0);
+    opts->plugboard_setting = hgl_flags_add_str("-s,--plugboard-setting,--steckerverbindungen", "Plugboard transpositions (Ger: Steckerverbindungen)", "", 0);
+    opts->indicator_setting = hgl_flags_add_str("-g,--indicator-setting,--grundstellung", "Indicator setting (Ger: Grundstellung)", "1 1 1", 0);
+
+    /* Enigma-cli general settings */
+    opts->group_size      = hgl_flags_add_u64_range("-G,--group-size", "Number of characters per group in the output.", 5, 0, 1, 64);
+    opts->groups_per_line = hgl_flags_add_u64_range("-N,--groups-per-line", "Number of groups per line in the output.", 6, 0, 1, 64);
+    opts->threads         = hgl_flags_add_u64_range("-t,--threads", "Number of threads to encipher with.", 1, 0, 1, 256);
+    opts->offset          = hgl_flags_add_u64("--offset", "Number of letters to skip ahead before enciphering (i.e. start mid-stream).", 0, 0);
+    opts->input_file      = hgl_flags_add_str("-i,--input", "Memory-map and encipher this file instead of reading from stdin.", "", 0);
+    opts->output_file     = hgl_flags_add_str("-o,--output", "Write the output to this file instead of stdout. Memory-mapped if -i is given.", "", 0);
+    opts->batch_file      = hgl_flags_add_str("--batch", "Encipher every record of this batch file (\"-\" for stdin) with its own settings. The results hold raw letters (-f, -G, and -N don't apply).", "", 0);
+    opts->batch_format    = hgl_flags_add_str("--batch-format", "Batch file format (\"csv\", \"tsv\", or \"binary\")", "csv", 0);
+    opts->procedure       = hgl_flags_add_str("--procedure", "Indicator procedure of the input or batch messages (\"none\", \"doubled-indicator\", or \"single-indicator\")", "none", 0);
+    opts->serve_socket    = hgl_flags_add_str("--serve", "Run as a daemon serving requests on this Unix domain socket.", "", 0);
+    opts->connect_socket  = hgl_flags_add_str("--connect", "Have the daemon listening on this Unix domain socket encipher the input.", "", 0);
+    opts->cache_size      = hgl_flags_add_u64_range("--cache-size", "Memory (in MiB) for caching configured machines in --batch and --serve mode.", 64, 0, 0, 1024 * 1024);
+    opts->crib_positions  = hgl_flags_add_str("--crib-positions", "List the offsets into the input at which these (comma-separated) cribs may be placed; where no crib letter meets the same ciphertext letter.", "", 0);
+    opts->search_indicator = hgl_flags_add_bool("--search-indicator", "Find the indicator settings under which the input deciphers to the crib.", false, 0);
+    opts->crib            = hgl_flags_add_str("--crib", "Known plaintext for --search-indicator and --bombe.", "", 0);
+    opts->crib_offset     = hgl_flags_add_u64("--crib-offset", "Number of letters into the message at which the crib starts.", 0, 0);
+    opts->search_ioc      = hgl_flags_add_bool("--search-ioc", "Find the reflectors, rotor orders, and indicator settings whose decryptions of the input have the highest index of coincidence.", false, 0);
+    opts->search_reflectors = hgl_flags_add_str("--search-reflectors", "Reflectors to try in --search-ioc and --bombe, and to catalog in --build-catalog.", "UKW-A UKW-B UKW-C", 0);
+    opts->search_rotors   = hgl_flags_add_str("--search-rotors", "Rotors to try in --search-ioc and --bombe, and to catalog in --build-catalog.", "I II III IV V VI VII VIII", 0);
+    opts->search_rings    = hgl_flags_add_bool("--search-rings", "Also try all middle and right ring settings in --search-ioc (26 times slower; see README).", false, 0);
+    opts->bitsliced       = hgl_flags_add_bool("--bitsliced", "Score the keys in --search-ioc with the bitsliced scorer rather than compiled tables (slower in the builds measured; see README).", false, 0);
+    opts->top             = hgl_flags_add_u64_range("--top", "Number of candidates reported by --search-ioc.", 10, 0, 1, 1000);
+    opts->bombe           = hgl_flags_add_bool("--bombe", "Find the rotor orders, indicator settings, and plugboard pairs consistent with the crib, like a Turing-Welchman bombe (with the given ring setting).", false, 0);
+    opts->build_catalog   = hgl_flags_add_bool("--build-catalog", "Build a catalog of the cycle structures of doubled indicators (see --catalog-lookup) for all indicator settings of the --search-reflectors and --search-rotors, and write it to the output.", false, 0);
+    opts->catalog_lookup  = hgl_flags_add_str("--catalog-lookup", "Find the reflectors, rotor orders, and indicator settings under which the doubled indicators (6 letters each) in the input have the cycle structure they have, in this catalog (see --build-catalog).", "", 0);
+    opts->search_plugboard = hgl_flags_add_bool("--search-plugboard", "Recover the plugboard setting from the input, given the other settings.", false, 0);
+    opts->ngrams          = hgl_flags_add_str("--ngrams", "N-gram table (see --build-ngrams), or text file of n-gram counts, for scoring decryptions in --search-plugboard.", "", 0);
+    opts->ngram_length    = hgl_flags_add_u64_range("--ngram-length", "Length of the n-grams used from an n-gram table.", 4, 0, 1, MAX_NGRAM_LENGTH);
+    opts->build_ngrams    = hgl_flags_add_str("--build-ngrams", "Build an n-gram table from this text corpus (\"-\" for stdin) and write it to the output.", "", 0);
+    opts->max_pairs       = hgl_flags_add_u64_range("--max-pairs", "Max. number of plugboard pairs in --search-plugboard.", 10, 0, 0, 13);
+    opts->restarts        = hgl_flags_add_u64_range("--restarts", "Number of (randomly started) hill-climbs in --search-plugboard.", 16, 0, 1, 1 << 20);
+    opts->temperature     = hgl_flags_add_f64_range("--temperature", "Initial simulated annealing temperature in --search-plugboard (0 for pure hill-climbing).", 0, 0, 0, 1000);
+    opts->format          = hgl_flags_add_str("-f,--format", "Output format (\"grouped\", \"raw\", or \"packed\")", "grouped", 0);
+    opts->input_format    = hgl_flags_add_str("--input-format", "Input format (\"raw\" or \"packed\"). Raw (or grouped) input may contain any characters.", "raw", 0);
+    opts->engine          = hgl_flags_add_str("-e,--engine", "Enciphering engine (\"reference\", \"table\", \"simd\", or \"segment\")", "reference", 0);
+    opts->verbose         = hgl_flags_add_bool("-v,--verbose", "Print the number of enciphered letters and dropped characters to stderr", false, 0);
+    opts->help            = hgl_flags_add_bool("--help,--hilfe", "Displays this message", false, 0);
+}
+
+/**
+ * --batch: enciphers (or deciphers) every record of the batch file with its own settings.
+ */
+static int batch_main(const Options *opts, Session *session)
+{
+    ENIGMA_ASSERT(!hgl_flags_occurred_in_args(opts->format) && !hgl_flags_occurred_in_args(opts->group_size) &&
+                  !hgl_flags_occurred_in_args(opts->groups_per_line) && !hgl_flags_occurred_in_args(opts->input_format),
+                  "-f, -G, -N, and --input-format can't be used with --batch, whose results hold raw letters.");
+    int batch_fd = 0;
+    if (!hgl_sv_equals(hgl_sv_from_cstr(*opts->batch_file), HGL_SV("-"))) {
+        batch_fd = open(*opts->batch_file, O_RDONLY);
+        ENIGMA_ASSERT(batch_fd >= 0, "Failed to open batch file \"%s\".", *opts->batch_file);
+    }
+    OutputWriter writer;
+    init_output_writer(&writer, FORMAT_RAW, 1, 1, session->output_fd);
+    MachineCache cache;
+    init_machine_cache(&cache, session->engine, *opts->cache_size * 1024 * 1024);
+    size_t n_records = encipher_batch(&cache, &session->settings, session->batch_format, session->procedure,
+                                      batch_fd, &writer, *opts->threads);
+    flush_output(&writer);
+    if (*opts->verbose) {
+        fprintf(stderr, "Enciphered %" PRIu64 " letters in %zu records (%" PRIu64 " machines configured).\n",
+                writer.n_letters, n_records, cache.n_misses);
+    }
+    free_machine_cache(&cache);
+    free_output_writer(&writer);
+    if (batch_fd != 0) {
+        close(batch_fd);
+    }
     return 0;
 }
 
 /**
- * Enciphers (or deciphers) the string at `input`, places the result into `output`, and
- * returns the length of the enciphered (or deciphered) output. 
+ * --crib-positions: lists the offsets at which the cribs may be placed. Fails if there
+ * are none.
  */
-size_t encipher_str(Enigma *enigma, char *output, const char *input)
+static int crib_positions_main(const Options *opts, Session *session)
 {
-    char *wr = output;
+    size_t length;
+    char *ciphertext = read_letters(session->input_fd, &length);
 
-    char c;
-    do {
-        c = *input++;
-        c = to_upper(c);
+    char *crib_list = strdup(*opts->crib_positions);
+    ENIGMA_ASSERT(crib_list != NULL, "Failed to allocate the cribs.");
+    const char *cribs[MAX_CRIBS];
+    size_t crib_lengths[MAX_CRIBS];
+    size_t n_cribs = 0;
+    size_t max_crib_length = 0;
+    char *save = NULL;
+    for (char *crib = strtok_r(crib_list, ",", &save); crib != NULL; crib = strtok_r(NULL, ",", &save)) {
+        ENIGMA_ASSERT(n_cribs < MAX_CRIBS, "Too many cribs (max. %d).", MAX_CRIBS);
+        size_t crib_length = filter_letters(crib, crib, strlen(crib));
+        ENIGMA_ASSERT(crib_length > 0 && crib_length < MAX_ROW_SIZE, "Invalid crib \"%s\".", crib);
+        max_crib_length = (crib_length > max_crib_length) ? crib_length : max_crib_length;
+        cribs[n_cribs] = crib;
+        crib_lengths[n_cribs++] = crib_length;
+    }
+    ENIGMA_ASSERT(n_cribs > 0, "No cribs given.");
+
+    /*
+     * Place the cribs CHUNK_SIZE offsets at a time, and print each fit as "offset crib".
+     * Each window extends far enough past its offsets for every crib to fit.
+     */
+    u64 *feasible = malloc((CHUNK_SIZE + max_crib_length) * sizeof(u64));
+    char *buffer = malloc(OUTPUT_BUFFER_SIZE);
+    ENIGMA_ASSERT(feasible != NULL && buffer != NULL, "Failed to allocate the crib positions.");
+    size_t buffered = 0;
+    size_t n_feasible[MAX_CRIBS] = {0};
+    for (size_t start = 0; start < length; start += CHUNK_SIZE) {
+        size_t n_offsets = (length - start < CHUNK_SIZE) ? length - start : CHUNK_SIZE;
+        size_t window = (length - start < CHUNK_SIZE + max_crib_length) ? length - start : CHUNK_SIZE + max_crib_length;
+        place_cribs(&ciphertext[start], window, cribs, crib_lengths, n_cribs, feasible);
+        for (size_t i = 0; i < n_offsets; i++) {
+            for (u64 fits = feasible[i]; fits != 0; fits &= fits - 1) {
+                int c = __builtin_ctzll(fits);
+                if (buffered + MAX_ROW_SIZE + 32 > OUTPUT_BUFFER_SIZE) {
+                    write_fully(session->output_fd, buffer, buffered);
+                    buffered = 0;
+                }
+                buffered += sprintf(&buffer[buffered], "%zu %.*s\n", start + i, (int) crib_lengths[c], cribs[c]);
+                n_feasible[c]++;
+            }
+        }
+    }
+    write_fully(session->output_fd, buffer, buffered);
+
+    size_t n_total = 0;
+    for (size_t c = 0; c < n_cribs; c++) {
+        n_total += n_feasible[c];
+        if (*opts->verbose) {
+            fprintf(stderr, "%.*s: %zu feasible offsets.\n", (int) crib_lengths[c], cribs[c], n_feasible[c]);
+        }
+    }
+    free(buffer);
+    free(feasible);
+    free(crib_list);
+    free(ciphertext);
+    return (n_total > 0) ? 0 : 1;
+}
+
+/**
+ * --search-indicator: prints the indicator settings (message keys) under which the input
+ * deciphers to the crib, along with the deciphered message. Fails if there are none.
+ */
+static int search_indicator_main(const Options *opts, Session *session)
+{
+    size_t length;
+    char *ciphertext = read_letters(session->input_fd, &length);
+    size_t crib_length;
+    char *crib = read_crib(opts, length, &crib_length);
+
+    b8 *matches = calloc(N_POSITIONS, sizeof(b8));
+    ENIGMA_ASSERT(matches != NULL, "Failed to allocate the search results.");
+    size_t n_matches = search_indicator(&session->enigma, ciphertext + *opts->crib_offset, crib, crib_length,
+                                        *opts->crib_offset, matches, *opts->threads);
 
-        /* Skip unrecognized letters */
-        if (!in_alphabet(c)) {
+    /* print each matching indicator setting along with the deciphered message */
+    char *plaintext = malloc(length + 1);
+    ENIGMA_ASSERT(plaintext != NULL, "Failed to allocate the plaintext.");
+    for (size_t pos = 0; pos < N_POSITIONS; pos++) {
+        if (!matches[pos]) {
             continue;
         }
+        Enigma e = session->enigma;
+        e.rotor[0].position = pos / (26 * 26);
+        e.rotor[1].position = (pos / 26) % 26;
+        e.rotor[2].position = pos % 26;
+        dprintf(session->output_fd, "%c%c%c ", DECODE(e.rotor[0].position), DECODE(e.rotor[1].position),
+                DECODE(e.rotor[2].position));
+        encipher_letters(ENGINE_REFERENCE, NULL, &e, plaintext, ciphertext, length);
+        dprintf(session->output_fd, "%.*s\n", (int) length, plaintext);
+    }
+    if (*opts->verbose) {
+        fprintf(stderr, "Tried %d indicator settings, %zu matched the crib.\n", N_POSITIONS, n_matches);
+    }
+    free(plaintext);
+    free(matches);
+    free(crib);
+    free(ciphertext);
+    return (n_matches > 0) ? 0 : 1;
+}
+
+/**
+ * --search-ioc: prints the keys under which the input deciphers to something
+ * language-like, best first.
+ */
+static int search_ioc_main(const Options *opts, Session *session)
+{
+    size_t length;
+    char *ciphertext = read_letters(session->input_fd, &length);
+    ENIGMA_ASSERT(length >= 2, "The ciphertext must be at least 2 letters long.");
+    SearchNames names;
+    split_search_names(&names, opts);
+
+    Candidate *results = malloc(*opts->top * sizeof(Candidate));
+    ENIGMA_ASSERT(results != NULL, "Failed to allocate the search results.");
+    size_t n_results = search_ioc(&session->enigma, ciphertext, length, names.reflectors, names.n_reflectors,
+                                  names.rotors, names.n_rotors, *opts->search_rings, *opts->bitsliced, *opts->top,
+                                  results, *opts->threads);
+
+    /* print the candidates as enigma-cli options, along with their index of coincidence */
+    for (size_t i = 0; i < n_results; i++) {
+        const Candidate *c = &results[i];
+        double ioc = (double) c->score / ((double) length * (double) (length - 1));
+        dprintf(session->output_fd, "%.4f -u %s -w \"%s %s %s\" -r \"%d %d %d\" -g \"%c%c%c\"\n", ioc,
+                names.reflectors[c->reflector], names.rotors[c->rotors[0]], names.rotors[c->rotors[1]],
+                names.rotors[c->rotors[2]], c->rings[0] + 1, c->rings[1] + 1, c->rings[2] + 1,
+                DECODE(c->position / (26 * 26)), DECODE((c->position / 26) % 26), DECODE(c->position % 26));
+
+        /* and, with --search-rings, the rest of its equivalence class */
+        for (int k = 1; k < 26; k++) {
+            if ((c->equivalents >> k) & 1) {
+                dprintf(session->output_fd, "       = -r \"%d %d %d\" -g \"%c%c%c\"\n", c->rings[0] + 1,
+                        (c->rings[1] + k) % 26 + 1, c->rings[2] + 1, DECODE(c->position / (26 * 26)),
+                        DECODE(((c->position / 26) + k) % 26), DECODE(c->position % 26));
+            }
+        }
+    }
+    free(results);
+    free_search_names(&names);
+    free(ciphertext);
+    return 0;
+}
+
+/**
+ * --bombe: runs a bombe on the crib, and prints the stops. Fails if there are none.
+ */
+static int bombe_main(const Options *opts, Session *session)
+{
+    size_t length;
+    char *ciphertext = read_letters(session->input_fd, &length);
+    size_t crib_length;
+    char *crib = read_crib(opts, length, &crib_length);
+    SearchNames names;
+    split_search_names(&names, opts);
 
-        /* encipher (or decipher ... transcipher? cipher?) character */
-        *wr++ = encipher_char(enigma, c);
-    } while (c != '\0');
+    Menu menu;
+    build_menu(&menu, ciphertext + *opts->crib_offset, crib, crib_length);
+    if (*opts->verbose) {
+        fprintf(stderr, "Menu: %zu letters, %zu links, %zu loops, test register %c.\n", menu.n_letters,
+                menu.n_links, menu.n_loops, DECODE(menu.test_register));
+    }
+    size_t n_stops;
+    BombeStop *stops = run_bombe(&session->enigma, &menu, *opts->crib_offset, names.reflectors, names.n_reflectors,
+                                 names.rotors, names.n_rotors, &n_stops, *opts->threads);
 
-    return wr - output;
+    /* print the stops as enigma-cli options */
+    const Enigma *enigma = &session->enigma;
+    for (size_t i = 0; i < n_stops; i++) {
+        const BombeStop *stop = &stops[i];
+        char plugboard_setting[3 * 13 + 1];
+        format_plugboard(plugboard_setting, stop->plugboard);
+        dprintf(session->output_fd, "-u %s -w \"%s %s %s\" -r \"%d %d %d\" -s \"%s\" -g \"%c%c%c\"\n",
+                names.reflectors[stop->reflector], names.rotors[stop->rotors[0]], names.rotors[stop->rotors[1]],
+                names.rotors[stop->rotors[2]], enigma->rotor[0].ring_setting + 1, enigma->rotor[1].ring_setting + 1,
+                enigma->rotor[2].ring_setting + 1, plugboard_setting, DECODE(stop->position / (26 * 26)),
+                DECODE((stop->position / 26) % 26), DECODE(stop->position % 26));
+    }
+    if (*opts->verbose) {
+        fprintf(stderr, "%zu stops.\n", n_stops);
+    }
+    free(stops);
+    free_menu(&menu);
+    free_search_names(&names);
+    free(crib);
+    free(ciphertext);
+    return (n_stops > 0) ? 0 : 1;
 }
 
+/**
+ * --build-catalog: builds a cycle catalog and writes it to the output.
+ */
+static int build_catalog_main(const Options *opts, Session *session)
+{
+    SearchNames names;
+    split_search_names(&names, opts);
+    build_catalog(session->output_fd, names.reflectors, names.n_reflectors, names.rotors, names.n_rotors,
+                  *opts->threads);
+    free_search_names(&names);
+    return 0;
+}
 
 /**
- * Enciphers (or deciphers) a single character (or letter) `c` given the current machine
- * settings and updates the rotor positions accordingly. 
- *
- * NB:`c` must be in the enigma alphabet and upper-case. 
+ * --catalog-lookup: looks up the characteristic of a day's doubled indicators in a cycle
+ * catalog, and prints the candidates. Fails if there are none.
  */
-u8 encipher_char(Enigma *enigma, char c)
+static int catalog_lookup_main(const Options *opts, Session *session)
 {
-    /* 1. advance rotors */
-    if (is_at_turnover(&enigma->rotor[1])) { 
-        step_rotor(&enigma->rotor[0]);
-        step_rotor(&enigma->rotor[1]);
-    } else if (is_at_turnover(&enigma->rotor[2])) {
-        step_rotor(&enigma->rotor[1]);
+    size_t length;
+    char *indicators = read_letters(session->input_fd, &length);
+    ENIGMA_ASSERT(length > 0 && length % 6 == 0, "The input must consist of doubled indicators, 6 letters each.");
+    u8 products[3][26];
+    ENIGMA_ASSERT(observe_products(indicators, length / 6, products), "The doubled indicators contradict each other.");
+    static const char *product_names[3] = {"AD", "BE", "CF"};
+    for (int k = 0; k < 3; k++) {
+        size_t n_known = 0;
+        for (u8 n = 0; n < 26; n++) {
+            n_known += products[k][n] < 26;
+        }
+        ENIGMA_ASSERT(n_known == 26, "Too few indicators; %s is known for %zu of 26 letters.", product_names[k], n_known);
+        ENIGMA_ASSERT(rank_cycle_structure(products[k]) < N_CYCLE_STRUCTURES,
+                      "The doubled indicators are inconsistent; %s is not a product of two reflections.", product_names[k]);
     }
-    step_rotor(&enigma->rotor[2]);
+    u32 characteristic = rank_characteristic(products);
 
-    /* 2. encipher character */
-    u8 n = ENCODE(c); 
-    n = apply_subst(&enigma->plugboard, n);
-    n = apply_rotor_subst(&enigma->rotor[2], FORWARD, n);
-    n = apply_rotor_subst(&enigma->rotor[1], FORWARD, n);
-    n = apply_rotor_subst(&enigma->rotor[0], FORWARD, n);
-    n = apply_subst(&enigma->reflector, n);
-    n = apply_rotor_subst(&enigma->rotor[0], REVERSE, n);
-    n = apply_rotor_subst(&enigma->rotor[1], REVERSE, n);
-    n = apply_rotor_subst(&enigma->rotor[2], REVERSE, n);
-    n = apply_subst(&enigma->plugboard, n);
-    return DECODE(n);
+    /* print the candidates as enigma-cli options */
+    Catalog catalog;
+    load_catalog(&catalog, *opts->catalog_lookup);
+    u32 begin = catalog.offsets[characteristic];
+    u32 end = catalog.offsets[characteristic + 1];
+    for (u32 i = begin; i < end; i++) {
+        const CatalogSetting *setting = &catalog.settings[catalog.entries[i] / N_POSITIONS];
+        u32 position = catalog.entries[i] % N_POSITIONS;
+        dprintf(session->output_fd, "-u %s -w \"%s\" -r \"1 1 1\" -g \"%c%c%c\"\n", setting->reflector, setting->rotors,
+                DECODE(position / (26 * 26)), DECODE((position / 26) % 26), DECODE(position % 26));
+    }
+    if (*opts->verbose) {
+        for (int k = 0; k < 3; k++) {
+            u8 counts[26 + 1];
+            count_cycles(products[k], counts);
+            fprintf(stderr, "%s:", product_names[k]);
+            for (u8 n = 26; n > 0; n--) {
+                for (u8 i = 0; i < counts[n]; i++) {
+                    fprintf(stderr, " %d", n);
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+        fprintf(stderr, "%u candidates.\n", end - begin);
+    }
+    free_catalog(&catalog);
+    free(indicators);
+    return (end > begin) ? 0 : 1;
 }
 
 /**
- * Mounts the given reflector ("Umkehrwalze") to the machine.
+ * --build-ngrams: builds an n-gram table from the corpus and writes it to the output.
  */
-static void apply_reflector_setting(Enigma *enigma, const char *str)
+static int build_ngrams_main(const Options *opts, Session *session)
 {
-    HglStringView sv = hgl_sv_from_cstr(str);
-    if (hgl_sv_equals(sv, HGL_SV("UKW-A"))) {
-        enigma->reflector = UKW_A;
-    } else if (hgl_sv_equals(sv, HGL_SV("UKW-B"))) {
-        enigma->reflector = UKW_B;
-    } else if (hgl_sv_equals(sv, HGL_SV("UKW-C"))) {
-        enigma->reflector = UKW_C;
-    } else {
-        ENIGMA_ASSERT(false, "Unknown reflector \"" HGL_SV_FMT "\".", HGL_SV_ARG(sv));
+    int corpus_fd = 0;
+    if (!hgl_sv_equals(hgl_sv_from_cstr(*opts->build_ngrams), HGL_SV("-"))) {
+        corpus_fd = open(*opts->build_ngrams, O_RDONLY);
+        ENIGMA_ASSERT(corpus_fd >= 0, "Failed to open corpus \"%s\".", *opts->build_ngrams);
+    }
+    build_ngram_file(corpus_fd, session->output_fd);
+    if (corpus_fd != 0) {
+        close(corpus_fd);
     }
+    return 0;
 }
 
 /**
- * Mounts the given rotors (e.g. "I VI II", from left to right, as seen from the 
- * machine operator) in the machine ("Walzenlage"). 
- *
- * NB: This will reset any earlier applied ring- and indicator settings.
- *
+ * --search-plugboard: recovers the plugboard setting under which the input reads the
+ * most like the n-grams, and prints the full key followed by the decryption.
  */
-static void apply_rotor_setting(Enigma *enigma, const char *str)
+static int search_plugboard_main(const Options *opts, Session *session)
 {
-    HglStringView sv = hgl_sv_from_cstr(str);
-    for (int i = 0; i < 3; i++) {
-        HglStringView r = hgl_sv_trim(hgl_sv_lchop_until(&sv, ' '));
-        if (hgl_sv_equals(r, HGL_SV("I"))) {
-            enigma->rotor[i] = ROTOR_I;
-        } else if (hgl_sv_equals(r, HGL_SV("II"))) {
-            enigma->rotor[i] = ROTOR_II;
-        } else if (hgl_sv_equals(r, HGL_SV("III"))) {
-            enigma->rotor[i] = ROTOR_III;
-        } else if (hgl_sv_equals(r, HGL_SV("IV"))) {
-            enigma->rotor[i] = ROTOR_IV;
-        } else if (hgl_sv_equals(r, HGL_SV("V"))) {
-            enigma->rotor[i] = ROTOR_V;
-        } else if (hgl_sv_equals(r, HGL_SV("VI"))) {
-            enigma->rotor[i] = ROTOR_VI;
-        } else if (hgl_sv_equals(r, HGL_SV("VII"))) {
-            enigma->rotor[i] = ROTOR_VII;
-        } else if (hgl_sv_equals(r, HGL_SV("VIII"))) {
-            enigma->rotor[i] = ROTOR_VIII;
-        } else {
-            ENIGMA_ASSERT(false, "Unknown rotor \"" HGL_SV_FMT "\".", HGL_SV_ARG(r));
-        }
+    ENIGMA_ASSERT(**opts->ngrams != '\0', "No n-gram file given (see --ngrams).");
+    NgramModel model;
+    load_ngram_model(&model, *opts->ngrams, *opts->ngram_length);
+    size_t length;
+    char *ciphertext = read_letters(session->input_fd, &length);
+    ENIGMA_ASSERT(length >= model.n, "The ciphertext is too short.");
+
+    /* start from the given plugboard, if any */
+    Enigma *enigma = &session->enigma;
+    u8 plugboard[26];
+    for (u8 n = 0; n < 26; n++) {
+        plugboard[n] = ENCODE(enigma->plugboard.image[n]);
+    }
+    u64 score = search_plugboard(enigma, &model, ciphertext, length, *opts->max_pairs, *opts->temperature,
+                                 *opts->restarts, plugboard, *opts->threads);
+
+    /* print the full key as enigma-cli options, followed by the decryption */
+    char plugboard_setting[3 * 13 + 1];
+    format_plugboard(plugboard_setting, plugboard);
+    ENIGMA_ASSERT(apply_plugboard_setting(enigma, plugboard_setting) == ENIGMA_OK, "%s", enigma_error_message());
+    EnigmaTable *table = compile_table(session->engine, enigma);
+    encipher_letters(session->engine, table, enigma, ciphertext, ciphertext, length);
+    const EnigmaSettings *settings = &session->settings;
+    dprintf(session->output_fd, "%.2f -u %s -w \"%s\" -r \"%s\" -s \"%s\" -g \"%s\"",
+            ngram_log_prob(&model, score, length), settings->reflector, settings->rotors, settings->ring,
+            plugboard_setting, settings->indicator);
+    if (*opts->offset > 0) {
+        dprintf(session->output_fd, " --offset %" PRIu64, *opts->offset);
     }
+    dprintf(session->output_fd, "\n%.*s\n", (int) length, ciphertext);
+    free(table);
+    free_ngram_model(&model);
+    free(ciphertext);
+    return 0;
 }
 
 /**
- * Applies an indicator (or "Ringstellung") setting (e.g. "ABC" or "1 2 3") to 
- * the currently mounted rotors.
+ * --serve: serves requests until killed.
  */
-static void apply_ring_setting(Enigma *enigma, const char *str)
+static int serve_main(const Options *opts, Session *session)
 {
-    HglStringView sv = hgl_sv_from_cstr(str);
-    for (int i = 0; i < 3; i++) {
-        HglStringView l;
-        sv = hgl_sv_trim(sv);
-        l = hgl_sv_lchop_lexeme(&sv, lex_numeric);
-        if (l.length != 0) {
-            enigma->rotor[i].ring_setting = (u8) hgl_sv_to_u64(l) - 1;
-            continue;
-        }
-        l = hgl_sv_lchop_lexeme(&sv, lex_letter);
-        if (l.length != 0) {
-            enigma->rotor[i].ring_setting = ENCODE(to_upper(l.start[0]));
-            continue;
-        }
-        ENIGMA_ERROR("Invalid ring setting \"%s\".", str);
+    MachineCache cache;
+    init_machine_cache(&cache, session->engine, *opts->cache_size * 1024 * 1024);
+    serve(open_server_socket(*opts->serve_socket), &cache, &session->settings);
+    free_machine_cache(&cache);
+    return 0;
+}
+
+/**
+ * --procedure: deciphers a message sent under an indicator procedure. Fails if a doubled
+ * indicator is inconsistent (the message is still deciphered).
+ */
+static int procedure_main(const Options *opts, Session *session)
+{
+    size_t length;
+    char *letters = read_all(session->input_fd, &length);
+    if (session->input_format == FORMAT_PACKED) {
+        char *packed = letters;
+        letters = malloc(length / 5 * 8 + 8);
+        ENIGMA_ASSERT(letters != NULL, "Failed to allocate the message.");
+        Unpacker unpacker = {0};
+        length = unpack_letters(&unpacker, letters, (const u8 *) packed, length);
+        free(packed);
+    } else {
+        length = filter_letters(letters, letters, length);
     }
-    ENIGMA_ASSERT(hgl_sv_trim(sv).length == 0, "Invalid ring setting \"%s\".", str);
+    ENIGMA_ASSERT(length >= INDICATOR_LENGTH, "The message is too short for its indicator (%d letters).",
+                  INDICATOR_LENGTH);
+    EnigmaTable *table = compile_table(session->engine, &session->enigma);
+    char indicator[INDICATOR_LENGTH + 1];
+    b8 consistent = read_message_key(session->procedure, session->engine, table, &session->enigma, letters, indicator);
+    if (!consistent) {
+        fprintf(stderr, "Inconsistent doubled indicator (%s).\n", indicator);
+    }
+
+    OutputWriter writer;
+    init_output_writer(&writer, session->format, *opts->group_size, *opts->groups_per_line, session->output_fd);
+    length -= INDICATOR_LENGTH;
+    encipher_letters_threaded(session->engine, table, &session->enigma, &letters[INDICATOR_LENGTH], length,
+                              *opts->threads);
+    write_output(&writer, &letters[INDICATOR_LENGTH], length);
+    finish_output(&writer);
+    if (*opts->verbose) {
+        fprintf(stderr, "Indicator %s, deciphered %zu letters.\n", indicator, length);
+    }
+    free_output_writer(&writer);
+    free(letters);
+    free(table);
+    return consistent ? 0 : 1;
 }
 
 /**
- * Applies a plugboard (or "Steckerverbindungen") setting (e.g. "ab cd ef gh") 
- * to the machine.
+ * The default mode: enciphers (or deciphers) the input file or stdin, or has the daemon
+ * do so with --connect. Fails if there is no input.
  */
-static void apply_plugboard_setting(Enigma *enigma, const char *str)
+static int encipher_main(const Options *opts, Session *session)
 {
-    enigma->plugboard = BARE_PLUGBOARD;
-    u8 wiring[26] = {0};
-    HglStringView sv = hgl_sv_from_cstr(str);
-    while (sv.length > 0) {
-        /* grab next pair */
-        HglStringView pair = hgl_sv_trim(hgl_sv_lchop_until(&sv, ' '));
-        ENIGMA_ASSERT(pair.length == 2, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
-                      "String should be formatted as \"ab cd ef ...\"", HGL_SV_ARG(pair));
+    EnigmaTable *table = compile_table(session->engine, &session->enigma);
+    OutputWriter writer;
+    init_output_writer(&writer, session->format, *opts->group_size, *opts->groups_per_line, session->output_fd);
+    size_t n_total_read_bytes;
+    if (**opts->connect_socket != '\0') {
+        n_total_read_bytes = encipher_remote(*opts->connect_socket, &session->settings, &session->enigma,
+                                             session->input_format, session->input_fd, &writer);
+    } else if (session->input_fd != 0 && is_regular_file(session->input_fd)) {
+        n_total_read_bytes = encipher_file(session->engine, table, &session->enigma, session->input_format, &writer,
+                                           session->input_fd,
+                                           **opts->output_file != '\0' && is_mappable_output(session->output_fd),
+                                           *opts->threads);
+    } else if (*opts->threads > 1) {
+        n_total_read_bytes = encipher_stream_threaded(session->engine, table, &session->enigma, session->input_format,
+                                                      &writer, session->input_fd, *opts->threads);
+    } else {
+        n_total_read_bytes = encipher_stream(session->engine, table, &session->enigma, session->input_format,
+                                             &writer, session->input_fd);
+    }
+    free(table);
+    if (n_total_read_bytes == 0) {
+        free_output_writer(&writer);
+        return 1;
+    }
+    finish_output(&writer);
+    if (*opts->verbose && session->input_format != FORMAT_PACKED) {
+        fprintf(stderr, "Enciphered %" PRIu64 " letters, dropped %" PRIu64 " other characters.\n",
+                writer.n_letters, n_total_read_bytes - writer.n_letters);
+    } else if (*opts->verbose) {
+        fprintf(stderr, "Enciphered %" PRIu64 " letters.\n", writer.n_letters);
+    }
+    free_output_writer(&writer);
+    return 0;
+}
+
+/**
+ * Reads all of `fd` and returns its letters (see `filter_letters`), placing their number
+ * into `length`.
+ */
+static char *read_letters(int fd, size_t *length)
+{
+    char *letters = read_all(fd, length);
+    *length = filter_letters(letters, letters, *length);
+    return letters;
+}
 
-        char c0 = to_upper(pair.start[0]);
-        char c1 = to_upper(pair.start[1]);
-        u8 n0 = ENCODE(c0);
-        u8 n1 = ENCODE(c1);
+/**
+ * Returns the letters of the crib given with --crib, placing their number into
+ * `crib_length`. Exits with an error unless the crib fits within the `length` letters
+ * of the ciphertext at --crib-offset.
+ */
+static char *read_crib(const Options *opts, size_t length, size_t *crib_length)
+{
+    *crib_length = strlen(*opts->crib);
+    char *crib = malloc(*crib_length + 1);
+    ENIGMA_ASSERT(crib != NULL, "Failed to allocate the crib.");
+    *crib_length = filter_letters(crib, *opts->crib, *crib_length);
+    ENIGMA_ASSERT(*crib_length > 0, "No crib given (see --crib).");
+    ENIGMA_ASSERT(*opts->crib_offset <= length && *crib_length <= length - *opts->crib_offset,
+                  "The crib does not fit within the %zu letters of the ciphertext.", length);
+    return crib;
+}
+
+/**
+ * Splits the names given with --search-reflectors and --search-rotors into `names`, and
+ * checks them (see `check_search_names`).
+ */
+static void split_search_names(SearchNames *names, const Options *opts)
+{
+    names->reflector_list = strdup(*opts->search_reflectors);
+    names->rotor_list = strdup(*opts->search_rotors);
+    ENIGMA_ASSERT(names->reflector_list != NULL && names->rotor_list != NULL, "Failed to allocate the search names.");
+    names->n_reflectors = split_words(names->reflector_list, names->reflectors, MAX_SEARCH_NAMES);
+    names->n_rotors = split_words(names->rotor_list, names->rotors, MAX_SEARCH_NAMES);
+    check_search_names(names->reflectors, names->n_reflectors, names->rotors, names->n_rotors);
+}
 
-        ENIGMA_ASSERT(c0 != c1, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
-                      "A character can not be swapped with itself", HGL_SV_ARG(pair));
-        ENIGMA_ASSERT(in_alphabet(c0), "Invalid plugboard pair \"" HGL_SV_FMT "\". "
-                      "Character '%c' is not in the Enigma alphabet", HGL_SV_ARG(pair), c0);
-        ENIGMA_ASSERT(in_alphabet(c1), "Invalid plugboard pair \"" HGL_SV_FMT "\". "
-                      "Character '%c' is not in the Enigma alphabet", HGL_SV_ARG(pair), c1);
-        ENIGMA_ASSERT(wiring[n0] == 0, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
-                      "The character '%c' has already been used.", HGL_SV_ARG(pair), c0);
-        ENIGMA_ASSERT(wiring[n1] == 0, "Invalid plugboard pair \"" HGL_SV_FMT "\". "
-                      "The character '%c' has already been used.", HGL_SV_ARG(pair), c1);
+/**
+ * Frees the names split by `split_search_names`.
+ */
+static void free_search_names(SearchNames *names)
+{
+    free(names->reflector_list);
+    free(names->rotor_list);
+}
 
-        /* apply wiring */
-        wiring[n0] = c1;
-        wiring[n1] = c0;
-        enigma->plugboard.image[n0] = c1;
-        enigma->plugboard.image[n1] = c0;
+/**
+ * Returns `enigma` compiled into a newly allocated table if `engine` needs one
+ * (ENGINE_TABLE), and NULL otherwise.
+ */
+static EnigmaTable *compile_table(Engine engine, const Enigma *enigma)
+{
+    if (engine != ENGINE_TABLE) {
+        return NULL;
     }
+    EnigmaTable *table = malloc(sizeof(EnigmaTable));
+    ENIGMA_ASSERT(table != NULL, "Failed to allocate the enigma table.");
+    compile_enigma(table, enigma);
+    return table;
 }
 
 /**
- * Applies an indicator (or "Grundstellung") setting (e.g. "ABC" or "1 2 3") to 
- * the currently mounted rotors.
+ * Places all orders of three distinct rotors out of `n_rotors` rotors into `orders`
+ * (room for n_rotors^3), and returns their number.
  */
-static void apply_indicator_setting(Enigma *enigma, const char *str)
+size_t list_rotor_orders(size_t n_rotors, u8 (*orders)[3])
 {
-    HglStringView sv = hgl_sv_from_cstr(str);
-    for (int i = 0; i < 3; i++) {
-        HglStringView l;
-        sv = hgl_sv_trim(sv);
-        l = hgl_sv_lchop_lexeme(&sv, lex_numeric);
-        if (l.length != 0) {
-            enigma->rotor[i].position = (u8) hgl_sv_to_u64(l) - 1;
-            continue;
-        }
-        l = hgl_sv_lchop_lexeme(&sv, lex_letter);
-        if (l.length != 0) {
-            enigma->rotor[i].position = ENCODE(to_upper(l.start[0]));
-            continue;
+    size_t n_orders = 0;
+    for (u8 i = 0; i < n_rotors; i++) {
+        for (u8 j = 0; j < n_rotors; j++) {
+            for (u8 k = 0; k < n_rotors; k++) {
+                if (i != j && j != k && i != k) {
+                    orders[n_orders][0] = i;
+                    orders[n_orders][1] = j;
+                    orders[n_orders][2] = k;
+                    n_orders++;
+                }
+            }
         }
-        ENIGMA_ERROR("Invalid indicator setting \"%s\".", str);
     }
-    ENIGMA_ASSERT(hgl_sv_trim(sv).length == 0, "Invalid indicator setting \"%s\".", str);
+    return n_orders;
 }
 
 /**
- * Returns true if rotor `r` is positioned at a turnover notch.
+ * Exits with an error unless there is at least one reflector and three rotors to search,
+ * and all their names are valid.
  */
-static b8 is_at_turnover(const Rotor *r)
+static void check_search_names(const char **reflectors, size_t n_reflectors, const char **rotors, size_t n_rotors)
 {
-    return (r->position == r->turnover1) ||
-           (r->position == r->turnover2);
+    ENIGMA_ASSERT(n_reflectors > 0, "No reflectors to search (see --search-reflectors).");
+    ENIGMA_ASSERT(n_rotors >= 3, "At least three rotors are needed to search (see --search-rotors).");
+    Enigma e = {0};
+    for (size_t i = 0; i < n_reflectors; i++) {
+        ENIGMA_ASSERT(apply_reflector_setting(&e, reflectors[i]) == ENIGMA_OK, "%s", enigma_error_message());
+    }
+    for (size_t i = 0; i < n_rotors; i++) {
+        char rotor_setting[64];
+        snprintf(rotor_setting, sizeof(rotor_setting), "%s %s %s", rotors[i], rotors[i], rotors[i]);
+        ENIGMA_ASSERT(apply_rotor_setting(&e, rotor_setting) == ENIGMA_OK, "%s", enigma_error_message());
+    }
 }
 
 /**
- * Steps rotor `r` once.
+ * Formats `plugboard` (encoded as 0-25) as a plugboard setting (e.g. "AB CD") into 
+ * `setting`, which must have room for 3 * 13 + 1 characters.
  */
-static void step_rotor(Rotor *r)
+static void format_plugboard(char *setting, const u8 plugboard[26])
 {
-    r->position = (r->position + 1) % 26;
+    char *wr = setting;
+    *wr = '\0';
+    for (u8 n = 0; n < 26; n++) {
+        if (plugboard[n] > n) {
+            wr += sprintf(wr, (wr == setting) ? "%c%c" : " %c%c", DECODE(n), DECODE(plugboard[n]));
+        }
+    }
 }
 
 /**
- * Returns the image of 'n' under the substitution given by the rotor `r` (including rotor 
- * position and ring setting) and the current flow direction `dir` through the rotor, where
- * `n` is the numerical encoding of a letter in the Enigma alphabet.
+ * Enciphers `input_fd` (stdin, or a pipe or other stream given with -i) in chunks of 
+ * CHUNK_SIZE bytes, using a single thread. The output is flushed after every chunk. 
+ * Returns the number of bytes read.
  */
-static u8 apply_rotor_subst(const Rotor *r, Direction dir, u8 n)
+static size_t encipher_stream(Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                              Format input_format, OutputWriter *writer, int input_fd)
 {
-    n = (n - r->ring_setting + r->position + 26) % 26;
-    switch (dir) {
-        case FORWARD: n = apply_subst(&r->forward, n); break;
-        case REVERSE: n = apply_subst(&r->reverse, n); break;
+    static char input[CHUNK_SIZE] = {0};
+    static char output[CHUNK_SIZE * 8 / 5 + 1] = {0}; /* packed input expands by 8/5 */
+    Unpacker unpacker = {0};
+    size_t n_total_read_bytes = 0;
+    while (true) {
+        ssize_t n_read_bytes = read(input_fd, input, CHUNK_SIZE);
+        if (n_read_bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        ENIGMA_ASSERT(n_read_bytes >= 0, "Failed to read the input.");
+        if (n_read_bytes == 0) {
+            break;
+        }
+        n_total_read_bytes += n_read_bytes;
+
+        size_t output_size = (input_format == FORMAT_PACKED) ?
+            unpack_letters(&unpacker, output, (const u8 *) input, n_read_bytes) :
+            filter_letters(output, input, n_read_bytes);
+        encipher_letters(engine, table, enigma, output, output, output_size);
+
+        /* Pretty-print result */
+        write_output(writer, output, output_size);
+        flush_output(writer);
     }
-    n = (n + r->ring_setting - r->position + 26) % 26;
-    return n;
+    return n_total_read_bytes;
 }
 
 /**
- * Applies substitution `s` to `n`.
+ * Enciphers `input_fd` (see `encipher_stream`) using `n_threads` threads. Since the machine state at any 
+ * letter offset can be computed directly (see `advance_enigma`), the input is read in 
+ * large chunks which are split into partitions that are filtered and enciphered 
+ * independently. The results are written in order, so the output is identical to that 
+ * of `encipher_stream`. Returns the number of bytes read.
  */
-static u8 apply_subst(const Substitution *s, u8 n)
+static size_t encipher_stream_threaded(Engine engine, const EnigmaTable *table, const Enigma *enigma,
+                                       Format input_format, OutputWriter *writer, int input_fd, size_t n_threads)
 {
-    return ENCODE(s->image[n]);
+    /* 
+     * Packed input partitions are kept at a multiple of 5 bytes (i.e. 8 letters) so that
+     * each partition starts on a letter boundary, and expand to PARTITION_SIZE letters.
+     */
+    size_t input_partition_size = (input_format == FORMAT_PACKED) ? PARTITION_SIZE / 8 * 5 : PARTITION_SIZE;
+    size_t n_partitions = n_threads * PARTITIONS_PER_THREAD;
+    size_t chunk_size = n_partitions * input_partition_size;
+    ThreadedChunk chunk = {
+        .engine  = engine,
+        .table   = table,
+        .start   = *enigma,
+        .input_format = input_format,
+        .input_partition_size = input_partition_size,
+        .input   = malloc(chunk_size),
+        .letters = malloc(n_partitions * PARTITION_SIZE),
+        .lengths = malloc(n_partitions * sizeof(size_t)),
+        .offsets = malloc(n_partitions * sizeof(u64)),
+    };
+    ENIGMA_ASSERT(chunk.input != NULL && chunk.letters != NULL &&
+                  chunk.lengths != NULL && chunk.offsets != NULL, 
+                  "Failed to allocate buffers for %zu threads.", n_threads);
+
+    size_t n_total_read_bytes = 0;
+    u64 n_total_letters = 0;
+    while (true) {
+        chunk.input_size = read_fully(input_fd, chunk.input, chunk_size);
+        if (chunk.input_size == 0) {
+            break;
+        }
+        n_total_read_bytes += chunk.input_size;
+
+        /* 1. filter (or unpack) the letters of each partition */
+        size_t n_jobs = (chunk.input_size + input_partition_size - 1) / input_partition_size;
+        parallel_for(n_jobs, n_threads, filter_partition, &chunk);
+
+        /* 2. find the letter offset at which each partition starts */
+        for (size_t i = 0; i < n_jobs; i++) {
+            chunk.offsets[i] = n_total_letters;
+            n_total_letters += chunk.lengths[i];
+        }
+
+        /* 3. encipher each partition */
+        parallel_for(n_jobs, n_threads, encipher_partition, &chunk);
+
+        /* Pretty-print result */
+        for (size_t i = 0; i < n_jobs; i++) {
+            write_output(writer, &chunk.letters[i * PARTITION_SIZE], chunk.lengths[i]);
+        }
+        flush_output(writer);
+    }
+
+    free(chunk.input);
+    free(chunk.letters);
+    free(chunk.lengths);
+    free(chunk.offsets);
+    return n_total_read_bytes;
 }
 
 /**
- * Lexer rule which matches the numerical encodings of the letters from the Enigma alphabet.
+ * Enciphers the file open at `input_fd` by memory-mapping it, using `n_threads` threads. 
+ * The mapped input is processed in windows like the chunks of `encipher_stream_threaded`,
+ * so memory use is bounded regardless of the size of the file. If `map_output` is set, 
+ * `writer->fd` must be a regular file opened for reading and writing, which is resized 
+ * to fit the output and mapped, and each window is formatted directly into it. Since 
+ * the size of the output must be known up front, the letters are then counted in a 
+ * first pass over the input. This saves copying the input and the output through `read`
+ * and `write`. Returns the size of the input file.
  */
-static size_t lex_numeric(HglStringView sv)
+static size_t encipher_file(Engine engine, const EnigmaTable *table, const Enigma *enigma, Format input_format,
+                            OutputWriter *writer, int input_fd, b8 map_output, size_t n_threads)
 {
-    if (sv.length == 0) {
+    struct stat st;
+    ENIGMA_ASSERT(fstat(input_fd, &st) == 0, "Failed to stat the input file.");
+    size_t input_size = st.st_size;
+    if (input_size == 0) {
         return 0;
     }
-    size_t original_length = sv.length;
-    if (sv.start[0] < '1' || sv.start[0] > '9') return 0;
-    u64 value = hgl_sv_lchop_u64(&sv);
-    if (value < 1 || value > 26) {
-        return 0;
+    char *input = mmap(NULL, input_size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+    ENIGMA_ASSERT(input != MAP_FAILED, "Failed to map the input file.");
+    posix_madvise(input, input_size, POSIX_MADV_SEQUENTIAL);
+
+    /* See `encipher_stream_threaded` */
+    size_t input_partition_size = (input_format == FORMAT_PACKED) ? PARTITION_SIZE / 8 * 5 : PARTITION_SIZE;
+    size_t n_partitions = n_threads * PARTITIONS_PER_THREAD;
+    size_t window_size = n_partitions * input_partition_size;
+    ThreadedChunk chunk = {
+        .engine  = engine,
+        .table   = table,
+        .start   = *enigma,
+        .input_format = input_format,
+        .input_partition_size = input_partition_size,
+        .letters = malloc(n_partitions * PARTITION_SIZE),
+        .lengths = malloc(n_partitions * sizeof(size_t)),
+        .offsets = malloc(n_partitions * sizeof(u64)),
+    };
+    ENIGMA_ASSERT(chunk.letters != NULL && chunk.lengths != NULL && chunk.offsets != NULL, 
+                  "Failed to allocate buffers for %zu threads.", n_threads);
+
+    /* Map the output file, sized to fit the formatted output exactly */
+    if (map_output) {
+        u64 n_letters = 0;
+        for (size_t begin = 0; begin < input_size; begin += window_size) {
+            chunk.input = &input[begin];
+            chunk.input_size = (input_size - begin < window_size) ? input_size - begin : window_size;
+            size_t n_jobs = (chunk.input_size + input_partition_size - 1) / input_partition_size;
+            parallel_for(n_jobs, n_threads, filter_partition, &chunk);
+            for (size_t i = 0; i < n_jobs; i++) {
+                n_letters += chunk.lengths[i];
+            }
+        }
+        size_t size = output_size(writer, n_letters);
+        ENIGMA_ASSERT(ftruncate(writer->fd, size) == 0, "Failed to resize the output file.");
+        if (size > 0) {
+            char *output = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+            ENIGMA_ASSERT(output != MAP_FAILED, "Failed to map the output file.");
+            map_output_writer(writer, output, size);
+        }
+    }
+
+    u64 n_total_letters = 0;
+    for (size_t begin = 0; begin < input_size; begin += window_size) {
+        chunk.input = &input[begin];
+        chunk.input_size = (input_size - begin < window_size) ? input_size - begin : window_size;
+        size_t n_jobs = (chunk.input_size + input_partition_size - 1) / input_partition_size;
+        parallel_for(n_jobs, n_threads, filter_partition, &chunk);
+        for (size_t i = 0; i < n_jobs; i++) {
+            chunk.offsets[i] = n_total_letters;
+            n_total_letters += chunk.lengths[i];
+        }
+        parallel_for(n_jobs, n_threads, encipher_partition, &chunk);
+
+        /* Pretty-print result */
+        for (size_t i = 0; i < n_jobs; i++) {
+            write_output(writer, &chunk.letters[i * PARTITION_SIZE], chunk.lengths[i]);
+        }
+        flush_output(writer);
     }
-    return original_length - sv.length;
+
+    munmap(input, input_size);
+    free(chunk.letters);
+    free(chunk.lengths);
+    free(chunk.offsets);
+    return input_size;
 }
 
 /**
- * Lexer rule which matches the letters from the Enigma alphabet.
+ * Enciphers every record of the batch file open at `batch_fd` with its own machine 
+ * settings, using `n_threads` threads, and writes the results to `writer` in the same 
+ * order and format as the records, tagged with their IDs. Empty settings default to 
+ * `defaults`. The machines are taken from `cache`. Returns the number of records.
+ *
+ * A record consists of seven fields: an ID, the reflector, rotor order, ring setting, 
+ * plugboard, and indicator settings (as given to -u, -w, -r, -s, and -g), and the message.
+ * In the CSV and TSV formats, every line is a record. Since the message is the last field,
+ * it may contain the delimiter. In the binary format, every field is prefixed by its 
+ * length. A result consists of the ID and the enciphered letters of the message. Under
+ * an indicator `procedure`, the indicator is dropped from the result (see 
+ * `read_record_key`).
+ *
+ * With ENGINE_SIMD, the records are sorted by length and enciphered in groups. Within a 
+ * group, records of up to MAX_LANE_MESSAGE_LENGTH letters are enciphered by a single call
+ * to `encipher_messages`, which runs MESSAGE_LANES machines side by side; records of 
+ * similar length keep its lanes busy until the end of the group. Longer records are 
+ * enciphered one by one with ENGINE_SIMD, which is faster for them.
  */
-static size_t lex_letter(HglStringView sv)
+static size_t encipher_batch(MachineCache *cache, const EnigmaSettings *defaults, BatchFormat batch_format,
+                             Procedure procedure, int batch_fd, OutputWriter *writer, size_t n_threads)
 {
-    if (sv.length == 0) {
-        return 0;
+    size_t size;
+    char *data = read_all(batch_fd, &size);
+    size_t n_records = 0;
+    Batch batch = {
+        .defaults = *defaults,
+        .cache    = cache,
+        .records  = (batch_format == BATCH_BINARY) ? 
+            parse_batch_binary(data, size, &n_records) :
+            parse_batch_text(data, size, (batch_format == BATCH_TSV) ? '\t' : ',', &n_records),
+    };
+    batch.n_records = n_records;
+    batch.procedure = procedure;
+
+    if (cache->engine == ENGINE_SIMD) {
+        batch.sorted = malloc(n_records * sizeof(BatchRecord *));
+        ENIGMA_ASSERT(n_records == 0 || batch.sorted != NULL, "Failed to allocate batch records.");
+        for (size_t i = 0; i < n_records; i++) {
+            batch.sorted[i] = &batch.records[i];
+        }
+        qsort(batch.sorted, n_records, sizeof(BatchRecord *), compare_record_lengths);
+        size_t n_groups = (n_records + BATCH_GROUP_SIZE - 1) / BATCH_GROUP_SIZE;
+        parallel_for(n_groups, n_threads, encipher_record_group, &batch);
+        free(batch.sorted);
+    } else {
+        parallel_for(n_records, n_threads, encipher_record, &batch);
     }
-    char c = to_upper(sv.start[0]);
-    if (c >= 'A' && c <= 'Z') {
-        return 1;
+
+    for (size_t i = 0; i < n_records; i++) {
+        const BatchRecord *record = &batch.records[i];
+        size_t id_length = strlen(record->id);
+        if (batch_format == BATCH_BINARY) {
+            u8 prefix[4] = {id_length, id_length >> 8, id_length >> 16, id_length >> 24};
+            write_raw(writer, (const char *) prefix, 4);
+            write_raw(writer, record->id, id_length);
+            u8 length[4] = {record->length, record->length >> 8, record->length >> 16, record->length >> 24};
+            write_raw(writer, (const char *) length, 4);
+            write_output(writer, record->message, record->length);
+        } else {
+            write_raw(writer, record->id, id_length);
+            write_raw(writer, (batch_format == BATCH_TSV) ? "\t" : ",", 1);
+            write_output(writer, record->message, record->length);
+            write_raw(writer, "\n", 1);
+        }
     }
-    return 0;
+
+    free(batch.records);
+    free(data);
+    return n_records;
+}
+
+/**
+ * Splits the `size` bytes of CSV (or TSV) at `data` into records, in place, using 
+ * `delimiter`. `data` must be NUL-terminated. Empty lines are skipped. Returns the 
+ * records and stores their number in `n_records`.
+ */
+static BatchRecord *parse_batch_text(char *data, size_t size, char delimiter, size_t *n_records)
+{
+    size_t capacity = 1024;
+    BatchRecord *records = malloc(capacity * sizeof(BatchRecord));
+    ENIGMA_ASSERT(records != NULL, "Failed to allocate batch records.");
+    *n_records = 0;
+
+    char *end = &data[size];
+    size_t line_number = 0;
+    for (char *line = data; line < end; ) {
+        line_number++;
+        char *line_end = memchr(line, '\n', end - line);
+        line_end = (line_end != NULL) ? line_end : end;
+        char *next = line_end + 1;
+        *line_end = '\0';
+        if (line_end > line && line_end[-1] == '\r') {
+            *--line_end = '\0';
+        }
+        if (line_end == line) {
+            line = next;
+            continue;
+        }
+
+        char *fields[7] = {line};
+        for (int i = 1; i < 7; i++) {
+            char *delim = memchr(fields[i - 1], delimiter, line_end - fields[i - 1]);
+            ENIGMA_ASSERT(delim != NULL, "Batch record on line %zu has fewer than 7 fields.", line_number);
+            *delim = '\0';
+            fields[i] = delim + 1;
+        }
+
+        if (*n_records == capacity) {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(BatchRecord));
+            ENIGMA_ASSERT(records != NULL, "Failed to allocate batch records.");
+        }
+        records[(*n_records)++] = (BatchRecord) {
+            .id       = fields[0],
+            .settings = {fields[1], fields[2], fields[3], fields[4], fields[5]},
+            .message  = fields[6],
+            .length   = line_end - fields[6],
+        };
+        line = next;
+    }
+    return records;
+}
+
+/**
+ * Splits the `size` bytes of length-prefixed fields at `data` into records, in place. 
+ * See `parse_fields`. Returns the records and stores their number in `n_records`.
+ */
+static BatchRecord *parse_batch_binary(char *data, size_t size, size_t *n_records)
+{
+    size_t capacity = 1024;
+    BatchRecord *records = malloc(capacity * sizeof(BatchRecord));
+    ENIGMA_ASSERT(records != NULL, "Failed to allocate batch records.");
+    *n_records = 0;
+
+    size_t offset = 0;
+    while (offset < size) {
+        char *fields[7];
+        size_t lengths[7];
+        size_t n = parse_fields(&data[offset], size - offset, 7, fields, lengths);
+        ENIGMA_ASSERT(n != 0, "Batch record %zu is truncated.", *n_records + 1);
+        offset += n;
+
+        if (*n_records == capacity) {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(BatchRecord));
+            ENIGMA_ASSERT(records != NULL, "Failed to allocate batch records.");
+        }
+        records[(*n_records)++] = (BatchRecord) {
+            .id       = fields[0],
+            .settings = {fields[1], fields[2], fields[3], fields[4], fields[5]},
+            .message  = fields[6],
+            .length   = lengths[6],
+        };
+    }
+    return records;
+}
+
+/**
+ * Parses `n_fields` fields, each prefixed by its length as a 32-bit little-endian integer,
+ * from the `size` bytes at `data`, in place. Every field is moved over its length prefix 
+ * to make room for a NUL terminator. Returns the number of bytes parsed, or 0 (leaving 
+ * `data` untouched) if `data` does not hold `n_fields` complete fields.
+ */
+static size_t parse_fields(char *data, size_t size, int n_fields, char *fields[], size_t lengths[])
+{
+    size_t offset = 0;
+    for (int i = 0; i < n_fields; i++) {
+        if (size - offset < 4) {
+            return 0;
+        }
+        const u8 *prefix = (const u8 *) &data[offset];
+        lengths[i] = (size_t) prefix[0] | ((size_t) prefix[1] << 8) | 
+                     ((size_t) prefix[2] << 16) | ((size_t) prefix[3] << 24);
+        if (size - offset - 4 < lengths[i]) {
+            return 0;
+        }
+        offset += 4 + lengths[i];
+    }
+
+    offset = 0;
+    for (int i = 0; i < n_fields; i++) {
+        fields[i] = &data[offset];
+        memmove(fields[i], &data[offset + 4], lengths[i]);
+        fields[i][lengths[i]] = '\0';
+        offset += 4 + lengths[i];
+    }
+    return offset;
 }
 
 /**
- * Returns the uppercase of `c`.
+ * `parallel_for` job which enciphers batch record `job`. See `encipher_batch_record`.
  */
-static char to_upper(char c)
+static void encipher_record(void *ctx, size_t job)
 {
-    return (c >= 'a' && c <= 'z') ? (c - 0x20) : c;
+    Batch *batch = ctx;
+    BatchRecord *record = &batch->records[job];
+    ENIGMA_ASSERT(encipher_batch_record(batch->cache, &batch->defaults, batch->procedure, record), 
+                  "Batch record \"%s\": %s", record->id, enigma_error_message());
 }
 
 /**
- * Returns true if `c` is in the Enigma alphabet.
+ * `parallel_for` job which enciphers group `job` of BATCH_GROUP_SIZE sorted batch 
+ * records; the short ones with `encipher_messages` and the rest one by one. See 
+ * `encipher_batch` and `prepare_batch_record`.
  */
-static char in_alphabet(char c)
+static void encipher_record_group(void *ctx, size_t job)
 {
-    return c >= 'A' && c <= 'Z';
+    Batch *batch = ctx;
+    size_t begin = job * BATCH_GROUP_SIZE;
+    size_t n_records = batch->n_records - begin;
+    n_records = (n_records < BATCH_GROUP_SIZE) ? n_records : BATCH_GROUP_SIZE;
+
+    Enigma *enigmas = malloc(n_records * sizeof(Enigma));
+    char **messages = malloc(n_records * sizeof(char *));
+    size_t *lengths = malloc(n_records * sizeof(size_t));
+    ENIGMA_ASSERT(enigmas != NULL && messages != NULL && lengths != NULL, "Failed to allocate batch group.");
+    size_t n_lane_records = 0;
+    for (size_t i = 0; i < n_records; i++) {
+        BatchRecord *record = batch->sorted[begin + i];
+        Enigma *enigma = &enigmas[n_lane_records];
+        ENIGMA_ASSERT(prepare_batch_record(batch->cache, &batch->defaults, batch->procedure, record, enigma), 
+                      "Batch record \"%s\": %s", record->id, enigma_error_message());
+        if (record->length > MAX_LANE_MESSAGE_LENGTH) {
+            encipher_letters(ENGINE_SIMD, NULL, enigma, record->message, record->message, record->length);
+            continue;
+        }
+        messages[n_lane_records] = record->message;
+        lengths[n_lane_records] = record->length;
+        n_lane_records++;
+    }
+    encipher_messages(enigmas, messages, (const char *const *) messages, lengths, n_lane_records);
+
+    free(enigmas);
+    free(messages);
+    free(lengths);
+}
+
+/**
+ * Sets up a machine according to the settings of `record`, where empty settings default
+ * to `defaults`, and enciphers its message, sent under `procedure`, in place. Machines 
+ * are reused from `cache`, so only the indicator setting (and message key) is applied per
+ * record. Returns false if the settings are invalid (see `enigma_error_message`).
+ */
+static b8 encipher_batch_record(MachineCache *cache, const EnigmaSettings *defaults, Procedure procedure,
+                                BatchRecord *record)
+{
+    EnigmaSettings settings = record_settings(defaults, record);
+    CachedMachine *machine = acquire_machine(cache, &settings);
+    if (machine == NULL) {
+        return false;
+    }
+    Enigma enigma = machine->enigma;
+    b8 ok = apply_indicator_setting(&enigma, settings.indicator) == ENIGMA_OK;
+    if (ok) {
+        record->length = filter_letters(record->message, record->message, record->length);
+        read_record_key(procedure, cache->engine, machine->table, &enigma, record);
+        encipher_letters(cache->engine, machine->table, &enigma, record->message, record->message, record->length);
+    }
+    release_machine(cache, machine);
+    return ok;
+}
+
+/**
+ * Sets up `enigma` according to the settings of `record` (see `encipher_batch_record`), 
+ * and filters the letters of its message in place, leaving them to be enciphered. Returns
+ * false if the settings are invalid (see `enigma_error_message`).
+ */
+static b8 prepare_batch_record(MachineCache *cache, const EnigmaSettings *defaults, Procedure procedure,
+                               BatchRecord *record, Enigma *enigma)
+{
+    EnigmaSettings settings = record_settings(defaults, record);
+    CachedMachine *machine = acquire_machine(cache, &settings);
+    if (machine == NULL) {
+        return false;
+    }
+    *enigma = machine->enigma;
+    release_machine(cache, machine);
+    if (apply_indicator_setting(enigma, settings.indicator) != ENIGMA_OK) {
+        return false;
+    }
+    record->length = filter_letters(record->message, record->message, record->length);
+    read_record_key(procedure, ENGINE_REFERENCE, NULL, enigma, record);
+    return true;
+}
+
+/**
+ * Deciphers the indicator at the start of the (filtered) message of `record`, sent under
+ * `procedure`, with `enigma` at the indicator setting, and sets `enigma` to the message 
+ * key (see `read_message_key`). The indicator is then dropped from the message. Records 
+ * too short for an indicator, or with an inconsistent one, are reported on stderr.
+ */
+static void read_record_key(Procedure procedure, Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                            BatchRecord *record)
+{
+    if (procedure == PROCEDURE_NONE) {
+        return;
+    }
+    if (record->length < INDICATOR_LENGTH) {
+        fprintf(stderr, "Batch record \"%s\": too short for its indicator.\n", record->id);
+        record->length = 0;
+        return;
+    }
+    char indicator[INDICATOR_LENGTH + 1];
+    if (!read_message_key(procedure, engine, table, enigma, record->message, indicator)) {
+        fprintf(stderr, "Batch record \"%s\": inconsistent doubled indicator (%s).\n", record->id, indicator);
+    }
+    record->message += INDICATOR_LENGTH;
+    record->length -= INDICATOR_LENGTH;
+}
+
+/**
+ * Reads the message key from the INDICATOR_LENGTH letters at `letters`, the indicator of
+ * a message sent under `procedure`, using `engine` (and `table`), and sets the rotors of
+ * `enigma` to it. Places the indicator, deciphered, into `indicator`. Returns false if 
+ * the two copies of a doubled message key differ, in which case the first one is used.
+ *
+ * Under PROCEDURE_DOUBLED_INDICATOR, `enigma` must be at the indicator setting from the 
+ * key sheet. Under PROCEDURE_SINGLE_INDICATOR, the indicator setting is the first three
+ * letters, sent in the clear (and kept as they are in `indicator`).
+ */
+static b8 read_message_key(Procedure procedure, Engine engine, const EnigmaTable *table, Enigma *enigma, 
+                           const char *letters, char indicator[INDICATOR_LENGTH + 1])
+{
+    assert(procedure != PROCEDURE_NONE);
+    memcpy(indicator, letters, INDICATOR_LENGTH);
+    indicator[INDICATOR_LENGTH] = '\0';
+    const char *key = indicator;
+    if (procedure == PROCEDURE_SINGLE_INDICATOR) {
+        char setting[3 + 1] = {indicator[0], indicator[1], indicator[2], '\0'};
+        ENIGMA_ASSERT(apply_indicator_setting(enigma, setting) == ENIGMA_OK, "%s", enigma_error_message());
+        encipher_letters(engine, table, enigma, &indicator[3], &indicator[3], 3);
+        key = &indicator[3];
+    } else {
+        encipher_letters(engine, table, enigma, indicator, indicator, INDICATOR_LENGTH);
+    }
+
+    char setting[3 + 1] = {key[0], key[1], key[2], '\0'};
+    ENIGMA_ASSERT(apply_indicator_setting(enigma, setting) == ENIGMA_OK, "%s", enigma_error_message());
+    return procedure != PROCEDURE_DOUBLED_INDICATOR || memcmp(indicator, &indicator[3], 3) == 0;
+}
+
+/**
+ * Returns the settings of `record`, where empty settings default to `defaults`.
+ */
+static EnigmaSettings record_settings(const EnigmaSettings *defaults, const BatchRecord *record)
+{
+    return (EnigmaSettings) {
+        .reflector = (*record->settings.reflector != '\0') ? record->settings.reflector : defaults->reflector,
+        .rotors    = (*record->settings.rotors    != '\0') ? record->settings.rotors    : defaults->rotors,
+        .ring      = (*record->settings.ring      != '\0') ? record->settings.ring      : defaults->ring,
+        .plugboard = (*record->settings.plugboard != '\0') ? record->settings.plugboard : defaults->plugboard,
+        .indicator = (*record->settings.indicator != '\0') ? record->settings.indicator : defaults->indicator,
+    };
+}
+
+/**
+ * Orders pointers to batch records by descending message length (for qsort).
+ */
+static int compare_record_lengths(const void *a, const void *b)
+{
+    const BatchRecord *ra = *(BatchRecord *const *) a;
+    const BatchRecord *rb = *(BatchRecord *const *) b;
+    return (ra->length < rb->length) - (ra->length > rb->length);
+}
+
+/**
+ * `parallel_for` job which upper-cases and compacts (or unpacks) the letters of input 
+ * partition `job`.
+ */
+static void filter_partition(void *ctx, size_t job)
+{
+    ThreadedChunk *chunk = ctx;
+    size_t begin = job * chunk->input_partition_size;
+    size_t end = begin + chunk->input_partition_size;
+    end = (end < chunk->input_size) ? end : chunk->input_size;
+    char *letters = &chunk->letters[job * PARTITION_SIZE];
+    if (chunk->input_format == FORMAT_PACKED) {
+        Unpacker unpacker = {0};
+        chunk->lengths[job] = unpack_letters(&unpacker, letters, (const u8 *) &chunk->input[begin], end - begin);
+    } else {
+        chunk->lengths[job] = filter_letters(letters, &chunk->input[begin], end - begin);
+    }
+}
+
+/**
+ * `parallel_for` job which enciphers the (filtered) letters of partition `job` in place.
+ */
+static void encipher_partition(void *ctx, size_t job)
+{
+    ThreadedChunk *chunk = ctx;
+    Enigma enigma = chunk->start;
+    advance_enigma(&enigma, chunk->offsets[job]);
+    char *letters = &chunk->letters[job * PARTITION_SIZE];
+    encipher_letters(chunk->engine, chunk->table, &enigma, letters, letters, chunk->lengths[job]);
+}
+
+/**
+ * Enciphers the `length` letters at `letters` in place with `enigma`, split into 
+ * partitions which are enciphered on `n_threads` threads (see `encipher_partition`).
+ */
+static void encipher_letters_threaded(Engine engine, const EnigmaTable *table, const Enigma *enigma, 
+                                      char *letters, size_t length, size_t n_threads)
+{
+    if (length == 0) {
+        return;
+    }
+    size_t n_partitions = (length + PARTITION_SIZE - 1) / PARTITION_SIZE;
+    ThreadedChunk chunk = {
+        .engine  = engine,
+        .table   = table,
+        .start   = *enigma,
+        .letters = letters,
+        .lengths = malloc(n_partitions * sizeof(size_t)),
+        .offsets = malloc(n_partitions * sizeof(u64)),
+    };
+    ENIGMA_ASSERT(chunk.lengths != NULL && chunk.offsets != NULL, "Failed to allocate the partitions.");
+    for (size_t i = 0; i < n_partitions; i++) {
+        chunk.offsets[i] = i * PARTITION_SIZE;
+        chunk.lengths[i] = (length - chunk.offsets[i] < PARTITION_SIZE) ? length - chunk.offsets[i] : PARTITION_SIZE;
+    }
+    parallel_for(n_partitions, n_threads, encipher_partition, &chunk);
+    free(chunk.lengths);
+    free(chunk.offsets);
+}
+
+/**
+ * Creates a Unix domain socket listening at `path`, replacing any existing socket file.
+ */
+static int open_server_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    ENIGMA_ASSERT(strlen(path) < sizeof(addr.sun_path), "Socket path \"%s\" is too long.", path);
+    strcpy(addr.sun_path, path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ENIGMA_ASSERT(listen_fd >= 0, "Failed to create socket.");
+    unlink(path);
+    ENIGMA_ASSERT(bind(listen_fd, (const struct sockaddr *) &addr, sizeof(addr)) == 0, 
+                  "Failed to bind socket to \"%s\".", path);
+    ENIGMA_ASSERT(listen(listen_fd, SOMAXCONN) == 0, "Failed to listen on \"%s\".", path);
+    set_nonblocking(listen_fd);
+    return listen_fd;
+}
+
+/**
+ * Serves requests from any number of clients connecting to `listen_fd`, until killed. 
+ * Never returns.
+ *
+ * A request is a batch record in the binary format (see `encipher_batch`), with empty
+ * settings defaulting to `defaults`. The machines are taken from `cache`. The response consists of three fields in the same 
+ * format: the ID of the request, "ok" or "error", and the enciphered letters or the 
+ * error message, respectively. Clients may send any number of requests on a connection 
+ * without waiting for the responses, which are sent in the same order.
+ */
+static void serve(int listen_fd, MachineCache *cache, const EnigmaSettings *defaults)
+{
+    int epoll_fd = epoll_create1(0);
+    ENIGMA_ASSERT(epoll_fd >= 0, "Failed to create epoll instance.");
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    ENIGMA_ASSERT(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == 0, "Failed to poll socket.");
+    int reserve_fd = open("/dev/null", O_RDONLY); /* see `accept_connections` */
+    ENIGMA_ASSERT(reserve_fd >= 0, "Failed to open /dev/null.");
+
+    struct epoll_event events[MAX_EVENTS];
+    while (true) {
+        int n_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n_events < 0 && errno == EINTR) {
+            continue;
+        }
+        ENIGMA_ASSERT(n_events >= 0, "Failed to wait for events.");
+        for (int i = 0; i < n_events; i++) {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                accept_connections(epoll_fd, listen_fd, &reserve_fd);
+            } else if (!serve_connection(epoll_fd, conn, cache, defaults)) {
+                close_connection(conn);
+            }
+        }
+    }
+}
+
+/**
+ * Accepts all pending connections on `listen_fd` and registers them with `epoll_fd`.
+ *
+ * When out of file descriptors, a pending connection would keep `listen_fd` readable, 
+ * and `serve` would spin on it. `reserve_fd` is therefore given up to accept such a 
+ * connection and close it right away (so the client sees it refused), and reopened.
+ */
+static void accept_connections(int epoll_fd, int listen_fd, int *reserve_fd)
+{
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED)) {
+            continue; /* the client already gave up */
+        }
+        if (fd < 0 && (errno == EMFILE || errno == ENFILE) && *reserve_fd >= 0) {
+            close(*reserve_fd);
+            fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                close(fd);
+            }
+            *reserve_fd = open("/dev/null", O_RDONLY);
+            if (fd < 0) {
+                return; /* EMFILE is reported even when there is nothing to accept */
+            }
+            fprintf(stderr, "Out of file descriptors; refused a connection.\n");
+            continue;
+        }
+        if (fd < 0) {
+            if (errno != EAGAIN) {
+                fprintf(stderr, "Failed to accept a connection: %s.\n", strerror(errno));
+            }
+            return;
+        }
+        set_nonblocking(fd);
+        Connection *conn = calloc(1, sizeof(Connection));
+        ENIGMA_ASSERT(conn != NULL, "Failed to allocate connection.");
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        struct epoll_event event = {.events = conn->events, .data.ptr = conn};
+        ENIGMA_ASSERT(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0, "Failed to poll connection.");
+    }
+}
+
+/**
+ * Reads whatever `conn` has sent, answers all complete requests, and sends as much of 
+ * the responses as possible without blocking. Returns false if the connection should
+ * be closed (i.e. it is done, broken, or sent an oversized request).
+ *
+ * While more than MAX_PENDING_OUTPUT bytes of responses are waiting for the client to 
+ * read them, no more requests are read or answered, so a client which never reads can't
+ * make the daemon buffer without bound.
+ */
+static b8 serve_connection(int epoll_fd, Connection *conn, MachineCache *cache, const EnigmaSettings *defaults)
+{
+    /* read */
+    while (!conn->hung_up && conn->input.length < MAX_REQUEST_SIZE && 
+           conn->output.length - conn->n_sent_bytes <= MAX_PENDING_OUTPUT) {
+        if (conn->input.capacity - conn->input.length < CHUNK_SIZE) {
+            append_bytes(&conn->input, NULL, CHUNK_SIZE);
+            conn->input.length -= CHUNK_SIZE;
+        }
+        ssize_t n = read(conn->fd, &conn->input.data[conn->input.length], 
+                         conn->input.capacity - conn->input.length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+        if (n < 0) {
+            return false;
+        }
+        conn->hung_up = (n == 0);
+        conn->input.length += n;
+    }
+
+    b8 pending_output;
+    b8 backlogged;
+    do {
+        /* answer complete requests */
+        size_t offset = 0;
+        while (conn->output.length - conn->n_sent_bytes <= MAX_PENDING_OUTPUT) {
+            char *fields[7];
+            size_t lengths[7];
+            size_t n = parse_fields(&conn->input.data[offset], conn->input.length - offset, 7, fields, lengths);
+            if (n == 0) {
+                break;
+            }
+            offset += n;
+
+            BatchRecord record = {
+                .id       = fields[0],
+                .settings = {fields[1], fields[2], fields[3], fields[4], fields[5]},
+                .message  = fields[6],
+                .length   = lengths[6],
+            };
+            append_field(&conn->output, record.id, lengths[0]);
+            if (encipher_batch_record(cache, defaults, PROCEDURE_NONE, &record)) {
+                append_field(&conn->output, "ok", 2);
+                append_field(&conn->output, record.message, record.length);
+            } else {
+                append_field(&conn->output, "error", 5);
+                const char *message = enigma_error_message();
+                append_field(&conn->output, message, strlen(message));
+            }
+        }
+        conn->input.length -= offset;
+        memmove(conn->input.data, &conn->input.data[offset], conn->input.length);
+        backlogged = conn->output.length - conn->n_sent_bytes > MAX_PENDING_OUTPUT;
+        if (!backlogged && conn->input.length >= MAX_REQUEST_SIZE) {
+            return false;
+        }
+
+        /* write */
+        while (conn->n_sent_bytes < conn->output.length) {
+            ssize_t n = send(conn->fd, &conn->output.data[conn->n_sent_bytes], 
+                             conn->output.length - conn->n_sent_bytes, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) {
+                break;
+            }
+            if (n < 0) {
+                return false;
+            }
+            conn->n_sent_bytes += n;
+        }
+        pending_output = conn->n_sent_bytes < conn->output.length;
+        if (!pending_output) {
+            conn->output.length = 0;
+            conn->n_sent_bytes = 0;
+        }
+
+        /* if all output got sent, go on answering the requests held back by the backlog */
+    } while (backlogged && !pending_output);
+
+    /* 
+     * Only wait for the socket to become writable while there is output pending, and 
+     * for it to become readable while reading (a hung up socket is always readable). 
+     */
+    b8 reading = !conn->hung_up && conn->output.length - conn->n_sent_bytes <= MAX_PENDING_OUTPUT;
+    u32 events = (reading ? EPOLLIN : 0) | (pending_output ? EPOLLOUT : 0);
+    if (events == 0) {
+        return false; /* hung up, and all responses sent */
+    }
+    if (events != conn->events) {
+        struct epoll_event event = {.events = events, .data.ptr = conn};
+        ENIGMA_ASSERT(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) == 0, "Failed to poll connection.");
+        conn->events = events;
+    }
+    return true;
+}
+
+/**
+ * Closes `conn` and frees its resources.
+ */
+static void close_connection(Connection *conn)
+{
+    close(conn->fd); /* also removes it from the epoll instance */
+    free(conn->input.data);
+    free(conn->output.data);
+    free(conn);
+}
+
+/**
+ * Client side of `serve`: has the daemon listening on `path` encipher everything read 
+ * from `input_fd` using `settings`, and writes the result to `writer`. The daemon only 
+ * knows about settings and raw letters, so packed input is unpacked here, and the
+ * indicator setting sent is the rotor positions of `enigma` (i.e. of `settings` advanced
+ * by --offset). Returns the number of bytes read.
+ */
+static size_t encipher_remote(const char *path, const EnigmaSettings *settings, const Enigma *enigma,
+                              Format input_format, int input_fd, OutputWriter *writer)
+{
+    size_t size;
+    char *message = read_all(input_fd, &size);
+    size_t length = size;
+    if (input_format == FORMAT_PACKED) {
+        char *letters = malloc(size * 8 / 5 + 1);
+        ENIGMA_ASSERT(letters != NULL, "Failed to allocate buffer.");
+        Unpacker unpacker = {0};
+        length = unpack_letters(&unpacker, letters, (const u8 *) message, size);
+        free(message);
+        message = letters;
+    }
+    char indicator[] = {DECODE(enigma->rotor[0].position), ' ', DECODE(enigma->rotor[1].position), ' ', 
+                        DECODE(enigma->rotor[2].position)};
+    ByteBuffer request = {0};
+    append_field(&request, "0", 1);
+    append_field(&request, settings->reflector, strlen(settings->reflector));
+    append_field(&request, settings->rotors, strlen(settings->rotors));
+    append_field(&request, settings->ring, strlen(settings->ring));
+    append_field(&request, settings->plugboard, strlen(settings->plugboard));
+    append_field(&request, indicator, sizeof(indicator));
+    append_field(&request, message, length);
+    free(message);
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    ENIGMA_ASSERT(strlen(path) < sizeof(addr.sun_path), "Socket path \"%s\" is too long.", path);
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ENIGMA_ASSERT(fd >= 0, "Failed to create socket.");
+    ENIGMA_ASSERT(connect(fd, (const struct sockaddr *) &addr, sizeof(addr)) == 0, 
+                  "Failed to connect to \"%s\".", path);
+    write_fully(fd, request.data, request.length);
+    shutdown(fd, SHUT_WR);
+    free(request.data);
+
+    size_t response_size;
+    char *response = read_all(fd, &response_size);
+    close(fd);
+    char *fields[3];
+    size_t lengths[3];
+    ENIGMA_ASSERT(parse_fields(response, response_size, 3, fields, lengths) != 0, "Malformed response.");
+    ENIGMA_ASSERT(strcmp(fields[1], "ok") == 0, "%s", fields[2]);
+    write_output(writer, fields[2], lengths[2]);
+    free(response);
+    return size;
+}
+
+/**
+ * Appends the `length` bytes at `bytes` to `buffer`, growing it as necessary. If `bytes`
+ * is NULL, only makes room for them.
+ */
+static void append_bytes(ByteBuffer *buffer, const void *bytes, size_t length)
+{
+    if (buffer->capacity - buffer->length < length) {
+        size_t capacity = (buffer->capacity > 0) ? buffer->capacity : CHUNK_SIZE;
+        while (capacity - buffer->length < length) {
+            capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, capacity);
+        ENIGMA_ASSERT(buffer->data != NULL, "Failed to allocate buffer.");
+        buffer->capacity = capacity;
+    }
+    if (bytes != NULL) {
+        memcpy(&buffer->data[buffer->length], bytes, length);
+    }
+    buffer->length += length;
+}
+
+/**
+ * Appends `field` to `buffer`, prefixed by its `length` as a 32-bit little-endian integer.
+ */
+static void append_field(ByteBuffer *buffer, const char *field, size_t length)
+{
+    u8 prefix[4] = {length, length >> 8, length >> 16, length >> 24};
+    append_bytes(buffer, prefix, 4);
+    append_bytes(buffer, field, length);
+}
+
+/**
+ * Puts `fd` into non-blocking mode.
+ */
+static void set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    ENIGMA_ASSERT(flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0, 
+                  "Failed to make file descriptor non-blocking.");
+}
+
+/**
+ * Returns true if `fd` is open on a regular file (which can be memory-mapped), rather
+ * than e.g. a pipe, socket, or terminal.
+ */
+static b8 is_regular_file(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/**
+ * Returns true if the output `fd` can be resized and memory-mapped: a regular file open
+ * for both reading and writing, and not in append mode. Only holds for files opened by -o,
+ * never for e.g. a stdout redirected with `>` or `>>`.
+ */
+static b8 is_mappable_output(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && (flags & O_ACCMODE) == O_RDWR && !(flags & O_APPEND) && is_regular_file(fd);
+}
+
+/**
+ * Initializes an empty `cache` of machines for `engine`, using at most `max_size` bytes
+ * for machines not currently in use.
+ */
+static void init_machine_cache(MachineCache *cache, Engine engine, size_t max_size)
+{
+    *cache = (MachineCache) {
+        .engine   = engine,
+        .max_size = max_size,
+    };
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+/**
+ * Frees all machines of `cache`. None of them may be in use.
+ */
+static void free_machine_cache(MachineCache *cache)
+{
+    cache->max_size = 0;
+    evict_machines(cache);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+/**
+ * Returns a machine set up according to `settings`, except for the indicator setting,
+ * from `cache`. The settings are always parsed, but the machine is only cached (and 
+ * compiled) if no equal machine is. Returns NULL if the settings are invalid (see `enigma_error_message`). The machine must be 
+ * released with `release_machine` when done.
+ */
+static CachedMachine *acquire_machine(MachineCache *cache, const EnigmaSettings *settings)
+{
+    /* 
+     * The key is the configured machine rather than the settings, so that equal machines 
+     * given in different ways (e.g. plugboard settings "AB CD" and "CD AB") share an entry.
+     */
+    Enigma key = {0};
+    EnigmaSettings machine_settings = *settings;
+    machine_settings.indicator = NULL; /* applied by the caller */
+    if (configure_enigma(&key, &machine_settings) != ENIGMA_OK) {
+        return NULL;
+    }
+    u64 hash = hash_bytes((const char *) &key, sizeof(Enigma));
+    CachedMachine **bucket = &cache->buckets[hash & (CACHE_BUCKETS - 1)];
+
+    /* look it up */
+    pthread_mutex_lock(&cache->lock);
+    CachedMachine *machine = *bucket;
+    while (machine != NULL && (machine->hash != hash || memcmp(&machine->enigma, &key, sizeof(Enigma)) != 0)) {
+        machine = machine->next_in_bucket;
+    }
+    if (machine != NULL) {
+        cache->n_hits++;
+        machine->refs++;
+        /* move to the front of the LRU list */
+        if (machine != cache->head) {
+            machine->prev->next = machine->next;
+            if (machine->next != NULL) {
+                machine->next->prev = machine->prev;
+            } else {
+                cache->tail = machine->prev;
+            }
+            machine->prev = NULL;
+            machine->next = cache->head;
+            cache->head->prev = machine;
+            cache->head = machine;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return machine;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    /* compile it without holding the lock */
+    machine = calloc(1, sizeof(CachedMachine));
+    ENIGMA_ASSERT(machine != NULL, "Failed to allocate cached machine.");
+    machine->enigma = key;
+    if (cache->engine == ENGINE_TABLE) {
+        machine->table = malloc(sizeof(EnigmaTable));
+        ENIGMA_ASSERT(machine->table != NULL, "Failed to allocate the enigma table.");
+        compile_enigma(machine->table, &machine->enigma);
+    }
+    machine->hash = hash;
+    machine->refs = 1;
+
+    /* 
+     * Note: Another thread may have cached the same machine in the meantime. That's 
+     *       harmless; the duplicate simply ends up being evicted first.
+     */
+    pthread_mutex_lock(&cache->lock);
+    cache->n_misses++;
+    machine->next_in_bucket = *bucket;
+    *bucket = machine;
+    machine->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = machine;
+    } else {
+        cache->tail = machine;
+    }
+    cache->head = machine;
+    cache->size += sizeof(CachedMachine) + ((machine->table != NULL) ? sizeof(EnigmaTable) : 0);
+    pthread_mutex_unlock(&cache->lock);
+    return machine;
+}
+
+/**
+ * Releases `machine`, acquired from `cache` with `acquire_machine`.
+ */
+static void release_machine(MachineCache *cache, CachedMachine *machine)
+{
+    pthread_mutex_lock(&cache->lock);
+    machine->refs--;
+    evict_machines(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Evicts the least recently used machines not in use from `cache` until it fits its 
+ * `max_size`. Must be called with the lock held (or from a single thread).
+ */
+static void evict_machines(MachineCache *cache)
+{
+    CachedMachine *machine = cache->tail;
+    while (cache->size > cache->max_size && machine != NULL) {
+        CachedMachine *prev = machine->prev;
+        if (machine->refs > 0) {
+            machine = prev;
+            continue;
+        }
+
+        /* unlink from the bucket and the LRU list */
+        CachedMachine **link = &cache->buckets[machine->hash & (CACHE_BUCKETS - 1)];
+        while (*link != machine) {
+            link = &(*link)->next_in_bucket;
+        }
+        *link = machine->next_in_bucket;
+        if (prev != NULL) {
+            prev->next = machine->next;
+        } else {
+            cache->head = machine->next;
+        }
+        if (machine->next != NULL) {
+            machine->next->prev = prev;
+        } else {
+            cache->tail = prev;
+        }
+
+        cache->size -= sizeof(CachedMachine) + ((machine->table != NULL) ? sizeof(EnigmaTable) : 0);
+        free(machine->table);
+        free(machine);
+        machine = prev;
+    }
+}
+
+/**
+ * Returns the 64-bit FNV-1a hash of the `length` bytes at `bytes`.
+ */
+static u64 hash_bytes(const char *bytes, size_t length)
+{
+    u64 hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (u8) bytes[i]) * 0x100000001B3;
+    }
+    return hash;
+}
+
+/**
+ * Splits `str` into (at most `max_words`) space-separated words, in place, and places 
+ * them into `words`. Returns the number of words.
+ */
+static size_t split_words(char *str, const char *words[], size_t max_words)
+{
+    size_t n_words = 0;
+    char *save = NULL;
+    for (char *word = strtok_r(str, " ", &save); word != NULL; word = strtok_r(NULL, " ", &save)) {
+        ENIGMA_ASSERT(n_words < max_words, "Too many names in \"%s\" (max. %zu).", word, max_words);
+        words[n_words++] = word;
+    }
+    return n_words;
+}
+
+/**
+ * Unpacks the letters from the `length` bytes of packed input (see FORMAT_PACKED) at 
+ * `input` and places them into `letters`. Returns the number of letters. Bits which do
+ * not yet make up a whole letter are kept in `unpacker` for the next call. Values 
+ * outside of 0-25 (i.e. padding) are dropped. `letters` must have room for 
+ * (length * 8 / 5 + 1) letters.
+ */
+static size_t unpack_letters(Unpacker *unpacker, char *letters, const u8 *input, size_t length)
+{
+    char *wr = letters;
+    for (size_t i = 0; i < length; i++) {
+        unpacker->bits = (unpacker->bits << 8) | input[i];
+        unpacker->n_bits += 8;
+        while (unpacker->n_bits >= 5) {
+            unpacker->n_bits -= 5;
+            u8 n = (unpacker->bits >> unpacker->n_bits) & 0x1F;
+            if (n < 26) {
+                *wr++ = DECODE(n);
+            }
+        }
+        unpacker->bits &= (1u << unpacker->n_bits) - 1;
+    }
+    return wr - letters;
+}
+
+/**
+ * Initializes `writer` for output in `format` to `fd`. For FORMAT_GROUPED, the output is 
+ * split into groups of `group_size` letters and lines of `groups_per_line` groups (both 
+ * in [1, 64]).
+ */
+static void init_output_writer(OutputWriter *writer, Format format, size_t group_size, size_t groups_per_line, int fd)
+{
+    *writer = (OutputWriter) {
+        .format          = format,
+        .group_size      = group_size,
+        .groups_per_line = groups_per_line,
+        .row_size        = groups_per_line * (group_size + 1) + 1,
+        .buffer          = malloc(OUTPUT_BUFFER_SIZE),
+        .buffer_size     = OUTPUT_BUFFER_SIZE,
+        .fd              = fd,
+    };
+    ENIGMA_ASSERT(writer->buffer != NULL, "Failed to allocate the output buffer.");
+    ENIGMA_ASSERT(writer->row_size <= MAX_ROW_SIZE, "Invalid group size or groups per line.");
+    memset(writer->row_template, ' ', writer->row_size);
+    writer->row_template[writer->row_size - 1] = '\n';
+}
+
+/**
+ * Makes `writer` format its output directly into `buffer`, which is a memory-mapped 
+ * output file of `size` bytes. `size` must be exactly the size of the remaining output 
+ * (see `output_size`), and nothing may have been buffered yet. `buffer` is unmapped by 
+ * `free_output_writer`.
+ */
+static void map_output_writer(OutputWriter *writer, char *buffer, size_t size)
+{
+    ENIGMA_ASSERT(writer->buffer_length == 0, "Can't map the output after it has been written to.");
+    free(writer->buffer);
+    writer->buffer = buffer;
+    writer->buffer_size = size;
+    writer->mapped = true;
+}
+
+/**
+ * Frees the resources of `writer`. Does not flush.
+ */
+static void free_output_writer(OutputWriter *writer)
+{
+    if (writer->mapped) {
+        munmap(writer->buffer, writer->buffer_size);
+    } else {
+        free(writer->buffer);
+    }
+    writer->buffer = NULL;
+}
+
+/**
+ * Returns the number of bytes `writer` outputs for `n_letters` letters, including what 
+ * `finish_output` appends. `writer` must not have been written to yet.
+ */
+static size_t output_size(const OutputWriter *writer, u64 n_letters)
+{
+    switch (writer->format) {
+        case FORMAT_GROUPED: {
+            /* a space after every full group, a newline after every full line, and " \n" */
+            u64 n_groups = n_letters / writer->group_size;
+            return n_letters + n_groups + n_groups / writer->groups_per_line + 2;
+        }
+        case FORMAT_RAW:    return n_letters + 1;
+        case FORMAT_PACKED: return (n_letters * 5 + 7) / 8;
+    }
+    return 0;
+}
+
+/**
+ * Formats the `length` letters at `str` into the output buffer of `writer`. Consecutive
+ * calls continue where the previous call left off. The buffer is flushed whenever it 
+ * fills up.
+ */
+static void write_output(OutputWriter *writer, const char *str, size_t length)
+{
+    writer->n_letters += length;
+    switch (writer->format) {
+        case FORMAT_GROUPED: write_grouped(writer, str, length); break;
+        case FORMAT_RAW:     write_raw(writer, str, length); break;
+        case FORMAT_PACKED:  write_packed(writer, str, length); break;
+    }
+}
+
+/**
+ * FORMAT_GROUPED: Splits the letters into groups of `group_size` letters and lines of 
+ * `groups_per_line` groups. Every group is followed by a space.
+ */
+static void write_grouped(OutputWriter *writer, const char *str, size_t length)
+{
+    size_t group_size = writer->group_size;
+    size_t row_letters = group_size * writer->groups_per_line;
+    while (length > 0) {
+        /* make room for one row or group */
+        if (writer->buffer_length + writer->row_size > writer->buffer_size) {
+            flush_output(writer);
+        }
+        char *wr = &writer->buffer[writer->buffer_length];
+
+        /* fast path: a full line */
+        if (writer->column == 0 && writer->group == 0 && length >= row_letters) {
+            memcpy(wr, writer->row_template, writer->row_size);
+            for (size_t g = 0; g < writer->groups_per_line; g++) {
+                memcpy(&wr[g * (group_size + 1)], &str[g * group_size], group_size);
+            }
+            writer->buffer_length += writer->row_size;
+            str += row_letters;
+            length -= row_letters;
+            continue;
+        }
+
+        /* slow path: (the rest of) one group */
+        size_t n = group_size - writer->column;
+        n = (n < length) ? n : length;
+        memcpy(wr, str, n);
+        writer->buffer_length += n;
+        str += n;
+        length -= n;
+        writer->column += n;
+
+        if (writer->column == group_size) {
+            writer->column = 0;
+            writer->group++;
+            writer->buffer[writer->buffer_length++] = ' ';
+        }
+        if (writer->group == writer->groups_per_line) {
+            writer->group = 0;
+            writer->buffer[writer->buffer_length++] = '\n';
+        }
+    }
+}
+
+/**
+ * FORMAT_RAW: Writes the letters as they are.
+ */
+static void write_raw(OutputWriter *writer, const char *str, size_t length)
+{
+    while (length > 0) {
+        if (writer->buffer_length == writer->buffer_size) {
+            flush_output(writer);
+        }
+        size_t n = writer->buffer_size - writer->buffer_length;
+        n = (n < length) ? n : length;
+        memcpy(&writer->buffer[writer->buffer_length], str, n);
+        writer->buffer_length += n;
+        str += n;
+        length -= n;
+    }
+}
+
+/**
+ * FORMAT_PACKED: Writes the numerical encoding (0-25) of each letter using 5 bits, most
+ * significant bit first. I.e. every 8 letters are packed into 5 bytes.
+ */
+static void write_packed(OutputWriter *writer, const char *str, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        writer->bits = (writer->bits << 5) | ENCODE(str[i]);
+        writer->n_bits += 5;
+        if (writer->n_bits >= 8) {
+            if (writer->buffer_length == writer->buffer_size) {
+                flush_output(writer);
+            }
+            writer->n_bits -= 8;
+            writer->buffer[writer->buffer_length++] = (char) (writer->bits >> writer->n_bits);
+            writer->bits &= (1u << writer->n_bits) - 1;
+        }
+    }
+}
+
+/**
+ * Terminates the output and flushes it. 
+ *
+ * FORMAT_GROUPED: The (possibly empty) last group is followed by a space and the last 
+ *                 line is terminated.
+ * FORMAT_RAW:     The letters are followed by a newline.
+ * FORMAT_PACKED:  The last byte is padded with ones, which can't be mistaken for a letter,
+ *                 since 0x1F is outside of 0-25.
+ */
+static void finish_output(OutputWriter *writer)
+{
+    if (writer->buffer_length + 2 > writer->buffer_size) {
+        flush_output(writer);
+    }
+    switch (writer->format) {
+        case FORMAT_GROUPED: {
+            writer->buffer[writer->buffer_length++] = ' ';
+            writer->buffer[writer->buffer_length++] = '\n';
+            writer->column = 0;
+            writer->group = 0;
+        } break;
+        case FORMAT_RAW: {
+            writer->buffer[writer->buffer_length++] = '\n';
+        } break;
+        case FORMAT_PACKED: {
+            if (writer->n_bits > 0) {
+                u8 n_pad = 8 - writer->n_bits;
+                writer->buffer[writer->buffer_length++] = (char) ((writer->bits << n_pad) | ((1u << n_pad) - 1));
+                writer->bits = 0;
+                writer->n_bits = 0;
+            }
+        } break;
+    }
+    flush_output(writer);
+}
+
+/**
+ * Writes the buffered output of `writer` to its file descriptor. Does nothing if the 
+ * output is memory-mapped.
+ */
+static void flush_output(OutputWriter *writer)
+{
+    if (writer->mapped) {
+        return;
+    }
+    write_fully(writer->fd, writer->buffer, writer->buffer_length);
+    writer->buffer_length = 0;
+}
+
+/**
+ * Writes all `size` bytes at `buf` to `fd`.
+ */
+void write_fully(int fd, const char *buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ENIGMA_ASSERT(n >= 0, "Failed to write output.");
+        buf += n;
+        size -= n;
+    }
+}
+
+/**
+ * Calls `fn(ctx, job)` for every job in [0, n_jobs) using `n_threads` worker threads.
+ * Jobs are handed out to the workers in order, as they become available. Returns when 
+ * all jobs are done.
+ */
+void parallel_for(size_t n_jobs, size_t n_threads, void (*fn)(void *ctx, size_t job), void *ctx)
+{
+    ParallelFor pf = {
+        .fn     = fn,
+        .ctx    = ctx,
+        .n_jobs = n_jobs,
+    };
+    atomic_init(&pf.next_job, 0);
+
+    n_threads = (n_threads < n_jobs) ? n_threads : n_jobs;
+    pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+    ENIGMA_ASSERT(threads != NULL, "Failed to allocate threads.");
+    for (size_t i = 0; i < n_threads; i++) {
+        int err = pthread_create(&threads[i], NULL, parallel_for_worker, &pf);
+        ENIGMA_ASSERT(err == 0, "Failed to create thread.");
+    }
+    for (size_t i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/**
+ * Worker thread of `parallel_for`.
+ */
+static void *parallel_for_worker(void *arg)
+{
+    ParallelFor *pf = arg;
+    while (true) {
+        size_t job = atomic_fetch_add(&pf->next_job, 1);
+        if (job >= pf->n_jobs) {
+            break;
+        }
+        pf->fn(pf->ctx, job);
+    }
+    return NULL;
+}
+
+/**
+ * Reads from `fd` into `buf` until `size` bytes have been read or EOF is reached. Returns 
+ * the number of bytes read.
+ */
+size_t read_fully(int fd, char *buf, size_t size)
+{
+    size_t n_read_bytes = 0;
+    while (n_read_bytes < size) {
+        ssize_t n = read(fd, &buf[n_read_bytes], size - n_read_bytes);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ENIGMA_ASSERT(n >= 0, "Failed to read from stdin.");
+        if (n == 0) {
+            break;
+        }
+        n_read_bytes += n;
+    }
+    return n_read_bytes;
+}
+
+/**
+ * Reads from `fd` until EOF into a newly allocated buffer, which is NUL-terminated. 
+ * Stores the number of bytes read in `size`.
+ */
+static char *read_all(int fd, size_t *size)
+{
+    size_t capacity = CHUNK_SIZE;
+    char *data = malloc(capacity);
+    ENIGMA_ASSERT(data != NULL, "Failed to allocate the input buffer.");
+    size_t length = 0;
+    while (true) {
+        length += read_fully(fd, &data[length], capacity - 1 - length);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        data = realloc(data, capacity);
+        ENIGMA_ASSERT(data != NULL, "Failed to allocate the input buffer.");
+    }
+    data[length] = '\0';
+    *size = length;
+    return data;
+}
+
+/**
+ * Parses the name of an enciphering engine.
+ */
+static Engine parse_engine(const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    if (hgl_sv_equals(sv, HGL_SV("reference"))) {
+        return ENGINE_REFERENCE;
+    } else if (hgl_sv_equals(sv, HGL_SV("table"))) {
+        return ENGINE_TABLE;
+    } else if (hgl_sv_equals(sv, HGL_SV("simd"))) {
+        return ENGINE_SIMD;
+    } else if (hgl_sv_equals(sv, HGL_SV("segment"))) {
+        return ENGINE_SEGMENT;
+    }
+    ENIGMA_ERROR("Unknown engine \"%s\".", str);
+}
+
+/**
+ * Parses the name of an input or output format.
+ */
+static Format parse_format(const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    if (hgl_sv_equals(sv, HGL_SV("grouped"))) {
+        return FORMAT_GROUPED;
+    } else if (hgl_sv_equals(sv, HGL_SV("raw"))) {
+        return FORMAT_RAW;
+    } else if (hgl_sv_equals(sv, HGL_SV("packed"))) {
+        return FORMAT_PACKED;
+    }
+    ENIGMA_ERROR("Unknown format \"%s\".", str);
+}
+
+/**
+ * Parses the batch file format given by `str`.
+ */
+static BatchFormat parse_batch_format(const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    if (hgl_sv_equals(sv, HGL_SV("csv"))) {
+        return BATCH_CSV;
+    } else if (hgl_sv_equals(sv, HGL_SV("tsv"))) {
+        return BATCH_TSV;
+    } else if (hgl_sv_equals(sv, HGL_SV("binary"))) {
+        return BATCH_BINARY;
+    }
+    ENIGMA_ERROR("Unknown batch format \"%s\".", str);
+}
+
+/**
+ * Parses the name of an indicator procedure.
+ */
+static Procedure parse_procedure(const char *str)
+{
+    HglStringView sv = hgl_sv_from_cstr(str);
+    if (hgl_sv_equals(sv, HGL_SV("none"))) {
+        return PROCEDURE_NONE;
+    } else if (hgl_sv_equals(sv, HGL_SV("doubled-indicator"))) {
+        return PROCEDURE_DOUBLED_INDICATOR;
+    } else if (hgl_sv_equals(sv, HGL_SV("single-indicator"))) {
+        return PROCEDURE_SINGLE_INDICATOR;
+    }
+    ENIGMA_ERROR("Unknown indicator procedure \"%s\".", str);
 }
 
 
@@ -0,0 +1,94 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * Private declarations shared by the sources of enigma-cli: the basic types, the error
+ * macros, and the helpers which the cryptanalysis modules (enigma_search.c, and so on) 
+ * borrow from enigma_cli.c.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef ENIGMA_CLI_H
+#define ENIGMA_CLI_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "enigma.h"
+
+/*--- Public macros ---------------------------------------------------------------------*/
+
+#define ENIGMA_ASSERT(cond, ...)                \
+    if (!(cond)) {                              \
+        fprintf(stderr, "Error: " __VA_ARGS__); \
+        fprintf(stderr, "\n");                  \
+        exit(1);                                \
+    }
+#define ENIGMA_ERROR(...)                       \
+    do {                                        \
+        fprintf(stderr, "Error: " __VA_ARGS__); \
+        fprintf(stderr, "\n");                  \
+        exit(1);                                \
+    } while (0)
+
+#define ENCODE(c) ((c) - 'A') // maps A-Z  --> 0-25
+#define DECODE(n) ((n) + 'A') // maps 0-25 --> A->Z
+
+#define CHUNK_SIZE (64 * 1024) // input is read and enciphered in chunks of this size
+
+#define MAX_SEARCH_NAMES 8 // max. number of rotors (and reflectors) to choose from in a search
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+typedef bool      b8;
+typedef uint8_t   u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t    i8;
+typedef int16_t  i16;
+typedef int32_t  i32;
+typedef int64_t  i64;
+static_assert(sizeof(b8) == 1, "");
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/* Helpers */
+void parallel_for(size_t n_jobs, size_t n_threads, void (*fn)(void *ctx, size_t job), void *ctx);
+size_t read_fully(int fd, char *buf, size_t size);
+void write_fully(int fd, const char *buf, size_t size);
+size_t list_rotor_orders(size_t n_rotors, u8 (*orders)[3]);
+
+#endif /* ENIGMA_CLI_H */
@@ -0,0 +1,462 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * The plugboard search behind --search-plugboard, which hill-climbs (or anneals) on the
+ * n-gram score of the decryption, and the n-gram models it scores with; quantized tables
+ * built by --build-ngrams and memory-mapped, or n-gram counts quantized at load time.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#ifndef _POSIX_C_SOURCE
+#  define _POSIX_C_SOURCE 200809L /* for mmap, posix_madvise, etc. */
+#endif
+
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hgl_string.h"
+#include "enigma_plugboard.h"
+
+/*--- Private macros --------------------------------------------------------------------*/
+
+#define NGRAM_MAGIC "ENIGRAMS"  // identifies n-gram table files (see NgramFileHeader)
+#define ANNEALING_COOLING 0.9   // factor by which the annealing temperature drops per pass
+#define MIN_TEMPERATURE 0.01    // annealing temperature below which only improvements are kept
+
+/*--- Private type definitions ----------------------------------------------------------*/
+
+/*
+ * The header of an n-gram table file, as written by --build-ngrams. It is followed by the
+ * unigram, bigram, trigram, and quadgram tables, in that order; 26^n u16 scores each 
+ * (see NgramModel). All numbers are in native byte order.
+ */
+typedef struct {
+    char magic[8];                          /* NGRAM_MAGIC */
+    u32 max_n;                              /* MAX_NGRAM_LENGTH */
+    u32 reserved;
+    double min_log_prob[MAX_NGRAM_LENGTH];  /* see NgramModel */
+} NgramFileHeader;
+
+/*
+ * The shared state of a plugboard search (see `search_plugboard`).
+ */
+typedef struct {
+    const NgramModel *model;
+    const u8 *ciphertext;      /* encoded as 0-25 */
+    const u8 (*scrambler)[26]; /* scrambler[i] is the substitution performed by the rotors 
+                                  and reflector (i.e. the machine sans plugboard) at letter i */
+    size_t length;
+    const u8 *initial;         /* plugboard to start the first restart from */
+    size_t max_pairs;
+    double temperature;        /* initial annealing temperature (0 for pure hill-climbing) */
+    u8 (*plugboards)[26];      /* best plugboard found by each restart */
+    u64 *scores;               /* and its score (see `score_plugboard`) */
+} PlugboardSearch;
+
+/*--- Function prototypes ---------------------------------------------------------------*/
+
+static void search_plugboard_job(void *ctx, size_t job);
+static u64 score_plugboard(const PlugboardSearch *search, const u8 plugboard[26]);
+static b8 swap_plugs(u8 plugboard[26], u8 a, u8 b, size_t max_pairs);
+static double quantize_ngrams(const u64 *counts, size_t size, u16 *scores);
+static u64 next_random(u64 *state);
+
+/*--- Plugboard functions ---------------------------------------------------------------*/
+
+/**
+ * Recovers the plugboard of `enigma` (which is otherwise fully set up) from the `length`
+ * letters of ciphertext at `ciphertext` by hill-climbing on the n-gram score (see 
+ * `model`) of the decryption, using at most `max_pairs` plug pairs. With a non-zero 
+ * `temperature`, worse plugboards are accepted now and then (simulated annealing), with 
+ * a probability that drops as the temperature cools. The first of the `n_restarts` 
+ * restarts starts from `plugboard`, and the others from random plugboards. The restarts
+ * are run on `n_threads` threads. Places the best plugboard found into `plugboard` and 
+ * returns its score (see `score_plugboard`).
+ */
+u64 search_plugboard(const Enigma *enigma, const NgramModel *model, const char *ciphertext, 
+                     size_t length, size_t max_pairs, double temperature, size_t n_restarts,
+                     u8 plugboard[26], size_t n_threads)
+{
+    PlugboardSearch search = {
+        .model       = model,
+        .length      = length,
+        .initial     = plugboard,
+        .max_pairs   = max_pairs,
+        .temperature = temperature,
+    };
+    u8 *encoded = malloc(length);
+    u8 (*scrambler)[26] = malloc(length * sizeof(*scrambler));
+    search.plugboards = malloc(n_restarts * sizeof(*search.plugboards));
+    search.scores = malloc(n_restarts * sizeof(u64));
+    ENIGMA_ASSERT(encoded != NULL && scrambler != NULL && search.plugboards != NULL && search.scores != NULL, 
+                  "Failed to allocate the plugboard search.");
+
+    /* 
+     * The plugboard is applied on the way in and out, so with the substitution S_i of
+     * the rest of the machine at letter i, the decryption is P(S_i(P(c_i))). 
+     */
+    char *column = malloc(length);
+    ENIGMA_ASSERT(column != NULL, "Failed to allocate the plugboard search.");
+    for (u8 n = 0; n < 26; n++) {
+        Enigma e = *enigma;
+        ENIGMA_ASSERT(apply_plugboard_setting(&e, "") == ENIGMA_OK, "%s", enigma_error_message());
+        memset(column, DECODE(n), length);
+        encipher_letters(ENGINE_SEGMENT, NULL, &e, column, column, length);
+        for (size_t i = 0; i < length; i++) {
+            scrambler[i][n] = ENCODE(column[i]);
+        }
+    }
+    free(column);
+    for (size_t i = 0; i < length; i++) {
+        encoded[i] = ENCODE(ciphertext[i]);
+    }
+    search.ciphertext = encoded;
+    search.scrambler = (const u8 (*)[26]) scrambler;
+
+    parallel_for(n_restarts, n_threads, search_plugboard_job, &search);
+
+    size_t best = 0;
+    for (size_t i = 1; i < n_restarts; i++) {
+        if (search.scores[i] > search.scores[best]) {
+            best = i;
+        }
+    }
+    u64 best_score = search.scores[best];
+    memcpy(plugboard, search.plugboards[best], 26);
+    free(search.scores);
+    free(search.plugboards);
+    free(scrambler);
+    free(encoded);
+    return best_score;
+}
+
+/**
+ * `parallel_for` job which runs restart number `job` of a plugboard search. Every pass
+ * tries all 325 ways of plugging two letters together (see `swap_plugs`). The search 
+ * converges when the annealing has cooled down and a pass brings no improvement.
+ */
+static void search_plugboard_job(void *ctx, size_t job)
+{
+    PlugboardSearch *search = ctx;
+    u64 rng = 0x9E3779B97F4A7C15 * (job + 1);
+    u8 current[26];
+    if (job == 0) {
+        memcpy(current, search->initial, 26);
+    } else {
+        for (u8 n = 0; n < 26; n++) {
+            current[n] = n;
+        }
+        for (size_t i = 0; i < search->max_pairs; i++) {
+            swap_plugs(current, next_random(&rng) % 26, next_random(&rng) % 26, search->max_pairs);
+        }
+    }
+    u64 current_score = score_plugboard(search, current);
+    u8 *best = search->plugboards[job];
+    u64 best_score = current_score;
+    memcpy(best, current, 26);
+
+    double temperature = search->temperature;
+    b8 improved = true;
+    while (improved || temperature >= MIN_TEMPERATURE) {
+        improved = false;
+        for (u8 a = 0; a < 26; a++) {
+            for (u8 b = a + 1; b < 26; b++) {
+                u8 trial[26];
+                memcpy(trial, current, 26);
+                if (!swap_plugs(trial, a, b, search->max_pairs)) {
+                    continue;
+                }
+                u64 score = score_plugboard(search, trial);
+                double delta = ((double) score - (double) current_score) * search->model->step;
+                b8 accept = score > current_score;
+                if (!accept && temperature >= MIN_TEMPERATURE) {
+                    double u = (double) (next_random(&rng) >> 11) / 9007199254740992.0; /* [0, 1) */
+                    accept = u < exp(delta / temperature);
+                }
+                if (!accept) {
+                    continue;
+                }
+                memcpy(current, trial, 26);
+                current_score = score;
+                improved |= (delta > 0);
+                if (score > best_score) {
+                    best_score = score;
+                    memcpy(best, current, 26);
+                }
+            }
+        }
+        temperature *= ANNEALING_COOLING;
+    }
+    search->scores[job] = best_score;
+}
+
+/**
+ * Returns the n-gram score of the decryption of the ciphertext of `search` with 
+ * `plugboard`; i.e. the sum of the quantized scores of its n-grams (see NgramModel).
+ */
+static u64 score_plugboard(const PlugboardSearch *search, const u8 plugboard[26])
+{
+    const NgramModel *model = search->model;
+    size_t index = 0;
+    u64 score = 0;
+    for (size_t i = 0; i < search->length; i++) {
+        u8 n = plugboard[search->scrambler[i][plugboard[search->ciphertext[i]]]];
+        index = (index * 26 + n) % model->size;
+        if (i + 1 >= model->n) {
+            score += model->scores[index];
+        }
+    }
+    return score;
+}
+
+/**
+ * Plugs the letters `a` and `b` together on `plugboard`, first unplugging whatever they
+ * were plugged to, or unplugs them if they were already plugged together. Returns false
+ * (leaving `plugboard` in an undefined state) if this leaves more than `max_pairs` pairs,
+ * or if `a` equals `b`.
+ */
+static b8 swap_plugs(u8 plugboard[26], u8 a, u8 b, size_t max_pairs)
+{
+    if (a == b) {
+        return false;
+    }
+    if (plugboard[a] == b) {
+        plugboard[a] = a;
+        plugboard[b] = b;
+        return true;
+    }
+    plugboard[plugboard[a]] = plugboard[a];
+    plugboard[plugboard[b]] = plugboard[b];
+    plugboard[a] = b;
+    plugboard[b] = a;
+
+    size_t n_pairs = 0;
+    for (u8 n = 0; n < 26; n++) {
+        n_pairs += (plugboard[n] > n);
+    }
+    return n_pairs <= max_pairs;
+}
+
+/**
+ * Counts the unigrams through quadgrams of the letters read from `corpus_fd`, which may 
+ * be of any size, and writes the resulting n-gram table file (see NgramFileHeader) to 
+ * `output_fd`.
+ */
+void build_ngram_file(int corpus_fd, int output_fd)
+{
+    size_t sizes[MAX_NGRAM_LENGTH];
+    size_t total_size = 0;
+    for (size_t n = 0, size = 26; n < MAX_NGRAM_LENGTH; n++, size *= 26) {
+        sizes[n] = size;
+        total_size += size;
+    }
+    u64 *counts = calloc(total_size, sizeof(u64));
+    u16 *scores = malloc(total_size * sizeof(u16));
+    char *chunk = malloc(CHUNK_SIZE);
+    ENIGMA_ASSERT(counts != NULL && scores != NULL && chunk != NULL, "Failed to allocate the n-gram tables.");
+
+    /* `window` holds the last MAX_NGRAM_LENGTH letters, across chunks */
+    size_t window = 0;
+    u64 n_letters = 0;
+    while (true) {
+        size_t length = read_fully(corpus_fd, chunk, CHUNK_SIZE);
+        if (length == 0) {
+            break;
+        }
+        length = filter_letters(chunk, chunk, length);
+        for (size_t i = 0; i < length; i++) {
+            window = (window * 26 + ENCODE(chunk[i])) % sizes[MAX_NGRAM_LENGTH - 1];
+            n_letters++;
+            u64 *table = counts;
+            for (size_t n = 0; n < MAX_NGRAM_LENGTH; n++) {
+                if (n_letters > n) {
+                    table[window % sizes[n]]++;
+                }
+                table += sizes[n];
+            }
+        }
+    }
+    ENIGMA_ASSERT(n_letters >= MAX_NGRAM_LENGTH, "The corpus must contain at least %d letters.", MAX_NGRAM_LENGTH);
+
+    NgramFileHeader header = {.magic = NGRAM_MAGIC, .max_n = MAX_NGRAM_LENGTH};
+    size_t offset = 0;
+    for (size_t n = 0; n < MAX_NGRAM_LENGTH; n++) {
+        header.min_log_prob[n] = quantize_ngrams(&counts[offset], sizes[n], &scores[offset]);
+        offset += sizes[n];
+    }
+    write_fully(output_fd, (const char *) &header, sizeof(header));
+    write_fully(output_fd, (const char *) scores, total_size * sizeof(u16));
+    free(chunk);
+    free(scores);
+    free(counts);
+}
+
+/**
+ * Loads an n-gram model from `path`; either an n-gram table file built by --build-ngrams,
+ * of which the n-grams of length `n` are used, or a text file with one n-gram and its 
+ * count per line (e.g. "TION 13168375"), which is quantized on the fly. Tables are 
+ * memory-mapped, so loading even a quadgram model costs next to nothing.
+ */
+void load_ngram_model(NgramModel *model, const char *path, size_t n)
+{
+    *model = (NgramModel) {0};
+    int fd = open(path, O_RDONLY);
+    ENIGMA_ASSERT(fd >= 0, "Failed to open n-gram file \"%s\".", path);
+    struct stat st;
+    ENIGMA_ASSERT(fstat(fd, &st) == 0 && st.st_size > 0, "Failed to read n-gram file \"%s\".", path);
+    model->mapping_size = st.st_size;
+    model->mapping = mmap(NULL, model->mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    ENIGMA_ASSERT(model->mapping != MAP_FAILED, "Failed to map n-gram file \"%s\".", path);
+    close(fd);
+
+    /* n-gram table */
+    const NgramFileHeader *header = model->mapping;
+    if (model->mapping_size >= sizeof(NgramFileHeader) && 
+        memcmp(header->magic, NGRAM_MAGIC, sizeof(header->magic)) == 0) {
+        ENIGMA_ASSERT(header->max_n == MAX_NGRAM_LENGTH, "Unsupported n-gram table \"%s\".", path);
+        size_t offset = 0;
+        model->size = 1;
+        for (size_t i = 0; i < n; i++) {
+            offset += (model->size *= 26);
+        }
+        offset -= model->size;
+        ENIGMA_ASSERT(model->mapping_size >= sizeof(NgramFileHeader) + (offset + model->size) * sizeof(u16), 
+                      "Truncated n-gram table \"%s\".", path);
+        model->n = n;
+        model->scores = (const u16 *) (header + 1) + offset;
+        model->min_log_prob = header->min_log_prob[n - 1];
+        model->step = -model->min_log_prob / 65535;
+        posix_madvise(model->mapping, model->mapping_size, POSIX_MADV_WILLNEED);
+        return;
+    }
+
+    /* text file of n-gram counts */
+    u64 *counts = NULL;
+    HglStringView sv = hgl_sv_from(model->mapping, model->mapping_size);
+    while (sv.length > 0) {
+        HglStringView line = hgl_sv_trim(hgl_sv_lchop_until(&sv, '\n'));
+        if (line.length == 0) {
+            continue;
+        }
+        HglStringView ngram = hgl_sv_trim(hgl_sv_lchop_until(&line, ' '));
+        if (model->n == 0) {
+            ENIGMA_ASSERT(ngram.length >= 1 && ngram.length <= MAX_NGRAM_LENGTH, 
+                          "Unsupported n-gram length in \"%s\" (max. %d).", path, MAX_NGRAM_LENGTH);
+            model->n = ngram.length;
+            model->size = 1;
+            for (size_t i = 0; i < model->n; i++) {
+                model->size *= 26;
+            }
+            counts = calloc(model->size, sizeof(u64));
+            ENIGMA_ASSERT(counts != NULL, "Failed to allocate the n-gram counts.");
+        }
+        ENIGMA_ASSERT(ngram.length == model->n, "Invalid n-gram \"" HGL_SV_FMT "\" in \"%s\".", 
+                      HGL_SV_ARG(ngram), path);
+        size_t index = 0;
+        for (size_t i = 0; i < ngram.length; i++) {
+            char c = ngram.start[i];
+            c = (c >= 'a' && c <= 'z') ? (c - 0x20) : c;
+            ENIGMA_ASSERT(c >= 'A' && c <= 'Z', "Invalid n-gram \"" HGL_SV_FMT "\" in \"%s\".", 
+                          HGL_SV_ARG(ngram), path);
+            index = index * 26 + ENCODE(c);
+        }
+        counts[index] += hgl_sv_to_u64(hgl_sv_trim(line));
+    }
+    ENIGMA_ASSERT(counts != NULL, "No n-grams in \"%s\".", path);
+    munmap(model->mapping, model->mapping_size);
+    model->mapping = NULL;
+
+    model->owned_scores = malloc(model->size * sizeof(u16));
+    ENIGMA_ASSERT(model->owned_scores != NULL, "Failed to allocate the n-gram model.");
+    model->min_log_prob = quantize_ngrams(counts, model->size, model->owned_scores);
+    model->step = -model->min_log_prob / 65535;
+    model->scores = model->owned_scores;
+    free(counts);
+}
+
+/**
+ * Unmaps (or frees) the tables of `model`.
+ */
+void free_ngram_model(NgramModel *model)
+{
+    if (model->mapping != NULL) {
+        munmap(model->mapping, model->mapping_size);
+    }
+    free(model->owned_scores);
+    *model = (NgramModel) {0};
+}
+
+/**
+ * Quantizes the log-probabilities of the `size` n-grams with the given `counts` into 
+ * `scores` (see NgramModel), and returns the log-probability of score 0; that of an 
+ * n-gram with a count of 0.01.
+ */
+static double quantize_ngrams(const u64 *counts, size_t size, u16 *scores)
+{
+    u64 total = 0;
+    for (size_t i = 0; i < size; i++) {
+        total += counts[i];
+    }
+    ENIGMA_ASSERT(total > 0, "No n-grams to quantize.");
+    double min_log_prob = log10(0.01 / (double) total);
+    for (size_t i = 0; i < size; i++) {
+        double log_prob = (counts[i] > 0) ? log10((double) counts[i] / (double) total) : min_log_prob;
+        scores[i] = (u16) lround((log_prob - min_log_prob) / -min_log_prob * 65535);
+    }
+    return min_log_prob;
+}
+
+/**
+ * Converts the sum `score` of the n-gram scores of a text of `length` letters back into 
+ * a log-probability.
+ */
+double ngram_log_prob(const NgramModel *model, u64 score, size_t length)
+{
+    size_t n_ngrams = (length >= model->n) ? length - model->n + 1 : 0;
+    return (double) n_ngrams * model->min_log_prob + (double) score * model->step;
+}
+
+/**
+ * Returns the next number of the xorshift64* generator with state `state` (not 0).
+ */
+static u64 next_random(u64 *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1D;
+}
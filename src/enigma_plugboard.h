@@ -0,0 +1,84 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * Plugboard recovery of enigma-cli: the n-gram language models behind --ngrams and
+ * --build-ngrams, and the hill-climbing search behind --search-plugboard. See
+ * enigma_plugboard.c.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef ENIGMA_PLUGBOARD_H
+#define ENIGMA_PLUGBOARD_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include "enigma_cli.h"
+
+/*--- Public macros ---------------------------------------------------------------------*/
+
+#define MAX_NGRAM_LENGTH 4 // longest n-grams supported by an NgramModel
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+/*
+ * An n-gram language model. `scores[i]` is the quantized log-probability (base 10) of 
+ * the n-gram whose letters, encoded as 0-25, are the base-26 digits of i (most 
+ * significant first), so an n-gram is looked up with a single index which is updated 
+ * with one multiply-add per letter. The log-probability is (min_log_prob + score *
+ * step), where min_log_prob is that of n-grams never seen, and 65535 means a probability
+ * of 1. Since a sum of scores maps to a sum of log-probabilities in the same way, 
+ * decryptions of equal length can be compared by their score sums alone.
+ */
+typedef struct {
+    size_t n;
+    size_t size;          /* 26^n */
+    const u16 *scores;
+    double min_log_prob;
+    double step;          /* -min_log_prob / 65535 */
+    void *mapping;        /* the mapped n-gram file */
+    size_t mapping_size;
+    u16 *owned_scores;    /* the scores, if quantized from a text file at load time */
+} NgramModel;
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/* Plugboard search */
+u64 search_plugboard(const Enigma *enigma, const NgramModel *model, const char *ciphertext, 
+                     size_t length, size_t max_pairs, double temperature, size_t n_restarts,
+                     u8 plugboard[26], size_t n_threads);
+
+/* N-gram models */
+void build_ngram_file(int corpus_fd, int output_fd);
+void load_ngram_model(NgramModel *model, const char *path, size_t n);
+void free_ngram_model(NgramModel *model);
+double ngram_log_prob(const NgramModel *model, u64 score, size_t length);
+
+#endif /* ENIGMA_PLUGBOARD_H */
@@ -0,0 +1,473 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * The key searches behind --search-indicator and --search-ioc. Both try every indicator
+ * setting of every machine they are given, and split the work across threads with 
+ * `parallel_for`.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <string.h>
+#include <pthread.h>
+
+#include "enigma_search.h"
+
+/*--- Private type definitions ----------------------------------------------------------*/
+
+/*
+ * The shared state of an indicator search (see `search_indicator`). Indicator settings 
+ * are indexed by their packed rotor positions (left * 26 * 26 + middle * 26 + right).
+ */
+typedef struct {
+    const Enigma *enigma;   /* machine with the rotor order, rings, and plugboard set up */
+    const char *ciphertext; /* the ciphertext letters under the crib */
+    const char *crib;
+    size_t crib_length;
+    u64 crib_offset;
+    b8 *matches;            /* matches[pos] is set if indicator setting `pos` fits the crib */
+} IndicatorSearch;
+
+/*
+ * The scratch space of a thread taking part in a ciphertext-only search. 
+ */
+typedef struct {
+    EnigmaTable *table;
+    Enigma *keys;     /* with `bitsliced`: the keys of all indicator settings, and their scores */
+    u64 *scores;
+    Candidate *heap;  /* min-heap (by score) of the best candidates found by this thread */
+    size_t heap_size;
+} SearchSlot;
+
+/*
+ * The shared state of a ciphertext-only search (see `search_ioc`). Every job takes a 
+ * free slot when it starts and puts it back when done, so no two threads ever share a 
+ * slot, and there are never more slots in use than threads.
+ */
+typedef struct {
+    const Enigma *enigma;     /* machine with the left ring setting and plugboard set up */
+    const char *letters;      /* the ciphertext */
+    const u8 *ciphertext;     /* encoded as 0-25 */
+    size_t length;
+    const char **reflectors;
+    size_t n_reflectors;
+    const char **rotors;
+    u8 (*orders)[3];          /* all rotor orders; indices into `rotors` */
+    size_t n_orders;
+    b8 search_rings;          /* also try all right ring settings, and the middle ones in `refine_candidate` */
+    b8 bitsliced;             /* score with `score_keys` rather than compiled tables */
+    size_t top_k;
+    SearchSlot *slots;
+    size_t *free_slots;
+    size_t n_free_slots;
+    pthread_mutex_t lock;
+} IocSearch;
+
+/*--- Function prototypes ---------------------------------------------------------------*/
+
+static void search_indicator_job(void *ctx, size_t job);
+static void search_ioc_job(void *ctx, size_t job);
+static void setup_candidate(const IocSearch *search, const Candidate *candidate, Enigma *enigma);
+static void refine_candidate(const IocSearch *search, const char *ciphertext, Candidate *candidate);
+static u64 score_ioc(const EnigmaTable *table, u16 pos, const u8 *ciphertext, size_t length, u64 threshold);
+static void push_candidate(Candidate *heap, size_t *heap_size, size_t top_k, Candidate candidate);
+static int compare_candidates(const void *a, const void *b);
+
+/*--- Search functions ------------------------------------------------------------------*/
+
+/**
+ * Tries every indicator setting (i.e. all 17,576 rotor start positions) on `enigma`, and 
+ * sets `matches[pos]` for those under which the ciphertext letters at `ciphertext` decipher
+ * to the `crib_length` letters at `crib`, starting `crib_offset` letters into the message.
+ * The positions are split across `n_threads` threads. Returns the number of matches.
+ */
+size_t search_indicator(const Enigma *enigma, const char *ciphertext, const char *crib, 
+                        size_t crib_length, u64 crib_offset, b8 *matches, size_t n_threads)
+{
+    IndicatorSearch search = {
+        .enigma      = enigma,
+        .ciphertext  = ciphertext,
+        .crib        = crib,
+        .crib_length = crib_length,
+        .crib_offset = crib_offset,
+        .matches     = matches,
+    };
+    parallel_for(N_POSITIONS / 26, n_threads, search_indicator_job, &search);
+
+    size_t n_matches = 0;
+    for (size_t pos = 0; pos < N_POSITIONS; pos++) {
+        n_matches += matches[pos];
+    }
+    return n_matches;
+}
+
+/**
+ * `parallel_for` job which tries the 26 indicator settings with the left and middle rotor
+ * positions given by `job`. A candidate is rejected at the first crib letter it does not
+ * reproduce, so most candidates cost a single keypress.
+ */
+static void search_indicator_job(void *ctx, size_t job)
+{
+    const IndicatorSearch *search = ctx;
+    for (u8 right = 0; right < 26; right++) {
+        Enigma e = *search->enigma;
+        e.rotor[0].position = job / 26;
+        e.rotor[1].position = job % 26;
+        e.rotor[2].position = right;
+        advance_enigma(&e, search->crib_offset);
+
+        size_t i = 0;
+        while (i < search->crib_length && 
+               encipher_char(&e, search->ciphertext[i]) == search->crib[i]) {
+            i++;
+        }
+        search->matches[job * 26 + right] = (i == search->crib_length);
+    }
+}
+
+/**
+ * Ciphertext-only search for the reflector, rotor order, and indicator setting (and, if
+ * `search_rings` is set, the middle and right ring settings) of `enigma`, whose plugboard
+ * and left ring setting are assumed to be known (or empty). The reflectors and rotors 
+ * are chosen from the `n_reflectors` and `n_rotors` (at most MAX_SEARCH_NAMES) names at
+ * `reflectors` and `rotors`. Every candidate deciphers the `length` letters at 
+ * `ciphertext`, and the `top_k` candidates whose decryptions have the highest index of 
+ * coincidence are placed into `results`, best first. Returns the number of results.
+ *
+ * Each rotor order (and ring setting) is compiled into a table once, after which trying
+ * all 17,576 indicator settings is a matter of table lookups. Each thread keeps its own 
+ * top-k heap, and abandons a candidate as soon as its decryption can no longer make it 
+ * into the heap. The heaps are merged at the end.
+ *
+ * Shifting the ring setting and position of a rotor by the same amount leaves its 
+ * substitution alone, and only moves its notch. The notch of the middle rotor only 
+ * matters when it steps the left rotor, i.e. at most once every 650 letters, so keys 
+ * that differ by such a shift of the middle rotor mostly give the same decryption. With 
+ * `search_rings`, only the canonical middle ring setting (1) is therefore searched, 
+ * and each result is then replaced by the best key of its class (see `refine_candidate`),
+ * which makes the ring search 26 times faster. (The notch of the left rotor never 
+ * matters, so its ring setting is fully interchangeable with its position.)
+ *
+ * With `bitsliced`, all indicator settings are scored by `score_keys` instead, without
+ * abandoning any. This gives the same results, but was slower in the builds measured.
+ */
+size_t search_ioc(const Enigma *enigma, const char *ciphertext, size_t length, 
+                  const char **reflectors, size_t n_reflectors, const char **rotors, size_t n_rotors,
+                  b8 search_rings, b8 bitsliced, size_t top_k, Candidate *results, size_t n_threads)
+{
+    IocSearch search = {
+        .enigma       = enigma,
+        .letters      = ciphertext,
+        .length       = length,
+        .reflectors   = reflectors,
+        .n_reflectors = n_reflectors,
+        .rotors       = rotors,
+        .search_rings = search_rings,
+        .bitsliced    = bitsliced,
+        .top_k        = top_k,
+    };
+
+    search.orders = malloc(n_rotors * n_rotors * n_rotors * sizeof(*search.orders));
+    ENIGMA_ASSERT(search.orders != NULL, "Failed to allocate the rotor orders.");
+    search.n_orders = list_rotor_orders(n_rotors, search.orders);
+
+    u8 *encoded = malloc(length);
+    ENIGMA_ASSERT(encoded != NULL, "Failed to allocate the ciphertext.");
+    for (size_t i = 0; i < length; i++) {
+        encoded[i] = ENCODE(ciphertext[i]);
+    }
+    search.ciphertext = encoded;
+
+    size_t n_jobs = n_reflectors * search.n_orders * (search_rings ? 26 : 1);
+    n_threads = (n_threads < n_jobs) ? n_threads : n_jobs;
+    search.slots = calloc(n_threads, sizeof(SearchSlot));
+    search.free_slots = malloc(n_threads * sizeof(size_t));
+    ENIGMA_ASSERT(search.slots != NULL && search.free_slots != NULL, "Failed to allocate the search slots.");
+    for (size_t i = 0; i < n_threads; i++) {
+        SearchSlot *slot = &search.slots[i];
+        if (bitsliced) {
+            slot->keys = malloc(N_POSITIONS * sizeof(Enigma));
+            slot->scores = malloc(N_POSITIONS * sizeof(u64));
+            ENIGMA_ASSERT(slot->keys != NULL && slot->scores != NULL, "Failed to allocate the search slots.");
+        } else {
+            slot->table = malloc(sizeof(EnigmaTable));
+            ENIGMA_ASSERT(slot->table != NULL, "Failed to allocate the search slots.");
+        }
+        slot->heap = malloc(top_k * sizeof(Candidate));
+        ENIGMA_ASSERT(slot->heap != NULL, "Failed to allocate the search slots.");
+        search.free_slots[search.n_free_slots++] = i;
+    }
+    pthread_mutex_init(&search.lock, NULL);
+    parallel_for(n_jobs, n_threads, search_ioc_job, &search);
+    pthread_mutex_destroy(&search.lock);
+
+    /* merge the heaps */
+    size_t n_results = 0;
+    for (size_t i = 0; i < n_threads; i++) {
+        for (size_t j = 0; j < search.slots[i].heap_size; j++) {
+            push_candidate(results, &n_results, top_k, search.slots[i].heap[j]);
+        }
+        free(search.slots[i].table);
+        free(search.slots[i].keys);
+        free(search.slots[i].scores);
+        free(search.slots[i].heap);
+    }
+    if (search_rings) {
+        for (size_t i = 0; i < n_results; i++) {
+            refine_candidate(&search, ciphertext, &results[i]);
+        }
+    }
+    qsort(results, n_results, sizeof(Candidate), compare_candidates);
+    free(search.slots);
+    free(search.free_slots);
+    free(search.orders);
+    free(encoded);
+    return n_results;
+}
+
+/**
+ * `parallel_for` job which sets up one reflector, rotor order, and ring setting, and 
+ * tries all indicator settings with it; by compiling it, or with `score_keys`.
+ */
+static void search_ioc_job(void *ctx, size_t job)
+{
+    IocSearch *search = ctx;
+    size_t n_ring_settings = search->search_rings ? 26 : 1;
+    size_t ring_setting = job % n_ring_settings;
+    size_t order = (job / n_ring_settings) % search->n_orders;
+    size_t reflector = job / n_ring_settings / search->n_orders;
+
+    /* take a free slot */
+    pthread_mutex_lock(&search->lock);
+    size_t slot_index = search->free_slots[--search->n_free_slots];
+    pthread_mutex_unlock(&search->lock);
+    SearchSlot *slot = &search->slots[slot_index];
+
+    /* set up the machine */
+    Candidate candidate = {
+        .reflector = reflector,
+        .rotors    = {search->orders[order][0], search->orders[order][1], search->orders[order][2]},
+        .rings     = {search->enigma->rotor[0].ring_setting, search->enigma->rotor[1].ring_setting, 
+                      search->enigma->rotor[2].ring_setting},
+    };
+    if (search->search_rings) {
+        candidate.rings[1] = 0; /* canonical; see `search_ioc` */
+        candidate.rings[2] = ring_setting;
+    }
+    Enigma enigma;
+    setup_candidate(search, &candidate, &enigma);
+    if (search->bitsliced) {
+        for (u16 pos = 0; pos < N_POSITIONS; pos++) {
+            slot->keys[pos] = enigma;
+            slot->keys[pos].rotor[0].position = pos / (26 * 26);
+            slot->keys[pos].rotor[1].position = (pos / 26) % 26;
+            slot->keys[pos].rotor[2].position = pos % 26;
+        }
+        ENIGMA_ASSERT(score_keys(slot->keys, N_POSITIONS, search->letters, search->length, slot->scores) != 0,
+                      "Failed to allocate the bitsliced scorer.");
+        for (u16 pos = 0; pos < N_POSITIONS; pos++) {
+            candidate.score = slot->scores[pos];
+            candidate.position = pos;
+            push_candidate(slot->heap, &slot->heap_size, search->top_k, candidate);
+        }
+    } else {
+        compile_enigma(slot->table, &enigma);
+        for (u16 pos = 0; pos < N_POSITIONS; pos++) {
+            u64 threshold = (slot->heap_size == search->top_k) ? slot->heap[0].score : 0;
+            candidate.score = score_ioc(slot->table, pos, search->ciphertext, search->length, threshold);
+            candidate.position = pos;
+            push_candidate(slot->heap, &slot->heap_size, search->top_k, candidate);
+        }
+    }
+
+    /* put the slot back */
+    pthread_mutex_lock(&search->lock);
+    search->free_slots[search->n_free_slots++] = slot_index;
+    pthread_mutex_unlock(&search->lock);
+}
+
+/**
+ * Sets up `enigma` (but not its rotor positions) with the reflector, rotor order, and 
+ * ring setting of `candidate`.
+ */
+static void setup_candidate(const IocSearch *search, const Candidate *candidate, Enigma *enigma)
+{
+    char rotor_setting[64];
+    snprintf(rotor_setting, sizeof(rotor_setting), "%s %s %s", search->rotors[candidate->rotors[0]], 
+             search->rotors[candidate->rotors[1]], search->rotors[candidate->rotors[2]]);
+    *enigma = *search->enigma;
+    ENIGMA_ASSERT(apply_reflector_setting(enigma, search->reflectors[candidate->reflector]) == ENIGMA_OK &&
+                  apply_rotor_setting(enigma, rotor_setting) == ENIGMA_OK, "%s", enigma_error_message());
+    for (int i = 0; i < 3; i++) {
+        enigma->rotor[i].ring_setting = candidate->rings[i];
+    }
+}
+
+/**
+ * Replaces `candidate`, found with the canonical middle ring setting, by the best of the
+ * 26 keys which shift its middle ring setting and position by the same amount (see 
+ * `search_ioc`), by deciphering the `search->length` letters at `ciphertext` with each 
+ * of them. Sets `candidate->equivalents` to the shifts of the new candidate that give 
+ * the very same decryption; these keys are indistinguishable on the ciphertext.
+ */
+static void refine_candidate(const IocSearch *search, const char *ciphertext, Candidate *candidate)
+{
+    size_t length = search->length;
+    char *decryptions = malloc(26 * length);
+    ENIGMA_ASSERT(decryptions != NULL, "Failed to allocate the decryptions.");
+    Enigma enigma;
+    setup_candidate(search, candidate, &enigma);
+
+    u64 scores[26];
+    u8 best = 0;
+    for (u8 k = 0; k < 26; k++) {
+        Enigma member = enigma;
+        member.rotor[0].position = candidate->position / (26 * 26);
+        member.rotor[1].position = (candidate->position / 26 + k) % 26;
+        member.rotor[2].position = candidate->position % 26;
+        member.rotor[1].ring_setting = (candidate->rings[1] + k) % 26;
+        char *decryption = &decryptions[k * length];
+        encipher_letters(ENGINE_REFERENCE, NULL, &member, decryption, ciphertext, length);
+
+        u32 counts[26] = {0};
+        scores[k] = 0;
+        for (size_t i = 0; i < length; i++) {
+            scores[k] += 2 * counts[ENCODE(decryption[i])]++;
+        }
+        best = (scores[k] > scores[best]) ? k : best;
+    }
+
+    candidate->equivalents = 0;
+    for (u8 k = 0; k < 26; k++) {
+        if (memcmp(&decryptions[k * length], &decryptions[best * length], length) == 0) {
+            candidate->equivalents |= 1u << ((k + 26 - best) % 26);
+        }
+    }
+    candidate->score = scores[best];
+    candidate->rings[1] = (candidate->rings[1] + best) % 26;
+    candidate->position = (candidate->position / (26 * 26)) * 26 * 26 
+                        + ((candidate->position / 26 + best) % 26) * 26 + candidate->position % 26;
+    free(decryptions);
+}
+
+/**
+ * Deciphers the `length` letters (encoded as 0-25) at `ciphertext` with the compiled 
+ * machine `table`, starting at the rotor position `pos`, and returns the sum of 
+ * n * (n - 1) over the letter counts n of the decryption; i.e. its index of coincidence
+ * times length * (length - 1). Returns 0 as soon as the result is certain not to exceed 
+ * `threshold`.
+ */
+static u64 score_ioc(const EnigmaTable *table, u16 pos, const u8 *ciphertext, size_t length, u64 threshold)
+{
+    u32 counts[26] = {0};
+    u32 max_count = 0;
+    u64 score = 0;
+    for (size_t i = 0; i < length; i++) {
+        pos = table->next[pos];
+        u8 n = ENCODE(table->image[pos].image[ciphertext[i]]);
+        score += 2 * counts[n]; /* (c + 1) * c - c * (c - 1) = 2c */
+        counts[n]++;
+        max_count = (counts[n] > max_count) ? counts[n] : max_count;
+
+        /* 
+         * At best, the remaining r letters all decipher to the most common letter so far,
+         * which adds (m + r) * (m + r - 1) - m * (m - 1) = 2mr + r(r - 1) to the score.
+         */
+        if (threshold > 0 && i % 16 == 15) {
+            u64 r = length - i - 1;
+            if (score + 2 * max_count * r + r * (r - 1) <= threshold) {
+                return 0;
+            }
+        }
+    }
+    return score;
+}
+
+/**
+ * Pushes `candidate` onto the min-heap `heap` of the (at most) `top_k` best candidates, 
+ * displacing the worst one if the heap is full.
+ */
+static void push_candidate(Candidate *heap, size_t *heap_size, size_t top_k, Candidate candidate)
+{
+    size_t i;
+    if (*heap_size < top_k) {
+        /* sift up from the bottom */
+        i = (*heap_size)++;
+        while (i > 0 && heap[(i - 1) / 2].score > candidate.score) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = candidate;
+        return;
+    }
+    if (candidate.score <= heap[0].score) {
+        return;
+    }
+
+    /* replace the root and sift down */
+    i = 0;
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= top_k) {
+            break;
+        }
+        if (child + 1 < top_k && heap[child + 1].score < heap[child].score) {
+            child++;
+        }
+        if (heap[child].score >= candidate.score) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = candidate;
+}
+
+/**
+ * `qsort` comparator which orders candidates by descending score, and, for equal scores,
+ * by reflector, rotor order, ring setting, and position.
+ */
+static int compare_candidates(const void *a, const void *b)
+{
+    const Candidate *ca = a;
+    const Candidate *cb = b;
+    if (ca->score != cb->score) {
+        return (ca->score < cb->score) ? 1 : -1;
+    }
+    u8 ka[8] = {ca->reflector, ca->rotors[0], ca->rotors[1], ca->rotors[2], ca->rings[0], ca->rings[1], ca->rings[2]};
+    u8 kb[8] = {cb->reflector, cb->rotors[0], cb->rotors[1], cb->rotors[2], cb->rings[0], cb->rings[1], cb->rings[2]};
+    int cmp = memcmp(ka, kb, sizeof(ka));
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (int) ca->position - (int) cb->position;
+}
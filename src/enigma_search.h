@@ -0,0 +1,70 @@
+
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2025 Henrik A. Glass
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ *
+ * ABOUT:
+ * 
+ * Key searches of enigma-cli: the known-plaintext search for the indicator setting behind
+ * --search-indicator, and the ciphertext-only search ranked by index of coincidence behind
+ * --search-ioc. See enigma_search.c.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef ENIGMA_SEARCH_H
+#define ENIGMA_SEARCH_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include "enigma_cli.h"
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+/*
+ * A candidate key found by a ciphertext-only search (see `search_ioc`). The reflector and
+ * rotors are indices into the names given to the search.
+ */
+typedef struct {
+    u64 score;        /* sum of n * (n - 1) over the letter counts n of the decryption */
+    u8 reflector;
+    u8 rotors[3];
+    u8 rings[3];
+    u16 position;     /* packed indicator setting */
+    u32 equivalents;  /* bit k is set if shifting the middle ring and position by k gives the
+                         same decryption (see `refine_candidate`) */
+} Candidate;
+
+/*--- Public functions ------------------------------------------------------------------*/
+
+/* Key searches */
+size_t search_indicator(const Enigma *enigma, const char *ciphertext, const char *crib, 
+                        size_t crib_length, u64 crib_offset, b8 *matches, size_t n_threads);
+size_t search_ioc(const Enigma *enigma, const char *ciphertext, size_t length, 
+                  const char **reflectors, size_t n_reflectors, const char **rotors, size_t n_rotors,
+                  b8 search_rings, b8 bitsliced, size_t top_k, Candidate *results, size_t n_threads);
+
+#endif /* ENIGMA_SEARCH_H */
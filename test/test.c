@@ -1,7 +1,19 @@
 
+#define HGL_FLAGS_MAX_N_FLAGS 64
 #include "hgl_test.h"
 
+/* 
+ * The library and the CLI are tested as a single compilation unit, so that the tests may 
+ * reach their private functions. The library holds the hgl_string.h implementation, and
+ * the CLI is made up of enigma_cli.c and its cryptanalysis modules.
+ */
+#include "enigma.c"
+#undef HGL_STRING_IMPLEMENTATION
 #include "enigma_cli.c"
+#include "enigma_search.c"
+#include "enigma_plugboard.c"
+#include "enigma_bombe.c"
+#include "enigma_catalog.c"
 
 GLOBAL_SETUP {
     hgl_flags_reset();
@@ -220,6 +232,729 @@ TEST(
     exit(exit_code);
 }
 
+TEST(
+    test_output_formatting_3, 
+    .input =         "AAAAAAAAAAAAAAAAA",
+    .expect_output = "BDZG OWCX \nLTKS BTMC \nD \n"
+) {
+    char *argv[] = {"0", "-G", "4", "-N", "2"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_raw_format, 
+    .input =         "AAAAA AAAAA",
+    .expect_output = "BDZGOWCXLT\n"
+) {
+    char *argv[] = {"0", "-f", "raw"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_packed_format, 
+    .input =         "AAA",
+    .expect_output = "\x08\xF3"
+) {
+    char *argv[] = {"0", "-f", "packed"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_packed_input_format, 
+    .input =         "\x08\xF3",
+    .expect_output = "AAA\n"
+) {
+    char *argv[] = {"0", "--input-format", "packed", "-f", "raw"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_invalid_format_setting_1, 
+    .expect_exit_code = 1,
+) {
+    char *argv[] = {"0", "-f", "hex"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(test_mapped_file_input_output) {
+    char input_path[] = "/tmp/enigma-test-input-XXXXXX";
+    char output_path[] = "/tmp/enigma-test-output-XXXXXX";
+    int input_fd = mkstemp(input_path);
+    int output_fd = mkstemp(output_path);
+    ASSERT(input_fd >= 0 && output_fd >= 0);
+    write_fully(input_fd, "AAAAAAAAAAAAAAAAA", 17);
+    close(input_fd);
+    close(output_fd);
+
+    char *argv[] = {"0", "-G", "4", "-N", "2", "-i", input_path, "-o", output_path};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    ASSERT(enigma_cli_main(argc, argv) == 0);
+
+    char output[64] = {0};
+    output_fd = open(output_path, O_RDONLY);
+    ASSERT(read(output_fd, output, sizeof(output) - 1) == 25);
+    ASSERT_CSTR_EQ(output, "BDZG OWCX \nLTKS BTMC \nD \n");
+    close(output_fd);
+    unlink(input_path);
+    unlink(output_path);
+}
+
+TEST(test_mapped_file_windows) {
+    /* an input spanning several windows is enciphered as one continuous message */
+    size_t input_size = 3 * 1024 * 1024 + 123;
+    char *input = malloc(input_size);
+    for (size_t i = 0; i < input_size; i++) {
+        input[i] = (i % 7 == 6) ? ' ' : 'A' + (i * 31 % 26);
+    }
+    char input_path[] = "/tmp/enigma-test-input-XXXXXX";
+    char output_path[] = "/tmp/enigma-test-output-XXXXXX";
+    int input_fd = mkstemp(input_path);
+    int output_fd = mkstemp(output_path);
+    ASSERT(input_fd >= 0 && output_fd >= 0);
+    write_fully(input_fd, input, input_size);
+    close(input_fd);
+    close(output_fd);
+
+    char *argv[] = {"0", "-f", "raw", "-t", "1", "-s", "AB CD", "-i", input_path, "-o", output_path};
+    int argc = sizeof(argv) / sizeof(argv[0]);
+    ASSERT(enigma_cli_main(argc, argv) == 0);
+
+    Enigma enigma = {0};
+    EnigmaSettings settings = {.reflector = "UKW-B", .rotors = "I II III", .ring = "1 1 1",
+                               .plugboard = "AB CD", .indicator = "1 1 1"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    size_t length = filter_letters(input, input, input_size);
+    encipher_letters(ENGINE_REFERENCE, NULL, &enigma, input, input, length);
+
+    size_t output_length;
+    output_fd = open(output_path, O_RDONLY);
+    char *output = read_all(output_fd, &output_length);
+    ASSERT(output_length == length + 1 && output[length] == '\n');
+    ASSERT(memcmp(output, input, length) == 0);
+    close(output_fd);
+    free(output);
+    free(input);
+    unlink(input_path);
+    unlink(output_path);
+}
+
+TEST(test_redirected_output) {
+    /* a stdout redirected with `>>` is written, not mapped, so nothing is truncated */
+    char input_path[] = "/tmp/enigma-test-input-XXXXXX";
+    char output_path[] = "/tmp/enigma-test-output-XXXXXX";
+    int input_fd = mkstemp(input_path);
+    int output_fd = mkstemp(output_path);
+    ASSERT(input_fd >= 0 && output_fd >= 0);
+    write_fully(input_fd, "AAAAA", 5);
+    write_fully(output_fd, "LOG\n", 4);
+    close(input_fd);
+    close(output_fd);
+
+    output_fd = open(output_path, O_WRONLY | O_APPEND);
+    ASSERT(output_fd >= 0 && dup2(output_fd, STDOUT_FILENO) == STDOUT_FILENO);
+    close(output_fd);
+    char *argv[] = {"0", "-i", input_path};
+    int argc = sizeof(argv) / sizeof(argv[0]);
+    ASSERT(enigma_cli_main(argc, argv) == 0);
+
+    char output[64] = {0};
+    output_fd = open(output_path, O_RDONLY);
+    ASSERT(read(output_fd, output, sizeof(output) - 1) == 12);
+    ASSERT_CSTR_EQ(output, "LOG\nBDZGO  \n");
+    close(output_fd);
+    unlink(input_path);
+    unlink(output_path);
+}
+
+TEST(
+    test_stream_file_input, 
+    .input =         "AAAAA",
+    .expect_output = "BDZGO  \n"
+) {
+    /* a pipe given with -i can't be mapped, so it is read like stdin */
+    char *argv[] = {"0", "-i", "/dev/stdin", "-t", "2"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_batch_csv, 
+    .input =         "m1,UKW-B,I II III,1 1 1,,1 1 1,AAAAA\n"
+                     "m2,UKW-C,II IV I,6 17 26,AC LS BQ WN MY UV FJ PZ TR OK,HAG,hello, world\r\n"
+                     "\n"
+                     "m3,,,,,,AAAAA AAAAA",
+    .expect_output = "m1,BDZGO\nm2,OMPRCRQUKU\nm3,BDZGOWCXLT\n"
+) {
+    char *argv[] = {"0", "--batch", "-", "-t", "2"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_batch_rejects_output_format, 
+    .input =         "m1,,,,,,AAAAA\n",
+    .expect_exit_code = 1
+) {
+    char *argv[] = {"0", "--batch", "-", "-f", "raw"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_batch_csv_lanes, 
+    .input =         "m1,UKW-B,I II III,1 1 1,,1 1 1,AAAAA\n"
+                     "m2,UKW-C,II IV I,6 17 26,AC LS BQ WN MY UV FJ PZ TR OK,HAG,hello, world\r\n"
+                     "m0,,,,,,\n"
+                     "m3,,,,,,AAAAA AAAAA\n"
+                     "m4,,,,,,AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA",
+    .expect_output = "m1,BDZGO\nm2,OMPRCRQUKU\nm0,\nm3,BDZGOWCXLT\n"
+                     "m4,BDZGOWCXLTKSBTMCDLPBMUQOFXYHCXTGYJFLINHNXSHIUNTHEORXPQPKOVHCBUBTZSZSOO\n"
+) {
+    /* m4 is too long for the lanes, so it is enciphered on its own */
+    char *argv[] = {"0", "--batch", "-", "-e", "simd"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_procedure_doubled_indicator, 
+    .input =         "ENIIA YPKXM OTURJ CQF",
+    .expect_output = "ATTAC KATDA WN \n"
+) {
+    char *argv[] = {"0", "-g", "ABC", "--procedure", "doubled-indicator"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_procedure_inconsistent_indicator, 
+    .input =         "ENIIA QPKXM OTURJ CQF",
+    .expect_output = "ATTAC KATDA WN \n",
+    .expect_exit_code = 1
+) {
+    char *argv[] = {"0", "-g", "ABC", "--procedure", "doubled-indicator"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_procedure_single_indicator, 
+    .input =         "QRSFT CPKXM OTURJ CQF",
+    .expect_output = "ATTAC KATDA WN \n"
+) {
+    char *argv[] = {"0", "--procedure", "single-indicator"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_procedure_packed_input, 
+    .input =         "\x23\x50\x80\x61\xea\xbb\x1d\x3a\x45\x22\x81\x7f",
+    .expect_output = "ATTAC KATDA WN \n"
+) {
+    char *argv[] = {"0", "-g", "ABC", "--procedure", "doubled-indicator", "--input-format", "packed", "-t", "2"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_batch_doubled_indicator, 
+    .input =         "m1,,,,,ABC,ENIIAYPKXMOTURJCQF\n"
+                     "m2,,,,,ABC,ENI\n",
+    .expect_output = "m1,ATTACKATDAWN\nm2,\n"
+) {
+    char *argv[] = {"0", "--batch", "-", "-e", "simd", "--procedure", "doubled-indicator"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(test_place_cribs) {
+    /* compare against a naive placement, across SIMD blocks and the ciphertext end */
+    char ciphertext[1000];
+    u64 state = 12345;
+    for (size_t i = 0; i < sizeof(ciphertext); i++) {
+        ciphertext[i] = DECODE(next_random(&state) % 26);
+    }
+    const char *cribs[] = {"WETTERBERICHT", "ANX", "KEINEBESONDERENEREIGNISSEXXOBERKOMMANDODERWEHRMACHT"};
+    size_t crib_lengths[] = {13, 3, 51};
+    static u64 feasible[sizeof(ciphertext)];
+    size_t n_feasible = place_cribs(ciphertext, sizeof(ciphertext), cribs, crib_lengths, 3, feasible);
+    size_t n_expected = 0;
+    for (size_t i = 0; i < sizeof(ciphertext); i++) {
+        for (size_t c = 0; c < 3; c++) {
+            b8 fits = (i + crib_lengths[c] <= sizeof(ciphertext));
+            for (size_t j = 0; fits && j < crib_lengths[c]; j++) {
+                fits = (ciphertext[i + j] != cribs[c][j]);
+            }
+            ASSERT(((feasible[i] >> c) & 1) == fits);
+            n_expected += fits;
+        }
+    }
+    ASSERT(n_feasible == n_expected);
+}
+
+TEST(
+    test_crib_positions,
+    .input = "QWEAN XANXB",
+    .expect_output = "0 ANX\n"
+                     "0 NAX\n"
+                     "1 ANX\n"
+                     "1 NAX\n"
+                     "2 ANX\n"
+                     "4 ANX\n"
+                     "5 ANX\n"
+                     "7 ANX\n"
+) {
+    char *argv[] = {"0", "--crib-positions", "anx,N-A-X"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_search_indicator, 
+    .input =         "FLGLDALVHAAOZEMMRHTMVZTJIBLYZJVLJAHXHXANHLJCNZYH\n",
+    .expect_output = "KZQ THEQUICKBROWNFOXJUMPSOVERTHELAZYDOGWETTERBERICHT\n"
+) {
+    char *argv[] = {"0", "-w", "II IV I", "-r", "6 17 26", "-s", "AC LS BQ WN MY UV FJ PZ TR OK",
+                    "--search-indicator", "--crib", "wetterbericht", "--crib-offset", "35", "-t", "2"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_search_ioc, 
+    .input =
+                     "NUXYFVBZABIOHQLYDMNTMUQUFOAVVFDINXEACLXHFDWTVJBCTNLHHOXIHIAGJDCK"
+                     "FBWVTTXUKBFSFTRLLBWFNWGKTGNUSIUDOSGPPQQMGNQXVYHQFQGWAPBFJDJOKPSC"
+                     "OJBBWEZWQQKLFTRKBTWXOBAEAHRDTMZQVVDTXRVPYEQUCDWXAKWFULPEHQHWJJON"
+                     "YMHXOFCUEBAJFIVSZLHCXBYAKPAXBVFQAIWZTJACFKAMHANTOPYQOOSKCSPRTLVB"
+                     "BLMW",
+    .expect_output = "0.0750 -u UKW-B -w \"III I II\" -r \"1 1 1\" -g \"QEV\"\n"
+) {
+    char *argv[] = {"0", "--search-ioc", "--search-rotors", "I II III", "--search-reflectors", "UKW-B", 
+                    "--top", "1", "-t", "2"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(test_search_ioc_bitsliced) {
+    /* the bitsliced scorer ranks the candidates just like the tables do */
+    const char *ciphertext = "NUXYFVBZABIOHQLYDMNTMUQUFOAVVFDINXEACLXHFDWTVJBCTNLHHOXIHIAGJDCK"
+                             "FBWVTTXUKBFSFTRLLBWFNWGKTGNUSIUDOSGPPQQMGNQXVYHQFQGWAPBFJDJOKPSC";
+    size_t length = strlen(ciphertext);
+    Enigma enigma = {0};
+    EnigmaSettings settings = {"UKW-B", "I II III", "1 1 5", "AZ BY CX", NULL};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    const char *reflectors[] = {"UKW-B", "UKW-C"};
+    const char *rotors[] = {"I", "II", "III"};
+
+    static Candidate tables[20];
+    static Candidate bitsliced[20];
+    size_t n = search_ioc(&enigma, ciphertext, length, reflectors, 2, rotors, 3, false, false, 20, tables, 1);
+    ASSERT(search_ioc(&enigma, ciphertext, length, reflectors, 2, rotors, 3, false, true, 20, bitsliced, 1) == n);
+    ASSERT(n == 20);
+    for (size_t i = 0; i < n; i++) {
+        ASSERT(tables[i].score == bitsliced[i].score && tables[i].reflector == bitsliced[i].reflector);
+        ASSERT(memcmp(tables[i].rotors, bitsliced[i].rotors, 3) == 0);
+        ASSERT(memcmp(tables[i].rings, bitsliced[i].rings, 3) == 0);
+        ASSERT(tables[i].position == bitsliced[i].position);
+    }
+}
+
+TEST(test_refine_candidate) {
+    /* a key with the canonical middle ring setting is moved to the best key of its class */
+    const char *text = "IT WAS THE BEST OF TIMES IT WAS THE WORST OF TIMES IT WAS THE AGE OF WISDOM IT WAS "
+                       "THE AGE OF FOOLISHNESS IT WAS THE EPOCH OF BELIEF IT WAS THE EPOCH OF INCREDULITY";
+    size_t length = strlen(text);
+    char *ciphertext = malloc(length);
+    length = filter_letters(ciphertext, text, length);
+    Enigma enigma = {0};
+    EnigmaSettings settings = {.reflector = "UKW-B", .rotors = "III I II", .ring = "1 7 12", 
+                               .plugboard = "", .indicator = "QEV"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    encipher_letters(ENGINE_REFERENCE, NULL, &enigma, ciphertext, ciphertext, length);
+
+    const char *reflectors[] = {"UKW-B"};
+    const char *rotors[] = {"I", "II", "III"};
+    IocSearch search = {.enigma = &enigma, .length = length, .reflectors = reflectors, .rotors = rotors};
+    Candidate candidate = {.reflector = 0, .rotors = {2, 0, 1}, .rings = {0, 0, 11}, 
+                           .position = ENCODE('Q') * 26 * 26 + ENCODE('Y') * 26 + ENCODE('V')};
+    refine_candidate(&search, ciphertext, &candidate);
+
+    /* the true key is in the class of the refined candidate */
+    u8 shift = (u8) ((6 + 26 - candidate.rings[1]) % 26);
+    ASSERT((candidate.equivalents & 1) && ((candidate.equivalents >> shift) & 1));
+    ASSERT((candidate.position / 26) % 26 == (ENCODE('E') + 26 - shift) % 26);
+    ASSERT(candidate.score > 0);
+    free(ciphertext);
+}
+
+TEST(test_search_plugboard) {
+    const char *text = "IT WAS THE BEST OF TIMES IT WAS THE WORST OF TIMES IT WAS THE AGE OF WISDOM IT WAS "
+                       "THE AGE OF FOOLISHNESS IT WAS THE EPOCH OF BELIEF IT WAS THE EPOCH OF INCREDULITY "
+                       "IT WAS THE SEASON OF LIGHT IT WAS THE SEASON OF DARKNESS IT WAS THE SPRING OF HOPE";
+
+    /* a trigram model of the plaintext itself */
+    static u32 counts[26 * 26 * 26];
+    char letters[512];
+    size_t n_letters = filter_letters(letters, text, strlen(text));
+    for (size_t i = 2; i < n_letters; i++) {
+        counts[ENCODE(letters[i - 2]) * 26 * 26 + ENCODE(letters[i - 1]) * 26 + ENCODE(letters[i])]++;
+    }
+    char path[] = "/tmp/enigma-test-ngrams-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    for (int i = 0; i < 26 * 26 * 26; i++) {
+        if (counts[i] > 0) {
+            dprintf(fd, "%c%c%c %u\n", DECODE(i / (26 * 26)), DECODE((i / 26) % 26), DECODE(i % 26), counts[i]);
+        }
+    }
+    close(fd);
+    NgramModel model;
+    load_ngram_model(&model, path, 3);
+    unlink(path);
+    ASSERT(model.n == 3);
+
+    Enigma enigma;
+    EnigmaSettings settings = {"UKW-B", "III I II", "1 1 1", "AN CX EH", "QEV"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    char ciphertext[512];
+    size_t length = encipher_text(ENGINE_REFERENCE, NULL, &enigma, ciphertext, text, strlen(text));
+
+    settings.plugboard = "";
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    u8 plugboard[26];
+    for (u8 n = 0; n < 26; n++) {
+        plugboard[n] = n;
+    }
+    search_plugboard(&enigma, &model, ciphertext, length, 3, 0, 4, plugboard, 2);
+    ASSERT(plugboard[ENCODE('A')] == ENCODE('N') && plugboard[ENCODE('C')] == ENCODE('X') && 
+           plugboard[ENCODE('E')] == ENCODE('H'));
+    free_ngram_model(&model);
+}
+
+TEST(test_search_plugboard_offset) {
+    /* a message enciphered from letter 20 on, searched for with --offset and the table engine */
+    const char *text = "IT WAS THE BEST OF TIMES IT WAS THE WORST OF TIMES IT WAS THE AGE OF WISDOM IT WAS "
+                       "THE AGE OF FOOLISHNESS IT WAS THE EPOCH OF BELIEF IT WAS THE EPOCH OF INCREDULITY "
+                       "IT WAS THE SEASON OF LIGHT IT WAS THE SEASON OF DARKNESS IT WAS THE SPRING OF HOPE";
+    static u32 counts[26 * 26 * 26];
+    char letters[512];
+    size_t n_letters = filter_letters(letters, text, strlen(text));
+    for (size_t i = 2; i < n_letters; i++) {
+        counts[ENCODE(letters[i - 2]) * 26 * 26 + ENCODE(letters[i - 1]) * 26 + ENCODE(letters[i])]++;
+    }
+    char ngram_path[] = "/tmp/enigma-test-ngrams-XXXXXX";
+    char input_path[] = "/tmp/enigma-test-input-XXXXXX";
+    char output_path[] = "/tmp/enigma-test-output-XXXXXX";
+    int ngram_fd = mkstemp(ngram_path);
+    int input_fd = mkstemp(input_path);
+    int output_fd = mkstemp(output_path);
+    ASSERT(ngram_fd >= 0 && input_fd >= 0 && output_fd >= 0);
+    for (int i = 0; i < 26 * 26 * 26; i++) {
+        if (counts[i] > 0) {
+            dprintf(ngram_fd, "%c%c%c %u\n", DECODE(i / (26 * 26)), DECODE((i / 26) % 26), DECODE(i % 26), counts[i]);
+        }
+    }
+    close(ngram_fd);
+
+    Enigma enigma;
+    EnigmaSettings settings = {"UKW-B", "III I II", "1 1 1", "AN CX EH", "QEV"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    advance_enigma(&enigma, 20);
+    char ciphertext[512];
+    encipher_letters(ENGINE_REFERENCE, NULL, &enigma, ciphertext, letters, n_letters);
+    write_fully(input_fd, ciphertext, n_letters);
+    close(input_fd);
+    close(output_fd);
+
+    char *argv[] = {"0", "--search-plugboard", "--ngrams", ngram_path, "--ngram-length", "3", "--max-pairs", "3",
+                    "--restarts", "4", "-u", "UKW-B", "-w", "III I II", "-g", "QEV", "--offset", "20", 
+                    "-e", "table", "-t", "2", "-i", input_path, "-o", output_path};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    ASSERT(enigma_cli_main(argc, argv) == 0);
+
+    static char output[1024];
+    output_fd = open(output_path, O_RDONLY);
+    ASSERT(read(output_fd, output, sizeof(output) - 1) > 0);
+    char *decryption = strchr(output, '\n') + 1;
+    ASSERT(strstr(output, "-s \"AN CX EH\" -g \"QEV\" --offset 20\n") != NULL);
+    ASSERT(strncmp(decryption, letters, n_letters) == 0);
+    close(output_fd);
+    unlink(ngram_path);
+    unlink(input_path);
+    unlink(output_path);
+}
+
+TEST(test_build_ngrams) {
+    const char *corpus = "The quick brown fox jumps over the lazy dog. The end; then THE END.";
+    char corpus_path[] = "/tmp/enigma-test-corpus-XXXXXX";
+    char table_path[] = "/tmp/enigma-test-ngrams-XXXXXX";
+    int corpus_fd = mkstemp(corpus_path);
+    int table_fd = mkstemp(table_path);
+    ASSERT(corpus_fd >= 0 && table_fd >= 0);
+    write_fully(corpus_fd, corpus, strlen(corpus));
+    lseek(corpus_fd, 0, SEEK_SET);
+    build_ngram_file(corpus_fd, table_fd);
+    close(corpus_fd);
+    close(table_fd);
+    unlink(corpus_path);
+
+    NgramModel model;
+    load_ngram_model(&model, table_path, 4);
+    ASSERT(model.n == 4 && model.size == 26 * 26 * 26 * 26);
+    ASSERT(model.mapping != NULL && model.owned_scores == NULL);
+    ASSERT(model.scores[((ENCODE('T') * 26 + ENCODE('H')) * 26 + ENCODE('E')) * 26 + ENCODE('E')] > 0);
+    ASSERT(model.scores[0] == 0);
+    free_ngram_model(&model);
+
+    load_ngram_model(&model, table_path, 1);
+    unlink(table_path);
+    ASSERT(model.n == 1 && model.size == 26);
+    ASSERT(model.scores[ENCODE('E')] > model.scores[ENCODE('Q')]);
+    ASSERT(ngram_log_prob(&model, model.scores[ENCODE('Q')], 1) < -1.0);
+    free_ngram_model(&model);
+}
+
+TEST(test_cycle_catalog) {
+    /* a day's doubled indicators, with enough message keys to reveal AD, BE, and CF fully */
+    Enigma daily;
+    EnigmaSettings settings = {"UKW-B", "II I III", "1 1 1", "AQ BW CE DR", "KQR"};
+    ASSERT(configure_enigma(&daily, &settings) == ENIGMA_OK);
+    char indicators[200 * 6];
+    u64 state = 5;
+    for (int i = 0; i < 200; i++) {
+        char key[6];
+        for (int k = 0; k < 3; k++) {
+            key[k] = key[k + 3] = DECODE(next_random(&state) % 26);
+        }
+        Enigma e = daily;
+        encipher_letters(ENGINE_REFERENCE, NULL, &e, &indicators[6 * i], key, 6);
+    }
+    u8 products[3][26];
+    ASSERT(observe_products(indicators, 200, products));
+    u32 characteristic = rank_characteristic(products);
+    ASSERT(characteristic < N_CHARACTERISTICS);
+
+    const char *reflectors[] = {"UKW-B"};
+    const char *rotors[] = {"I", "II", "III"};
+    char catalog_path[] = "/tmp/enigma-test-catalog-XXXXXX";
+    int catalog_fd = mkstemp(catalog_path);
+    ASSERT(catalog_fd >= 0);
+    build_catalog(catalog_fd, reflectors, 1, rotors, 3, 2);
+    close(catalog_fd);
+    Catalog catalog;
+    load_catalog(&catalog, catalog_path);
+    unlink(catalog_path);
+    ASSERT(catalog.n_settings == 6 && catalog.offsets[N_CHARACTERISTICS] == 6 * N_POSITIONS);
+
+    /* the daily key (sans plugboard) is among the candidates */
+    b8 found = false;
+    for (u32 i = catalog.offsets[characteristic]; i < catalog.offsets[characteristic + 1]; i++) {
+        const CatalogSetting *setting = &catalog.settings[catalog.entries[i] / N_POSITIONS];
+        found |= strcmp(setting->rotors, "II I III") == 0 && 
+                 catalog.entries[i] % N_POSITIONS == (ENCODE('K') * 26 + ENCODE('Q')) * 26 + ENCODE('R');
+    }
+    ASSERT(found);
+    free_catalog(&catalog);
+
+    /* a contradiction, and an incomplete product */
+    memcpy(indicators, "AAAAAA" "ABBBBB", 12);
+    ASSERT(!observe_products(indicators, 2, products));
+    ASSERT(observe_products(indicators, 1, products));
+    ASSERT(rank_characteristic(products) == N_CHARACTERISTICS);
+}
+
+TEST(test_bombe) {
+    const char *text = "WETTERVORHERSAGEBISKAYAXXNEBELUNDREGENXXDERKOMMANDANTX";
+    const char *crib = "WETTERVORHERSAGEBISKAYA";
+    Enigma enigma;
+    EnigmaSettings settings = {"UKW-B", "II V III", "1 1 1", "AR BY CQ DJ EK FW GL HT IM NO", "QXE"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    char ciphertext[64];
+    encipher_text(ENGINE_REFERENCE, NULL, &enigma, ciphertext, text, strlen(text));
+
+    Menu menu;
+    build_menu(&menu, ciphertext, crib, strlen(crib));
+    ASSERT(menu.n_links == 23 && menu.n_letters == 23 && menu.n_loops == 3);
+
+    const char *reflectors[] = {"UKW-B"};
+    const char *rotors[] = {"II", "III", "V"};
+    size_t n_stops;
+    BombeStop *stops = run_bombe(&enigma, &menu, 0, reflectors, 1, rotors, 3, &n_stops, 2);
+    ASSERT(n_stops == 1);
+    ASSERT(stops[0].rotors[0] == 0 && stops[0].rotors[1] == 2 && stops[0].rotors[2] == 1);
+    ASSERT(stops[0].position == ENCODE('Q') * 26 * 26 + ENCODE('X') * 26 + ENCODE('E'));
+    for (int n = 0; n < 26; n++) {
+        ASSERT(stops[0].plugboard[n] == ENCODE(enigma.plugboard.image[n]));
+    }
+    free(stops);
+    free_menu(&menu);
+}
+
+TEST(test_bombe_crib_offset) {
+    /* a crib 700 letters into the message, past a turnover of the left rotor */
+    static char text[800];
+    memset(text, 'X', 700);
+    strcpy(&text[700], "WETTERVORHERSAGEBISKAYAXXNEBELUNDREGEN");
+    const char *crib = "WETTERVORHERSAGEBISKAYA";
+    Enigma enigma;
+    EnigmaSettings settings = {"UKW-B", "II V III", "1 1 1", "AR BY CQ DJ EK FW GL HT IM NO", "QXE"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    static char ciphertext[800];
+    encipher_text(ENGINE_REFERENCE, NULL, &enigma, ciphertext, text, strlen(text));
+
+    Menu menu;
+    build_menu(&menu, &ciphertext[700], crib, strlen(crib));
+    const char *reflectors[] = {"UKW-B"};
+    const char *rotors[] = {"II", "III", "V"};
+    size_t n_stops;
+    BombeStop *stops = run_bombe(&enigma, &menu, 700, reflectors, 1, rotors, 3, &n_stops, 2);
+    b8 found = false;
+    for (size_t i = 0; i < n_stops; i++) {
+        found |= (stops[i].rotors[0] == 0 && stops[i].rotors[1] == 2 && stops[i].rotors[2] == 1 &&
+                  stops[i].position == ENCODE('Q') * 26 * 26 + ENCODE('X') * 26 + ENCODE('E'));
+    }
+    ASSERT(found);
+    free(stops);
+    free_menu(&menu);
+}
+
+TEST(test_batch_binary_records) {
+    char data[] = "\x02\0\0\0" "m1" "\x05\0\0\0" "UKW-B" "\x08\0\0\0" "I II III" 
+                  "\x05\0\0\0" "1 1 1" "\0\0\0\0" "\x05\0\0\0" "1 1 1" "\x05\0\0\0" "AAAAA";
+    size_t n_records;
+    BatchRecord *records = parse_batch_binary(data, sizeof(data) - 1, &n_records);
+    ASSERT(n_records == 1);
+    ASSERT_CSTR_EQ(records[0].id, "m1");
+    ASSERT_CSTR_EQ(records[0].settings.rotors, "I II III");
+    ASSERT_CSTR_EQ(records[0].settings.plugboard, "");
+    ASSERT_CSTR_EQ(records[0].message, "AAAAA");
+    ASSERT(records[0].length == 5);
+    free(records);
+}
+
+TEST(test_machine_cache) {
+    EnigmaSettings settings = {"UKW-C", "II IV I", "6 17 26", "AC LS BQ WN MY UV FJ PZ TR OK", "HAG"};
+    EnigmaSettings other = {"UKW-B", "I II III", "1 1 1", "", "1 1 1"};
+    EnigmaSettings invalid = {"UKW-B", "I II X", "1 1 1", "", "1 1 1"};
+    MachineCache cache;
+    init_machine_cache(&cache, ENGINE_REFERENCE, sizeof(CachedMachine) + 64);
+
+    CachedMachine *a = acquire_machine(&cache, &settings);
+    settings.indicator = "AAA"; /* not part of the key */
+    CachedMachine *b = acquire_machine(&cache, &settings);
+    ASSERT(a != NULL && a == b);
+    ASSERT(cache.n_hits == 1 && cache.n_misses == 1);
+    ASSERT(acquire_machine(&cache, &invalid) == NULL);
+    settings.plugboard = "OK TR PZ FJ UV MY WN BQ LS AC"; /* the same machine */
+    CachedMachine *d = acquire_machine(&cache, &settings);
+    ASSERT(d == a && cache.n_misses == 1);
+    release_machine(&cache, a);
+    release_machine(&cache, b);
+    release_machine(&cache, d);
+
+    /* only one machine fits, so acquiring another evicts the first one */
+    CachedMachine *c = acquire_machine(&cache, &other);
+    release_machine(&cache, c);
+    ASSERT(cache.head == c && cache.tail == c);
+    free_machine_cache(&cache);
+    ASSERT(cache.head == NULL && cache.size == 0);
+}
+
+static void *serve_thread(void *arg)
+{
+    static const EnigmaSettings defaults = {"UKW-B", "I II III", "1 1 1", "", "1 1 1"};
+    static MachineCache cache;
+    init_machine_cache(&cache, ENGINE_TABLE, 1024 * 1024);
+    serve(*(int *) arg, &cache, &defaults);
+    return NULL;
+}
+
+TEST(test_serve_pipelined_requests) {
+    char path[] = "/tmp/enigma-test-socket-XXXXXX";
+    close(mkstemp(path));
+    int listen_fd = open_server_socket(path);
+    pthread_t thread;
+    ASSERT(pthread_create(&thread, NULL, serve_thread, &listen_fd) == 0);
+
+    ByteBuffer request = {0};
+    const char *records[][7] = {
+        {"m1", "", "", "", "", "", "AAAAA"},
+        {"m2", "UKW-C", "II IV I", "6 17 26", "AC LS BQ WN MY UV FJ PZ TR OK", "HAG", "hello, world"},
+        {"m3", "", "I II X", "", "", "", "AAAAA"},
+    };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 7; j++) {
+            append_field(&request, records[i][j], strlen(records[i][j]));
+        }
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT(connect(fd, (const struct sockaddr *) &addr, sizeof(addr)) == 0);
+    write_fully(fd, request.data, request.length);
+    shutdown(fd, SHUT_WR);
+
+    size_t size;
+    char *response = read_all(fd, &size);
+    char *fields[9];
+    size_t lengths[9];
+    ASSERT(parse_fields(response, size, 9, fields, lengths) == size);
+    ASSERT_CSTR_EQ(fields[0], "m1");
+    ASSERT_CSTR_EQ(fields[1], "ok");
+    ASSERT_CSTR_EQ(fields[2], "BDZGO");
+    ASSERT_CSTR_EQ(fields[3], "m2");
+    ASSERT_CSTR_EQ(fields[4], "ok");
+    ASSERT_CSTR_EQ(fields[5], "OMPRCRQUKU");
+    ASSERT_CSTR_EQ(fields[6], "m3");
+    ASSERT_CSTR_EQ(fields[7], "error");
+    ASSERT_CSTR_EQ(fields[8], "Unknown rotor \"X\".");
+    unlink(path);
+}
+
+TEST(
+    test_connect_with_offset,
+    .input =         "AAAAA",
+    .expect_output = "WCXLT  \n"
+) {
+    /* the daemon enciphers from the offset, just like enciphering locally would */
+    char path[] = "/tmp/enigma-test-socket-XXXXXX";
+    close(mkstemp(path));
+    int listen_fd = open_server_socket(path);
+    pthread_t thread;
+    ASSERT(pthread_create(&thread, NULL, serve_thread, &listen_fd) == 0);
+
+    char *argv[] = {"0", "--offset", "5", "--connect", path};
+    int argc = sizeof(argv) / sizeof(argv[0]);
+    int exit_code = enigma_cli_main(argc, argv);
+    unlink(path);
+    exit(exit_code);
+}
+
 TEST(
     test_unknown_characters, 
     .input =         "A;AA,öäööAA-AAAAA",
@@ -231,6 +966,43 @@ TEST(
     exit(exit_code);
 }
 
+/* Repeats a string literal 4^7 times */
+#define REPEAT_4(s)     s s s s
+#define REPEAT_16384(s) REPEAT_4(REPEAT_4(REPEAT_4(REPEAT_4(REPEAT_4(REPEAT_4(REPEAT_4(s)))))))
+
+TEST(
+    test_input_larger_than_chunk_size, 
+    .input =         "AAA" REPEAT_16384("    ") "AAAAAAA",
+    .expect_output = "BDZGO WCXLT  \n"
+) {
+    char *argv[] = {"0"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_threads_input_larger_than_partition_size, 
+    .input =         "AAA" REPEAT_16384("                ") "AAAAAAA",
+    .expect_output = "BDZGO WCXLT  \n"
+) {
+    char *argv[] = {"0", "--threads", "3"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_threads_table_engine_double_step, 
+    .input =         "AAAAA AAAAA",
+    .expect_output = "HDZGO VBUYP  \n"
+) {
+    char *argv[] = {"0", "--rotors", "III II I", "--indicator-setting", "ADO", "--engine", "table", "--threads", "4"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
 TEST(
     test_double_step, 
     .input =         "AAAAA AAAAA",
@@ -260,6 +1032,344 @@ TEST(
     exit(exit_code);
 }
 
+TEST(
+    test_table_engine_double_step, 
+    .input =         "AAAAA AAAAA",
+    .expect_output = "HDZGO VBUYP  \n"
+) {
+    char *argv[] = {"0", "--rotors", "III II I", "--indicator-setting", "ADO", "--engine", "table"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_table_engine_valid_machine_settings, 
+    .input =         "AAAAA AAAAA",
+    .expect_output = "VFEZT BNMFM  \n"
+) {
+    char *argv[] = {
+        "0", 
+        "--reflector",         "UKW-C", 
+        "--rotors",            "III II I", 
+        "--ring-setting",      "1 23 16",
+        "--indicator-setting", "HAG",
+        "--plugboard-setting", "AB CD kf Pz XR",
+        "--engine",            "table"
+    };
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_invalid_engine_setting_1, 
+    .expect_exit_code = 1,
+    .input = "\n"
+) {
+    char *argv[] = {"0", "--engine", "turbo"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(test_advance_enigma_matches_stepping) {
+    const Rotor *rotors[] = {
+        &ROTOR_I, &ROTOR_II, &ROTOR_III, &ROTOR_IV, 
+        &ROTOR_V, &ROTOR_VI, &ROTOR_VII, &ROTOR_VIII
+    };
+    for (int m = 0; m < 8; m++) {
+        for (int r = 0; r < 8; r++) {
+            for (u8 m_pos = 0; m_pos < 26; m_pos++) {
+                for (u8 r_pos = 0; r_pos < 26; r_pos += 3) {
+                    Enigma start = {.rotor = {ROTOR_I, *rotors[m], *rotors[r]}};
+                    start.rotor[0].position = 7;
+                    start.rotor[1].position = m_pos;
+                    start.rotor[2].position = r_pos;
+                    Enigma stepped = start;
+                    for (u64 n = 0; n < 1500; n++) {
+                        Enigma advanced = start;
+                        advance_enigma(&advanced, n);
+                        ASSERT(pack_positions(&advanced) == pack_positions(&stepped));
+                        step_rotors(&stepped);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(
+    test_offset, 
+    .input =         "AAAAA",
+    .expect_output = "VBUYP  \n"
+) {
+    char *argv[] = {"0", "--rotors", "III II I", "--indicator-setting", "ADO", "--offset", "5"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(
+    test_simd_engine_example_settings_encipher, 
+    .input =         "AAAAA AAAAA AAAAA AAAAA AAAAA AAAAA"
+                     "AAAAA AAAAA AAAAA AAAAA AAAAA AAAAA"
+                     "AAAAA AAAAA",
+    .expect_output = "MYIJE XBYWP MWCVO KJVWX KELDQ NPJVS \n"
+                     "FWSQO IBHMU HRTWV SRQIY TTJYG FBKDT \n"
+                     "YXYJT VMKCY  \n"
+) {
+    char *argv[] = {
+        "0", 
+        "-u", "UKW-C", 
+        "-w", "II IV I", 
+        "-r", "6 17 26", 
+        "-s", "ac ls bq wn my uv fj pz tr ok", 
+        "-g", "HAG",
+        "-e", "simd",
+    };
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(test_simd_kernels_match_reference) {
+#ifdef ENIGMA_X86_SIMD
+    Enigma enigma = {0};
+    apply_reflector_setting(&enigma, "UKW-B");
+    apply_rotor_setting(&enigma, "VI II VIII");
+    apply_ring_setting(&enigma, "3 26 14");
+    apply_plugboard_setting(&enigma, "AZ BY CX DW EV");
+    apply_indicator_setting(&enigma, "QEV");
+
+    SimdEnigma simd;
+    prepare_simd_enigma(&simd, &enigma);
+
+    for (int i = 0; i < 1000; i++) {
+        u8 positions[3][SIMD_BLOCK_SIZE];
+        u8 input[SIMD_BLOCK_SIZE];
+        u8 expected[SIMD_BLOCK_SIZE];
+        for (int k = 0; k < SIMD_BLOCK_SIZE; k++) {
+            step_rotors(&enigma);
+            for (int r = 0; r < 3; r++) {
+                positions[r][k] = enigma.rotor[r].position;
+            }
+            input[k] = (i * 7 + k * 3) % 26;
+            expected[k] = apply_machine_subst(&enigma, input[k]);
+        }
+
+        u8 output[SIMD_BLOCK_SIZE];
+        if (__builtin_cpu_supports("ssse3")) {
+            encipher_block_ssse3(&simd, output, input, (const u8 (*)[SIMD_BLOCK_SIZE]) positions);
+            ASSERT(memcmp(output, expected, SIMD_BLOCK_SIZE) == 0);
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            encipher_block_avx2(&simd, output, input, (const u8 (*)[SIMD_BLOCK_SIZE]) positions);
+            ASSERT(memcmp(output, expected, SIMD_BLOCK_SIZE) == 0);
+        }
+    }
+#endif
+}
+
+TEST(test_lane_kernels_match_reference) {
+    /* every lane with its own rotors, rings, plugboard, and position */
+    const char *rotors[] = {"I II III", "VI II VIII", "IV V VII", "VIII VII VI"};
+    const char *plugboards[] = {"", "AZ BY CX DW EV", "QW ER TZ UI OP AS DF GH JK LY", "MN"};
+    Enigma enigmas[MESSAGE_LANES];
+    LaneEnigmas lanes = {0};
+    u64 state = 7;
+    for (size_t l = 0; l < MESSAGE_LANES; l++) {
+        char ring[16], indicator[4];
+        snprintf(ring, sizeof(ring), "%d %d %d", (int) (next_random(&state) % 26) + 1, 
+                 (int) (next_random(&state) % 26) + 1, (int) (next_random(&state) % 26) + 1);
+        for (int i = 0; i < 3; i++) {
+            indicator[i] = DECODE(next_random(&state) % 26);
+        }
+        indicator[3] = '\0';
+        EnigmaSettings settings = {(l % 2) ? "UKW-B" : "UKW-C", rotors[l % 4], ring, plugboards[(l / 4) % 4], indicator};
+        ASSERT(configure_enigma(&enigmas[l], &settings) == ENIGMA_OK);
+        load_lane(&lanes, l, &enigmas[l]);
+    }
+
+    for (int i = 0; i < 100; i++) {
+        u8 expected[LANE_BLOCK_SIZE][MESSAGE_LANES];
+        u8 input[LANE_BLOCK_SIZE][MESSAGE_LANES];
+        for (size_t l = 0; l < MESSAGE_LANES; l++) {
+            for (size_t k = 0; k < LANE_BLOCK_SIZE; k++) {
+                input[k][l] = next_random(&state) % 26;
+                step_rotors(&enigmas[l]);
+                expected[k][l] = apply_machine_subst(&enigmas[l], input[k][l]);
+            }
+        }
+
+        LaneEnigmas scalar = lanes;
+        u8 output[LANE_BLOCK_SIZE][MESSAGE_LANES];
+        memcpy(output, input, sizeof(input));
+        encipher_lanes_scalar(&scalar, output, LANE_BLOCK_SIZE);
+        ASSERT(memcmp(output, expected, sizeof(expected)) == 0);
+#ifdef ENIGMA_X86_SIMD
+        if (__builtin_cpu_supports("avx2")) {
+            LaneEnigmas avx2 = lanes;
+            memcpy(output, input, sizeof(input));
+            encipher_lanes_avx2(&avx2, output, LANE_BLOCK_SIZE);
+            ASSERT(memcmp(output, expected, sizeof(expected)) == 0);
+            ASSERT(memcmp(avx2.position, scalar.position, sizeof(scalar.position)) == 0);
+        }
+#endif
+        lanes = scalar;
+    }
+}
+
+TEST(test_encipher_messages_matches_reference) {
+    /* more messages than lanes, of all lengths (including none), in no particular order */
+    enum { N_MESSAGES = 300 };
+    static char messages[N_MESSAGES][400];
+    static char expected[N_MESSAGES][400];
+    static char outputs[N_MESSAGES][400];
+    static Enigma enigmas[N_MESSAGES];
+    static Enigma reference[N_MESSAGES];
+    const char *message_ptrs[N_MESSAGES];
+    char *output_ptrs[N_MESSAGES];
+    size_t lengths[N_MESSAGES];
+    u64 state = 3;
+    for (int m = 0; m < N_MESSAGES; m++) {
+        char indicator[4] = {DECODE(m % 26), DECODE(m / 26 % 26), DECODE(m * 7 % 26), '\0'};
+        EnigmaSettings settings = {"UKW-B", (m % 2) ? "VI II VIII" : "I II III", "3 26 14", 
+                                   (m % 3) ? "AZ BY CX" : "", indicator};
+        ASSERT(configure_enigma(&enigmas[m], &settings) == ENIGMA_OK);
+        reference[m] = enigmas[m];
+        lengths[m] = next_random(&state) % 400;
+        for (size_t i = 0; i < lengths[m]; i++) {
+            messages[m][i] = DECODE(next_random(&state) % 26);
+        }
+        encipher_letters(ENGINE_REFERENCE, NULL, &reference[m], expected[m], messages[m], lengths[m]);
+        message_ptrs[m] = messages[m];
+        output_ptrs[m] = outputs[m];
+    }
+
+    encipher_messages(enigmas, output_ptrs, message_ptrs, lengths, N_MESSAGES);
+    for (int m = 0; m < N_MESSAGES; m++) {
+        ASSERT(memcmp(outputs[m], expected[m], lengths[m]) == 0);
+        ASSERT(memcmp(&enigmas[m], &reference[m], sizeof(Enigma)) == 0);
+    }
+}
+
+TEST(test_segment_engine_matches_reference) {
+    /* long enough for the left rotor to move, with double-notched rotors and double steps */
+    static char input[20000];
+    static char expected[20000];
+    static char output[20000];
+    for (size_t i = 0; i < sizeof(input); i++) {
+        input[i] = DECODE((i * 7 + i / 26) % 26);
+    }
+    Enigma enigma;
+    EnigmaSettings settings = {"UKW-B", "VI II VIII", "3 26 14", "AZ BY CX DW EV", "QDV"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+    Enigma reference = enigma;
+    encipher_letters(ENGINE_REFERENCE, NULL, &reference, expected, input, sizeof(input));
+    for (size_t split = 1; split < 60; split += 29) {
+        Enigma segment = enigma;
+        for (size_t i = 0; i < sizeof(input); i += split) {
+            size_t n = (sizeof(input) - i < split) ? sizeof(input) - i : split;
+            encipher_letters(ENGINE_SEGMENT, NULL, &segment, &output[i], &input[i], n);
+        }
+        ASSERT(memcmp(output, expected, sizeof(input)) == 0);
+        ASSERT(memcmp(&segment, &reference, sizeof(Enigma)) == 0);
+    }
+}
+
+TEST(
+    test_segment_engine_double_step, 
+    .input =         "AAAAA AAAAA",
+    .expect_output = "HDZGO VBUYP  \n"
+) {
+    char *argv[] = {"0", "--rotors", "III II I", "--indicator-setting", "ADO", "--engine", "segment"};
+    int argc = sizeof(argv) / sizeof(argv[0]); 
+    int exit_code = enigma_cli_main(argc, argv);
+    exit(exit_code);
+}
+
+TEST(test_score_keys_matches_reference) {
+    const char *ciphertext = "MYIJEXBYWPMWCVOKJVWXKELDQNPJVSFWSQOIBHMUHRTWVSRQIYTTJYGFBKDTYXYJTVMKCY"
+                             "QWERTZUIOPASDFGHJKLYXCVBNMQWERTZUIOPASDFGHJKLYXCVBNMAAAAAAAAAAAAAAAAAA";
+    size_t length = strlen(ciphertext);
+
+    /* keys with all kinds of ring settings, positions, and plugboards; more than one batch */
+    static Enigma keys[300];
+    const char *plugboards[] = {"", "AZ BY CX DW EV", "QW ER TZ UI OP AS DF GH JK LY", "MN"};
+    u64 state = 42;
+    for (int k = 0; k < 300; k++) {
+        char ring[16], indicator[4];
+        snprintf(ring, sizeof(ring), "%d %d %d", (int) (next_random(&state) % 26) + 1, 
+                 (int) (next_random(&state) % 26) + 1, (int) (next_random(&state) % 26) + 1);
+        for (int i = 0; i < 3; i++) {
+            indicator[i] = DECODE(next_random(&state) % 26);
+        }
+        indicator[3] = '\0';
+        EnigmaSettings settings = {"UKW-B", "VI II VIII", ring, plugboards[k % 4], indicator};
+        ASSERT(configure_enigma(&keys[k], &settings) == ENIGMA_OK);
+    }
+    static u64 scores[300];
+    ASSERT(score_keys(keys, 300, ciphertext, length, scores) == 300);
+
+    for (int k = 0; k < 300; k++) {
+        Enigma e = keys[k];
+        u64 counts[26] = {0};
+        for (size_t i = 0; i < length; i++) {
+            counts[ENCODE(encipher_char(&e, ciphertext[i]))]++;
+        }
+        u64 expected = 0;
+        for (int n = 0; n < 26; n++) {
+            expected += counts[n] * (counts[n] - 1);
+        }
+        ASSERT(scores[k] == expected);
+    }
+}
+
+TEST(test_filter_letters_matches_scalar) {
+    static char input[4096];
+    static char expected[4096];
+    static char letters[4096];
+    u32 seed = 1;
+    for (size_t i = 0; i < sizeof(input); i++) {
+        seed = seed * 1103515245 + 12345;
+        input[i] = (char) (seed >> 16);
+        if (i % 64 < 32) input[i] = 'a' + (i % 26); /* make sure some blocks are all letters */
+    }
+    for (size_t length = 0; length < sizeof(input); length += 97) {
+        size_t n_expected = filter_letters_scalar(expected, input, length);
+        size_t n = filter_letters(letters, input, length);
+        ASSERT(n == n_expected);
+        ASSERT(memcmp(letters, expected, n) == 0);
+
+        /* in place */
+        memcpy(letters, input, length);
+        n = filter_letters(letters, letters, length);
+        ASSERT(n == n_expected);
+        ASSERT(memcmp(letters, expected, n) == 0);
+    }
+}
+
+TEST(test_library_setup_errors) {
+    Enigma enigma;
+    EnigmaSettings settings = {"UKW-B", "I II III", "1 1 1", "", "1 1 1"};
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_OK);
+
+    char output[16];
+    size_t n = encipher_text(ENGINE_SIMD, NULL, &enigma, output, "Hello, World!", 13);
+    ASSERT(n == 10 && memcmp(output, "ILBDAAMTAZ", 10) == 0);
+
+    settings.rotors = "I II IX";
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_INVALID_ROTOR);
+    ASSERT_CSTR_EQ(enigma_error_message(), "Unknown rotor \"IX\".");
+    settings.rotors = "I II III";
+    settings.plugboard = "AB BC";
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_INVALID_PLUGBOARD);
+    settings.plugboard = "";
+    settings.indicator = "1 1 27";
+    ASSERT(configure_enigma(&enigma, &settings) == ENIGMA_INVALID_INDICATOR);
+}
+
 TEST(
     test_invalid_plugboard_setting_1, 
     .expect_exit_code = 1,